@@ -0,0 +1,173 @@
+#include "channel.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace aris {
+
+/// cases count whose lock order is kept on stack
+static const size_t select_inline_cases = 8;
+
+/// rotate first tried case, so select dont starve later cases
+static thread_local size_t select_round_ = 0;
+
+void ChannelBase::WaitQueue::push(ChannelWaiter* waiter) {
+    waiter->prev = tail_;
+    waiter->next = nullptr;
+    if (tail_ != nullptr)
+        tail_->next = waiter;
+    else
+        head_ = waiter;
+    tail_ = waiter;
+    waiter->linked = true;
+}
+
+void ChannelBase::WaitQueue::remove(ChannelWaiter* waiter) {
+    if (!waiter->linked)
+        return;
+    if (waiter->prev != nullptr)
+        waiter->prev->next = waiter->next;
+    else
+        head_ = waiter->next;
+    if (waiter->next != nullptr)
+        waiter->next->prev = waiter->prev;
+    else
+        tail_ = waiter->prev;
+    waiter->prev = waiter->next = nullptr;
+    waiter->linked = false;
+}
+
+ChannelWaiter* ChannelBase::WaitQueue::pop() {
+    ChannelWaiter* waiter = head_;
+    if (waiter != nullptr)
+        remove(waiter);
+    return waiter;
+}
+
+ChannelWaiter* ChannelBase::WaitQueue::claim() {
+    while (ChannelWaiter* waiter = pop()) {
+        // select may be completed by other channel already
+        int expected = -1;
+        if (waiter->context->fired.compare_exchange_strong(expected, waiter->index))
+            return waiter;
+    }
+    return nullptr;
+}
+
+void ChannelBase::close() {
+    // claimed waiters are unlinked, chain them through next
+    ChannelWaiter* wake = nullptr;
+    {
+        Mutex::Lock lock(mutex_);
+        if (closed_)
+            return;
+        closed_ = true;
+        // fail all parked operations
+        while (ChannelWaiter* waiter = senders_.claim()) {
+            waiter->context->ok = false;
+            waiter->next = wake;
+            wake = waiter;
+        }
+        while (ChannelWaiter* waiter = receivers_.claim()) {
+            waiter->context->ok = false;
+            waiter->next = wake;
+            wake = waiter;
+        }
+    }
+    while (wake != nullptr) {
+        // waiter may be released once notified
+        ChannelWaiter* next = wake->next;
+        wake->context->waiter.notify();
+        wake = next;
+    }
+}
+
+bool ChannelBase::is_closed() {
+    Mutex::Lock lock(mutex_);
+    return closed_;
+}
+
+// lock channels in address order, same channel is locked once
+static size_t lock_channels(ChannelCase* cases, size_t count, ChannelBase** order) {
+    for (size_t index = 0; index < count; index++)
+        order[index] = cases[index].channel;
+    std::sort(order, order + count);
+    size_t unique = std::unique(order, order + count) - order;
+    for (size_t index = 0; index < unique; index++)
+        order[index]->lock();
+    return unique;
+}
+
+static void unlock_channels(ChannelBase** order, size_t count) {
+    for (size_t index = count; index > 0; index--)
+        order[index - 1]->unlock();
+}
+
+int ChannelBase::select(ChannelCase* cases, size_t count, bool block, bool & ok) {
+    if (count == 0)
+        return -1;
+    ChannelBase* inline_order[select_inline_cases];
+    std::vector<ChannelBase*> heap_order;
+    ChannelBase** order = inline_order;
+    if (count > select_inline_cases) {
+        heap_order.resize(count);
+        order = heap_order.data();
+    }
+
+    size_t locked = lock_channels(cases, count, order);
+    size_t start = count > 1 ? select_round_++ % count : 0;
+    for (size_t n = 0; n < count; n++) {
+        size_t index = (start + n) % count;
+        ChannelCase& c = cases[index];
+        ChannelWaiter* wake = nullptr;
+        bool done = c.send ? c.channel->do_send(c.value, ok, wake) : c.channel->do_recv(c.value, ok, wake);
+        if (!done)
+            continue;
+        unlock_channels(order, locked);
+        if (wake != nullptr)
+            wake->context->waiter.notify();
+        return index;
+    }
+    if (!block) {
+        unlock_channels(order, locked);
+        return -1;
+    }
+
+    // park on every channel, first channel ready complete the wait.
+    // peers touch waiters and values while fiber is parked, keep them off its stack
+    std::unique_ptr<ChannelWaitContext> context(new ChannelWaitContext());
+    std::unique_ptr<ChannelWaiter[]> waiters(new ChannelWaiter[count]);
+    for (size_t index = 0; index < count; index++) {
+        ChannelCase& c = cases[index];
+        ChannelWaiter& waiter = waiters[index];
+        waiter.context = context.get();
+        waiter.index = index;
+        waiter.value = c.channel->park_value(c.value, c.send);
+        if (c.send)
+            c.channel->senders_.push(&waiter);
+        else
+            c.channel->receivers_.push(&waiter);
+    }
+    unlock_channels(order, locked);
+    context->waiter.wait();
+
+    // remove waiters left on other channels
+    locked = lock_channels(cases, count, order);
+    for (size_t index = 0; index < count; index++) {
+        ChannelCase& c = cases[index];
+        if (c.send)
+            c.channel->senders_.remove(&waiters[index]);
+        else
+            c.channel->receivers_.remove(&waiters[index]);
+    }
+    unlock_channels(order, locked);
+    ok = context->ok;
+    int fired = context->fired.load();
+    for (size_t index = 0; index < count; index++) {
+        ChannelCase& c = cases[index];
+        c.channel->unpark_value(waiters[index].value, c.value, c.send, fired == static_cast<int>(index) && ok);
+    }
+    return fired;
+}
+
+}
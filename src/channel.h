@@ -0,0 +1,379 @@
+/**
+ * @file channel.h
+ * @author aris
+ * @brief bounded mpmc channel for fiber message passing
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_CHANNEL_H__
+#define __STUDY_SRC_CHANNEL_H__
+
+#include "fiber_sync.h"
+#include "noncopable.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief fixed capacity ring buffer, each slot and index own a cache line
+ */
+template <typename T>
+class RingBuffer : Noncopable {
+public:
+    explicit RingBuffer(size_t capacity): capacity_(capacity), slots_(capacity) {}
+
+    bool empty() const { return head_ == tail_; }
+    bool full() const { return tail_ - head_ == capacity_; }
+    size_t size() const { return tail_ - head_; }
+    size_t capacity() const { return capacity_; }
+
+    void push(T && value) {
+        slots_[tail_ % capacity_].value = std::move(value);
+        tail_++;
+    }
+
+    T pop() {
+        T value = std::move(slots_[head_ % capacity_].value);
+        head_++;
+        return value;
+    }
+
+private:
+    struct alignas(cache_line_size) Slot {
+        T value {};
+    };
+
+    size_t capacity_ {0};
+    std::vector<Slot> slots_;
+    alignas(cache_line_size) size_t head_ {0};
+    alignas(cache_line_size) size_t tail_ {0};
+};
+
+/**
+ * @brief one blocked send or recv, or one select, registered on channels.
+ * it is reached by peers while fiber is parked, so it live on heap
+ */
+struct ChannelWaitContext {
+    /// index of case which complete the wait, -1 means still waiting
+    std::atomic<int> fired {-1};
+    /// false if fired because channel is closed
+    bool ok {false};
+    FiberWaiter waiter;
+};
+
+/**
+ * @brief wait entry of one case on one channel
+ */
+struct ChannelWaiter {
+    ChannelWaitContext* context {nullptr};
+    int index {-1};
+    /// heap slot holding value to send or receiving value
+    void* value {nullptr};
+    ChannelWaiter* prev {nullptr};
+    ChannelWaiter* next {nullptr};
+    bool linked {false};
+};
+
+class ChannelBase;
+
+/**
+ * @brief one case of select
+ */
+struct ChannelCase {
+    ChannelBase* channel {nullptr};
+    bool send {false};
+    void* value {nullptr};
+};
+
+/**
+ * @brief type erased channel core, blocked senders and receivers are parked
+ * and the value is handed to them directly
+ */
+class ChannelBase : Noncopable {
+public:
+    /**
+     * @brief close channel, parked senders fail and receivers fail once buffer is drained
+     */
+    void close();
+
+    /**
+     * @brief check if channel is closed
+     */
+    bool is_closed();
+
+    /**
+     * @brief lock channel, used by select
+     */
+    void lock() { mutex_.lock(); }
+    void unlock() { mutex_.unlock(); }
+
+    /**
+     * @brief run first ready case, park fiber until one case is ready if block is true
+     * @param[in] cases select cases
+     * @param[in] count case count
+     * @param[in] block wait if no case is ready
+     * @param[out] ok false if case completed because channel is closed
+     * @return index of completed case, -1 if none ready and block is false
+     */
+    static int select(ChannelCase* cases, size_t count, bool block, bool & ok);
+
+protected:
+    /**
+     * @brief intrusive doubly linked wait queue
+     */
+    class WaitQueue {
+    public:
+        void push(ChannelWaiter* waiter);
+        void remove(ChannelWaiter* waiter);
+        ChannelWaiter* pop();
+
+        /**
+         * @brief pop first waiter whose wait is not completed yet, and complete it
+         */
+        ChannelWaiter* claim();
+
+    private:
+        ChannelWaiter* head_ {nullptr};
+        ChannelWaiter* tail_ {nullptr};
+    };
+
+    /**
+     * @brief try to send, lock should be held
+     * @param[in] value send source
+     * @param[out] ok false if channel is closed
+     * @param[out] wake claimed receiver, should be notified after unlock
+     * @return false if send should wait
+     */
+    virtual bool do_send(void* value, bool & ok, ChannelWaiter* & wake) = 0;
+
+    /**
+     * @brief try to recv, lock should be held
+     * @param[in] value recv destination
+     * @param[out] ok false if channel is closed and drained
+     * @param[out] wake claimed sender, should be notified after unlock
+     * @return false if recv should wait
+     */
+    virtual bool do_recv(void* value, bool & ok, ChannelWaiter* & wake) = 0;
+
+    /**
+     * @brief get heap slot peers use while case is parked, parked fiber stack may be swapped out
+     * @param[in] value case value
+     * @param[in] send send value is moved into slot
+     */
+    virtual void* park_value(void* value, bool send) = 0;
+
+    /**
+     * @brief release slot, received value is moved out, send value not taken is moved back
+     * @param[in] slot slot from park_value
+     * @param[in] value case value
+     * @param[in] send send case
+     * @param[in] done case completed with ok
+     */
+    virtual void unpark_value(void* slot, void* value, bool send, bool done) = 0;
+
+protected:
+    Mutex mutex_;
+    bool closed_ {false};
+    WaitQueue senders_;
+    WaitQueue receivers_;
+};
+
+/**
+ * @brief bounded mpmc channel, capacity 0 makes an unbuffered channel
+ * where send complete only when a receiver takes the value
+ */
+template <typename T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    explicit Channel(size_t capacity = 0): buffer_(capacity) {}
+
+    /**
+     * @brief send value, park fiber while channel is full
+     * @return false if channel is closed
+     */
+    bool send(T value) {
+        ChannelCase c {this, true, &value};
+        bool ok = false;
+        select(&c, 1, true, ok);
+        return ok;
+    }
+
+    /**
+     * @brief recv value, park fiber while channel is empty
+     * @return false if channel is closed and drained
+     */
+    bool recv(T & value) {
+        ChannelCase c {this, false, &value};
+        bool ok = false;
+        select(&c, 1, true, ok);
+        return ok;
+    }
+
+    /**
+     * @brief send without wait, value is moved only when success
+     * @return false if channel is full or closed
+     */
+    bool try_send(T & value) {
+        ChannelCase c {this, true, &value};
+        bool ok = false;
+        return select(&c, 1, false, ok) == 0 && ok;
+    }
+
+    /**
+     * @brief recv without wait
+     * @return false if channel is empty or closed
+     */
+    bool try_recv(T & value) {
+        ChannelCase c {this, false, &value};
+        bool ok = false;
+        return select(&c, 1, false, ok) == 0 && ok;
+    }
+
+    /**
+     * @brief get buffered value count
+     */
+    size_t size() {
+        Mutex::Lock lock(mutex_);
+        return buffer_.size();
+    }
+
+    size_t capacity() const { return buffer_.capacity(); }
+
+protected:
+    bool do_send(void* value, bool & ok, ChannelWaiter* & wake) override {
+        T& source = *static_cast<T*>(value);
+        if (closed_) {
+            ok = false;
+            return true;
+        }
+        // hand value to parked receiver
+        if (ChannelWaiter* receiver = receivers_.claim()) {
+            *static_cast<T*>(receiver->value) = std::move(source);
+            receiver->context->ok = true;
+            wake = receiver;
+            ok = true;
+            return true;
+        }
+        if (buffer_.capacity() == 0 || buffer_.full())
+            return false;
+        buffer_.push(std::move(source));
+        ok = true;
+        return true;
+    }
+
+    bool do_recv(void* value, bool & ok, ChannelWaiter* & wake) override {
+        T& destination = *static_cast<T*>(value);
+        if (buffer_.capacity() != 0 && !buffer_.empty()) {
+            destination = buffer_.pop();
+            // a slot is free, move parked sender value in
+            if (ChannelWaiter* sender = senders_.claim()) {
+                buffer_.push(std::move(*static_cast<T*>(sender->value)));
+                sender->context->ok = true;
+                wake = sender;
+            }
+            ok = true;
+            return true;
+        }
+        // unbuffered, take value from parked sender
+        if (ChannelWaiter* sender = senders_.claim()) {
+            destination = std::move(*static_cast<T*>(sender->value));
+            sender->context->ok = true;
+            wake = sender;
+            ok = true;
+            return true;
+        }
+        if (closed_) {
+            ok = false;
+            return true;
+        }
+        return false;
+    }
+
+    void* park_value(void* value, bool send) override {
+        if (send)
+            return new T(std::move(*static_cast<T*>(value)));
+        return new T();
+    }
+
+    void unpark_value(void* slot, void* value, bool send, bool done) override {
+        T* parked = static_cast<T*>(slot);
+        // recv got a value, or send was not taken
+        if (send != done)
+            *static_cast<T*>(value) = std::move(*parked);
+        delete parked;
+    }
+
+private:
+    RingBuffer<T> buffer_;
+};
+
+/**
+ * @brief wait on several channel operations, first ready one is done
+ * @code
+ *  int a; std::string b;
+ *  Select select;
+ *  select.recv(ch_a, a).recv(ch_b, b);
+ *  switch (select.wait()) { case 0: ...; case 1: ...; }
+ * @endcode
+ */
+class Select : Noncopable {
+public:
+    /**
+     * @brief add recv case
+     */
+    template <typename T>
+    Select& recv(Channel<T> & channel, T & value) {
+        cases_.emplace_back(ChannelCase{&channel, false, &value});
+        return *this;
+    }
+
+    /**
+     * @brief add send case, value is moved only when this case is done
+     */
+    template <typename T>
+    Select& send(Channel<T> & channel, T & value) {
+        cases_.emplace_back(ChannelCase{&channel, true, &value});
+        return *this;
+    }
+
+    /**
+     * @brief park until one case is done
+     * @return index of done case
+     */
+    int wait() {
+        return ChannelBase::select(cases_.data(), cases_.size(), true, ok_);
+    }
+
+    /**
+     * @brief do one ready case without wait
+     * @return index of done case, -1 if none is ready
+     */
+    int poll() {
+        return ChannelBase::select(cases_.data(), cases_.size(), false, ok_);
+    }
+
+    /**
+     * @brief false if done case is completed by channel close
+     */
+    bool ok() const { return ok_; }
+
+private:
+    std::vector<ChannelCase> cases_;
+    bool ok_ {false};
+};
+
+}
+
+#endif
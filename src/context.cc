@@ -0,0 +1,162 @@
+#include "context.h"
+
+#include <cstdint>
+#include <cstring>
+
+#ifndef ARIS_FIBER_USE_UCONTEXT
+
+#if defined(__x86_64__)
+/**
+ * system v abi, callee-saved: rbx rbp r12-r15, mxcsr and x87 control word
+ * stack layout from sp: [mxcsr, fpucw] r15 r14 r13 r12 rbx rbp ret
+ */
+asm(R"(
+    .text
+    .globl aris_context_swap
+    .hidden aris_context_swap
+    .type aris_context_swap, @function
+    .align 16
+aris_context_swap:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size aris_context_swap, .-aris_context_swap
+
+    .globl aris_context_entry
+    .hidden aris_context_entry
+    .type aris_context_entry, @function
+    .align 16
+aris_context_entry:
+    callq *%rbx
+    ud2
+    .size aris_context_entry, .-aris_context_entry
+)");
+#elif defined(__aarch64__)
+/**
+ * aapcs64, callee-saved: x19-x28, fp, lr, d8-d15
+ * stack layout from sp: x19 ... x28, fp, lr, d8 ... d15
+ */
+asm(R"(
+    .text
+    .globl aris_context_swap
+    .hidden aris_context_swap
+    .type aris_context_swap, %function
+    .align 4
+aris_context_swap:
+    sub sp, sp, #160
+    stp x19, x20, [sp, #0]
+    stp x21, x22, [sp, #16]
+    stp x23, x24, [sp, #32]
+    stp x25, x26, [sp, #48]
+    stp x27, x28, [sp, #64]
+    stp x29, x30, [sp, #80]
+    stp d8, d9, [sp, #96]
+    stp d10, d11, [sp, #112]
+    stp d12, d13, [sp, #128]
+    stp d14, d15, [sp, #144]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0]
+    ldp x21, x22, [sp, #16]
+    ldp x23, x24, [sp, #32]
+    ldp x25, x26, [sp, #48]
+    ldp x27, x28, [sp, #64]
+    ldp x29, x30, [sp, #80]
+    ldp d8, d9, [sp, #96]
+    ldp d10, d11, [sp, #112]
+    ldp d12, d13, [sp, #128]
+    ldp d14, d15, [sp, #144]
+    add sp, sp, #160
+    ret
+    .size aris_context_swap, .-aris_context_swap
+
+    .globl aris_context_entry
+    .hidden aris_context_entry
+    .type aris_context_entry, %function
+    .align 4
+aris_context_entry:
+    blr x19
+    brk #0
+    .size aris_context_entry, .-aris_context_entry
+)");
+#endif
+
+extern "C" void aris_context_entry();
+
+#endif
+
+namespace aris {
+
+#ifdef ARIS_FIBER_USE_UCONTEXT
+
+void Context::make(void* stack, size_t size, Entry entry) {
+    getcontext(&context_);
+    context_.uc_link = nullptr;
+    context_.uc_stack.ss_sp = stack;
+    context_.uc_stack.ss_size = size;
+    makecontext(&context_, entry, 0);
+}
+
+void* Context::get_stack_pointer() const {
+#if defined(__x86_64__)
+    return reinterpret_cast<void*>(context_.uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void*>(context_.uc_mcontext.sp);
+#else
+    // unknown layout, caller should regard whole stack as used
+    return nullptr;
+#endif
+}
+
+#else
+
+void Context::make(void* stack, size_t size, Entry entry) {
+    // stack top should be aligned to 16 bytes
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size) & ~static_cast<uintptr_t>(15);
+#if defined(__x86_64__)
+    // after ret to entry, sp should be 16 bytes aligned before call
+    void** sp = reinterpret_cast<void**>(top - 80);
+    memset(sp, 0, 80);
+    // default mxcsr and x87 control word
+    uint32_t* ctrl = reinterpret_cast<uint32_t*>(sp);
+    ctrl[0] = 0x1F80;
+    ctrl[1] = 0x037F;
+    // rbx hold entry, ret to trampoline
+    sp[5] = reinterpret_cast<void*>(entry);
+    sp[7] = reinterpret_cast<void*>(&aris_context_entry);
+#elif defined(__aarch64__)
+    void** sp = reinterpret_cast<void**>(top - 160);
+    memset(sp, 0, 160);
+    // x19 hold entry, lr point to trampoline
+    sp[0] = reinterpret_cast<void*>(entry);
+    sp[11] = reinterpret_cast<void*>(&aris_context_entry);
+#endif
+    sp_ = sp;
+}
+
+void* Context::get_stack_pointer() const {
+    return sp_;
+}
+
+#endif
+
+}
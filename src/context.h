@@ -0,0 +1,81 @@
+/**
+ * @file context.h
+ * @author aris
+ * @brief fiber context switch backend
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_CONTEXT_H__
+#define __STUDY_SRC_CONTEXT_H__
+
+#include <cstddef>
+
+/**
+ * @brief context switch backend is selected at build time
+ * x86-64 and aarch64 use a register-only switch written in assembly,
+ * define ARIS_FIBER_USE_UCONTEXT to fall back to glibc ucontext,
+ * other architectures always use ucontext
+ */
+#if !defined(ARIS_FIBER_USE_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define ARIS_FIBER_USE_UCONTEXT
+#endif
+
+#ifdef ARIS_FIBER_USE_UCONTEXT
+#include <ucontext.h>
+#else
+/**
+ * @brief save callee-saved registers on current stack, store stack pointer to from,
+ * then restore registers from to stack pointer
+ */
+extern "C" void aris_context_swap(void** from, void* to);
+#endif
+
+namespace aris {
+
+class Context {
+public:
+    typedef void (*Entry)();
+
+    /**
+     * @brief prepare context, entry will run on stack when first switched to
+     * @param[in] stack stack bottom
+     * @param[in] size stack size
+     * @param[in] entry entry func, must not return
+     */
+    void make(void* stack, size_t size, Entry entry);
+
+    /**
+     * @brief get stack pointer saved when context is switched out
+     */
+    void* get_stack_pointer() const;
+
+    /**
+     * @brief save current execution to from, and switch to to
+     * @param[in, out] from current context
+     * @param[in] to target context
+     */
+    static void swap(Context & from, Context & to) {
+#ifdef ARIS_FIBER_USE_UCONTEXT
+        swapcontext(&from.context_, &to.context_);
+#else
+        aris_context_swap(&from.sp_, to.sp_);
+#endif
+    }
+
+private:
+#ifdef ARIS_FIBER_USE_UCONTEXT
+    /// glibc context, save signal mask as well
+    ucontext_t context_ {};
+#else
+    /// saved stack pointer, registers are saved on stack
+    void* sp_ {nullptr};
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+
+namespace aris {
+
+struct Topology {
+    std::vector<int> cpus;
+    std::vector<std::vector<int>> nodes;
+};
+
+static Topology load_topology() {
+    Topology topology;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                topology.cpus.push_back(cpu);
+        }
+    }
+    if (topology.cpus.empty())
+        topology.cpus.push_back(0);
+    // node ids may have holes, stop after a run of missing ones
+    for (int node = 0, missing = 0; missing < 64; node++) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file) {
+            missing++;
+            continue;
+        }
+        missing = 0;
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for (int cpu : CpuTopology::parse_cpu_list(list)) {
+            if (std::binary_search(topology.cpus.begin(), topology.cpus.end(), cpu))
+                cpus.push_back(cpu);
+        }
+        if (!cpus.empty())
+            topology.nodes.emplace_back(std::move(cpus));
+    }
+    if (topology.nodes.empty())
+        topology.nodes.push_back(topology.cpus);
+    return topology;
+}
+
+static const Topology & get_topology() {
+    static Topology topology = load_topology();
+    return topology;
+}
+
+const std::vector<int> & CpuTopology::get_cpus() {
+    return get_topology().cpus;
+}
+
+int CpuTopology::get_node_count() {
+    return get_topology().nodes.size();
+}
+
+const std::vector<int> & CpuTopology::get_node_cpus(int node) {
+    const Topology & topology = get_topology();
+    return topology.nodes[node % topology.nodes.size()];
+}
+
+int CpuTopology::get_cpu_node(int cpu) {
+    const Topology & topology = get_topology();
+    for (size_t node = 0; node < topology.nodes.size(); node++) {
+        const std::vector<int> & cpus = topology.nodes[node];
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+            return node;
+    }
+    return -1;
+}
+
+std::vector<int> CpuTopology::parse_cpu_list(const std::string & list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty())
+            continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+}
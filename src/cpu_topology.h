@@ -0,0 +1,55 @@
+/**
+ * @file cpu_topology.h
+ * @author aris
+ * @brief cpus and numa nodes usable by process
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_CPU_TOPOLOGY_H__
+#define __STUDY_SRC_CPU_TOPOLOGY_H__
+
+#include <string>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief numa layout read from sysfs once, only cpus process is allowed to run on are kept,
+ * machine without numa info is one node holding all cpus
+ */
+class CpuTopology {
+public:
+    /**
+     * @brief get cpus process can run on
+     */
+    static const std::vector<int> & get_cpus();
+
+    /**
+     * @brief get numa node count, node without usable cpu is skipped
+     */
+    static int get_node_count();
+
+    /**
+     * @brief get usable cpus of node
+     * @param[in] node node index, 0 to node count - 1
+     */
+    static const std::vector<int> & get_node_cpus(int node);
+
+    /**
+     * @brief get node of cpu, -1 if cpu is not usable
+     */
+    static int get_cpu_node(int cpu);
+
+    /**
+     * @brief parse cpu list like "0-3,8,10-11"
+     */
+    static std::vector<int> parse_cpu_list(const std::string & list);
+};
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "fd_manager.h"
+#include "hook.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace aris {
+
+FdContext::FdContext(int fd)
+    : fd_(fd) {
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        return;
+    init_ = true;
+    socket_ = S_ISSOCK(st.st_mode);
+    if (socket_) {
+        // original fcntl, hooked one hide O_NONBLOCK from user
+        int flags = fcntl_f(fd_, F_GETFL, 0);
+        if (!(flags & O_NONBLOCK))
+            fcntl_f(fd_, F_SETFL, flags | O_NONBLOCK);
+        sys_nonblock_ = true;
+    }
+}
+
+void FdContext::set_timeout(int type, uint64_t ms) {
+    if (type == SO_RCVTIMEO)
+        recv_timeout_ = ms;
+    else
+        send_timeout_ = ms;
+}
+
+uint64_t FdContext::get_timeout(int type) const {
+    return type == SO_RCVTIMEO ? recv_timeout_ : send_timeout_;
+}
+
+RWMutex& FdManager::get_mutex() {
+    static RWMutex* mutex = new RWMutex();
+    return *mutex;
+}
+
+std::vector<FdContext::ptr>& FdManager::get_contexts() {
+    // hooked syscalls may run before or after static objects of other files
+    static std::vector<FdContext::ptr>* contexts = new std::vector<FdContext::ptr>(64);
+    return *contexts;
+}
+
+FdContext::ptr FdManager::get(int fd, bool create) {
+    if (fd < 0)
+        return nullptr;
+    std::vector<FdContext::ptr> & contexts = get_contexts();
+    {
+        RWMutex::ReadLock lock(get_mutex());
+        if (static_cast<size_t>(fd) < contexts.size() && contexts[fd])
+            return contexts[fd];
+    }
+    if (!create)
+        return nullptr;
+    RWMutex::Lock lock(get_mutex());
+    if (static_cast<size_t>(fd) >= contexts.size())
+        contexts.resize(std::max<size_t>(fd + 1, contexts.size() * 3 / 2));
+    if (!contexts[fd])
+        contexts[fd].reset(new FdContext(fd));
+    return contexts[fd];
+}
+
+void FdManager::del(int fd) {
+    if (fd < 0)
+        return;
+    std::vector<FdContext::ptr> & contexts = get_contexts();
+    RWMutex::Lock lock(get_mutex());
+    if (static_cast<size_t>(fd) < contexts.size())
+        contexts[fd].reset();
+}
+
+void FdManager::forget_iomanager(IOManager* iom) {
+    std::vector<FdContext::ptr> & contexts = get_contexts();
+    RWMutex::ReadLock lock(get_mutex());
+    for (auto & context : contexts) {
+        if (context && context->get_iomanager() == iom)
+            context->set_iomanager(nullptr);
+    }
+}
+
+}
@@ -0,0 +1,127 @@
+/**
+ * @file fd_manager.h
+ * @author aris
+ * @brief state of fds used by syscall hooks
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_FD_MANAGER_H__
+#define __STUDY_SRC_FD_MANAGER_H__
+
+#include "noncopable.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace aris {
+
+class IOManager;
+
+/**
+ * @brief state of one fd, socket is set non blocking in system,
+ * blocking mode user asked for is kept here and emulated by hooks
+ */
+class FdContext : Noncopable {
+public:
+    typedef std::shared_ptr<FdContext> ptr;
+
+    /**
+     * @brief check fd type, socket is set non blocking
+     * @param[in] fd fd to manage
+     */
+    explicit FdContext(int fd);
+
+    /**
+     * @brief check if fd is valid when context is created
+     */
+    bool is_init() const { return init_; }
+
+    bool is_socket() const { return socket_; }
+
+    bool is_closed() const { return closed_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief mark fd closed, waiters woken by close see it and fail with EBADF
+     */
+    void set_closed() { closed_.store(true, std::memory_order_release); }
+
+    /**
+     * @brief iomanager fd events are registered on, close cancel them there
+     * whatever thread it is called from
+     */
+    void set_iomanager(IOManager* iom) { iomanager_.store(iom, std::memory_order_release); }
+    IOManager* get_iomanager() const { return iomanager_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief non blocking mode user set by fcntl or ioctl
+     */
+    void set_user_nonblock(bool flag) { user_nonblock_ = flag; }
+    bool get_user_nonblock() const { return user_nonblock_; }
+
+    /**
+     * @brief non blocking mode set by hook
+     */
+    bool get_sys_nonblock() const { return sys_nonblock_; }
+
+    /**
+     * @brief set timeout of SO_RCVTIMEO or SO_SNDTIMEO
+     * @param[in] type SO_RCVTIMEO or SO_SNDTIMEO
+     * @param[in] ms timeout in milliseconds, ~0ull means no timeout
+     */
+    void set_timeout(int type, uint64_t ms);
+
+    /**
+     * @brief get timeout of SO_RCVTIMEO or SO_SNDTIMEO, ~0ull means no timeout
+     */
+    uint64_t get_timeout(int type) const;
+
+private:
+    int fd_ {-1};
+    bool init_ {false};
+    bool socket_ {false};
+    bool sys_nonblock_ {false};
+    bool user_nonblock_ {false};
+    std::atomic<bool> closed_ {false};
+    std::atomic<IOManager*> iomanager_ {nullptr};
+    uint64_t recv_timeout_ {~0ull};
+    uint64_t send_timeout_ {~0ull};
+};
+
+/**
+ * @brief contexts of fds indexed by fd
+ */
+class FdManager : Noncopable {
+public:
+    /**
+     * @brief get context of fd
+     * @param[in] fd fd
+     * @param[in] create create context if fd has none
+     * @return null if fd has no context and create is false
+     */
+    static FdContext::ptr get(int fd, bool create = false);
+
+    /**
+     * @brief remove context of fd, called when fd is closed
+     */
+    static void del(int fd);
+
+    /**
+     * @brief drop iomanager from all contexts, called when iomanager is destroyed
+     */
+    static void forget_iomanager(IOManager* iom);
+
+private:
+    static RWMutex& get_mutex();
+    static std::vector<FdContext::ptr>& get_contexts();
+};
+
+}
+
+#endif
@@ -1,92 +1,247 @@
 #include "fiber.h"
 #include "log.h"
+#include "stack_allocator.h"
+#include "stack_profiler.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
-#include <ucontext.h>
+#include <sched.h>
+#include <vector>
 
 namespace aris {
 
-class MallocStackAllocator {
-public:
-    static void* Alloc(size_t size) {
-        return malloc(size);
+/**
+ * @brief stack shared by fibers of one thread
+ */
+struct SharedStack {
+    SharedStack(size_t sz): size(StackAllocator::get_class_size(sz)) {
+        stack = StackAllocator::Alloc(size);
     }
-
-    static void Dealloc(void* p, size_t size) {
-        return free(p);
+    ~SharedStack() {
+        StackAllocator::Dealloc(stack, size);
+    }
+    /// stack top, stack grow down from here
+    char* top() {
+        return static_cast<char*>(stack) + size;
     }
+
+    void* stack {nullptr};
+    size_t size {0};
+    /// fiber whose stack content is now on this stack
+    Fiber* occupant {nullptr};
 };
 
-using StackAllocator = MallocStackAllocator;
+static std::atomic<size_t> shared_stack_count_ {4};
+static std::atomic<size_t> shared_stack_size_ {256 * 1024};
+
+static std::atomic<int> fiber_local_slot_count_ {0};
+
+/// fiber id is unique in process, fiber may run on any thread
+static std::atomic<uint64_t> fiber_id_count_ {0};
 
 static thread_local int thread_fiber_count_ = 0;
 static thread_local Fiber::ptr thread_main_fiber_ = nullptr;
 static thread_local Fiber::ptr thread_current_fiber_ = nullptr;
 
-Fiber::Fiber(std::function<void()>cb, size_t stacksize) :
-cb_(cb), stack_size_(stacksize) {
+/**
+ * @brief fiber may continue on another thread after switch, thread locals are read
+ * by noinline accessor, so address of previous thread local is never reused
+ */
+static ARIS_NOINLINE Fiber::ptr& main_fiber() {
+    return thread_main_fiber_;
+}
+
+static ARIS_NOINLINE Fiber::ptr& current_fiber() {
+    return thread_current_fiber_;
+}
+static thread_local std::vector<std::shared_ptr<SharedStack>> thread_shared_stacks_;
+static thread_local size_t thread_shared_stack_index_ = 0;
+
+// pick shared stack in round robin
+static std::shared_ptr<SharedStack> get_thread_shared_stack() {
+    if (thread_shared_stacks_.empty()) {
+        size_t count = std::max<size_t>(shared_stack_count_.load(std::memory_order_relaxed), 1);
+        size_t size = shared_stack_size_.load(std::memory_order_relaxed);
+        for (size_t index = 0; index < count; index++)
+            thread_shared_stacks_.emplace_back(std::make_shared<SharedStack>(size));
+    }
+    auto stack = thread_shared_stacks_[thread_shared_stack_index_ % thread_shared_stacks_.size()];
+    thread_shared_stack_index_++;
+    return stack;
+}
+
+void Fiber::set_shared_stack(size_t count, size_t size) {
+    shared_stack_count_.store(count, std::memory_order_relaxed);
+    shared_stack_size_.store(size, std::memory_order_relaxed);
+}
+
+Fiber::Fiber(std::function<void()>cb, size_t stacksize, StackMode mode) :
+cb_(cb), stack_size_(stacksize ? stacksize : default_stack_size), stack_mode_(mode) {
     create_main_fiber();
     if (cb == nullptr) {
         ARIS_LOG_FMT_WARN("cant create fiber with none func, create %s failed", "fiber");
         return;
     }
     // set current fiber
-    fiber_id_ =  thread_fiber_count_;
+    fiber_id_ = fiber_id_count_.fetch_add(1, std::memory_order_relaxed);
     // add thread fiber
     thread_fiber_count_++;
-    // malloc 
-    stack_ = StackAllocator::Alloc(stacksize);
     // init state
     state_ = State::Ready;
-    // get current context
-    getcontext(&context_);
-    context_.uc_link = nullptr;
-    context_.uc_stack.ss_sp = stack_;
-    context_.uc_stack.ss_size = stacksize;
-    makecontext(&context_, &Fiber::run, 0);
+    // shared fiber bind stack of the thread it first run on, fiber is often created elsewhere
+    if (stack_mode_ == StackMode::SHARED) {
+        stack_size_ = StackAllocator::get_class_size(shared_stack_size_.load(std::memory_order_relaxed));
+    } else {
+        // only painted stack is measured when term
+        bool profiling = StackProfiler::is_profiling();
+        if (profiling)
+            stack_site_ = StackProfiler::get_site(cb_);
+        // no size given, pick size class from recorded peak of this entry point
+        if (stacksize == 0 && StackProfiler::is_adaptive()) {
+            StackSite* site = profiling ? stack_site_ : StackProfiler::get_site(cb_);
+            stack_size_ = StackProfiler::choose_size(site, stack_size_);
+        }
+        // alloc stack, use whole size class
+        stack_fixed_ = stacksize != 0;
+        stack_size_ = StackAllocator::get_class_size(stack_size_);
+        stack_ = StackAllocator::Alloc(stack_size_);
+        if (stack_ == nullptr) {
+            ARIS_LOG_FMT_ERROR("alloc fiber stack failed, size: %u", stack_size_);
+            throw std::bad_alloc();
+        }
+        if (profiling)
+            StackProfiler::paint(stack_, stack_size_);
+        // make context
+        context_.make(stack_, stack_size_, &Fiber::run);
+        context_made_ = true;
+    }
     ARIS_LOG_FMT_INFO("create fiber success, fiber id: %d", fiber_id_);
 } 
 
 Fiber::Fiber() {
-    fiber_id_ = thread_fiber_count_;
-    getcontext(&context_);
+    fiber_id_ = fiber_id_count_.fetch_add(1, std::memory_order_relaxed);
     thread_fiber_count_++;
     ARIS_LOG_FMT_INFO("create default fiber success, fiber id: %d", fiber_id_);
 }
 
 void Fiber::create_main_fiber() {
-    if (thread_main_fiber_ != nullptr)
+    if (main_fiber() != nullptr)
         return;
     
-    thread_main_fiber_ = Fiber::ptr(new Fiber());
-    thread_current_fiber_ = thread_main_fiber_;
+    main_fiber() = Fiber::ptr(new Fiber());
+    current_fiber() = main_fiber();
 }
 
 Fiber::~Fiber() {
+    clear_locals();
+    if (shared_stack_ && shared_stack_->occupant == this)
+        shared_stack_->occupant = nullptr;
+    free(save_buffer_);
     StackAllocator::Dealloc(stack_, stack_size_);
 }
 
+// save live stack of current occupant, restore this fiber stack
+void Fiber::acquire_shared_stack() {
+    if (!shared_stack_) {
+        shared_stack_ = get_thread_shared_stack();
+        stack_size_ = shared_stack_->size;
+    }
+    SharedStack* stack = shared_stack_.get();
+    if (stack->occupant == this)
+        return;
+    if (stack->occupant != nullptr)
+        stack->occupant->save_shared_stack();
+    stack->occupant = this;
+    // first run, make context on shared stack
+    if (!context_made_) {
+        context_.make(stack->stack, stack->size, &Fiber::run);
+        context_made_ = true;
+        return;
+    }
+    memcpy(stack->top() - save_size_, save_buffer_, save_size_);
+}
+
+// copy [sp, top) to right sized buffer
+void Fiber::save_shared_stack() {
+    SharedStack* stack = shared_stack_.get();
+    char* sp = static_cast<char*>(context_.get_stack_pointer());
+    if (sp == nullptr || sp < stack->stack || sp > stack->top())
+        sp = static_cast<char*>(stack->stack);
+    save_size_ = stack->top() - sp;
+    // grow buffer, or shrink it when it is far bigger than live stack
+    if (save_size_ > save_capacity_ || save_size_ < save_capacity_ / 4) {
+        size_t capacity = (save_size_ + 1023) & ~static_cast<size_t>(1023);
+        void* buffer = realloc(save_buffer_, capacity);
+        if (buffer == nullptr)
+            throw std::bad_alloc();
+        save_buffer_ = buffer;
+        save_capacity_ = capacity;
+    }
+    memcpy(save_buffer_, sp, save_size_);
+}
+
 // get fiber current state
 Fiber::State Fiber::get_fiber_state() {
     return state_;
 }
 
 void Fiber::set_thread_main_fiber(Fiber::ptr fiber) {
-    thread_main_fiber_ = fiber;
+    main_fiber() = fiber;
 }
 
 Fiber::ptr Fiber::get_thread_main_fiber() {
-    return thread_main_fiber_;
+    return main_fiber();
 }
 
 void Fiber::set_thread_current_fiber(Fiber::ptr fiber) {
-    thread_current_fiber_ = fiber;
+    current_fiber() = fiber;
 }
 
 Fiber::ptr Fiber::get_thread_current_fiber() {
-    return thread_current_fiber_;
+    return current_fiber();
+}
+
+uint64_t Fiber::get_current_fiber_id() {
+    return current_fiber() ? current_fiber()->fiber_id_ : 0;
+}
+
+int Fiber::alloc_local_slot() {
+    int index = fiber_local_slot_count_.fetch_add(1, std::memory_order_relaxed);
+    if (index >= max_local_slots) {
+        ARIS_LOG_FMT_ERROR("alloc fiber local failed, max slots: %d", max_local_slots);
+        throw std::out_of_range("fiber local slots exhausted");
+    }
+    return index;
+}
+
+void* Fiber::get_local(int index) {
+    create_main_fiber();
+    return current_fiber()->locals_[index].value;
+}
+
+void Fiber::set_local(int index, void* value, void (*destroy)(void*)) {
+    create_main_fiber();
+    LocalSlot& slot = current_fiber()->locals_[index];
+    if (slot.value != nullptr && slot.destroy != nullptr)
+        slot.destroy(slot.value);
+    slot.value = value;
+    slot.destroy = destroy;
+}
+
+void Fiber::clear_locals() {
+    for (auto & slot : locals_) {
+        if (slot.value == nullptr)
+            continue;
+        if (slot.destroy != nullptr)
+            slot.destroy(slot.value);
+        slot.value = nullptr;
+        slot.destroy = nullptr;
+    }
 }
 
 // get thread fiber count
@@ -99,46 +254,73 @@ void Fiber::yield() {
     // main fiber cant be yield, 
     // only children fiber can yield, so main fiber put in font ground
     try {
-        if (fiber_id_ == thread_main_fiber_->fiber_id_)
+        // thread locals of this thread, only used before switch
+        Fiber::ptr& main = main_fiber();
+        if (fiber_id_ == main->fiber_id_)
             throw std::logic_error("main fiber cannot be yield");
 
         // yield current fiber, exec main fiber
-        set_thread_current_fiber(thread_main_fiber_);
-        thread_main_fiber_->set_fiber_state(State::RUNNING);
-        // swap current fiber to main fiber
-        state_ = State::Ready;
-        swapcontext(&context_, &thread_main_fiber_->context_);
+        current_fiber() = main;
+        main->set_fiber_state(State::RUNNING);
+        // swap current fiber to main fiber, term fiber keep its state
+        if (state_ == State::RUNNING)
+            state_ = State::Ready;
+        Context::swap(context_, main->context_);
     } catch (std::exception& e) {
         ARIS_LOG_FMT_WARN("yield failed, err: %s",e.what());
         return;
     }
-    ARIS_LOG_FMT_INFO("fiber yield successfully, fiber id: %d", fiber_id_);
+    // ARIS_LOG_FMT_INFO("fiber yield successfully, fiber id: %d", fiber_id_);
+}
+
+// yield current fiber without being scheduled again
+void Fiber::hold() {
+    state_ = State::HOLD;
+    yield();
 }
 
 // resume execute current fiber
-void Fiber::resume() {
+Fiber::State Fiber::resume() {
+    State state;
     // current fiber is already in execute 
     try {
+        // thread locals of this thread, main fiber never move
+        Fiber::ptr& main = main_fiber();
         // in case cant get back to main fiber
         // other fiber must checkout from main fiber
         // main fiber cant resume, because main fiber func has nothing to do 
-        if (thread_main_fiber_->fiber_id_ == fiber_id_) 
+        if (main->fiber_id_ == fiber_id_) 
             throw std::logic_error("main fiber cannot resume");
-        if (thread_current_fiber_ != thread_main_fiber_) 
+        if (current_fiber() != main) 
             throw std::logic_error("current fiber is not main fiber");
-        if (thread_current_fiber_->fiber_id_ == fiber_id_) 
-            throw std::logic_error("fiber id is the same");
+        // fiber woken by other thread may not finish switching out yet
+        for (int spin = 0; on_cpu_.exchange(true, std::memory_order_acquire); spin++) {
+            if (spin > 64)
+                sched_yield();
+        }
+        // state is only stable once on_cpu_ is owned
+        if (state_ == State::TERM) {
+            on_cpu_.store(false, std::memory_order_release);
+            throw std::logic_error("fiber is already term");
+        }
+        // shared fiber bring its stack back
+        if (stack_mode_ == StackMode::SHARED)
+            acquire_shared_stack();
         // set current fiber as now
-        set_thread_current_fiber(shared_from_this());
+        current_fiber() = shared_from_this();
         state_ = State::RUNNING;
         // swap to current fiber
-        thread_main_fiber_->set_fiber_state(State::Ready);
-        swapcontext(&thread_main_fiber_->context_, &context_);
+        main->set_fiber_state(State::Ready);
+        Context::swap(main->context_, context_);
+        // state must be read before other thread is allowed to resume fiber
+        state = state_;
+        on_cpu_.store(false, std::memory_order_release);
     } catch (std::exception& e) {
         ARIS_LOG_FMT_WARN("fiber resume failed, fiber id: %d, err: %s", fiber_id_, e.what());
-        return;
+        return state_;
     }
     // ARIS_LOG_FMT_INFO("fiber resume successfully, fiber id: %d", fiber_id_);
+    return state;
 }
 
 // set fiber state
@@ -146,40 +328,76 @@ void Fiber::set_fiber_state(Fiber::State state) {
     state_ = state;
 }
 
-// reset fiber, reuse fiber
+// reset fiber, reuse fiber and its stack
 void Fiber::reset(std::function<void()> cb) {
     try {
-        if (thread_main_fiber_ && fiber_id_ == thread_main_fiber_->fiber_id_)
+        if (main_fiber() && fiber_id_ == main_fiber()->fiber_id_)
             throw std::logic_error("main fiber cannot be reset");
+        if (state_ != State::TERM)
+            throw std::logic_error("only term fiber can be reset");
+        clear_locals();
         cb_.swap(cb);
-        // yield
-        yield();
+        state_ = State::Ready;
+        // term fiber has nothing on shared stack, bind again on next first resume
+        if (stack_mode_ == StackMode::SHARED) {
+            shared_stack_ = nullptr;
+            bound_thread_ = -1;
+            context_made_ = false;
+            save_size_ = 0;
+            return;
+        }
+        // reused stack belong to new entry point now
+        bool profiling = StackProfiler::is_profiling();
+        stack_site_ = profiling ? StackProfiler::get_site(cb_) : nullptr;
+        // new entry point may need another size class, swap stack through thread cache
+        if (!stack_fixed_) {
+            size_t size = default_stack_size;
+            if (StackProfiler::is_adaptive())
+                size = StackProfiler::choose_size(profiling ? stack_site_ : StackProfiler::get_site(cb_), size);
+            size = StackAllocator::get_class_size(size);
+            // keep old stack if new one cant be mapped
+            void* stack = size != stack_size_ ? StackAllocator::Alloc(size) : nullptr;
+            if (stack != nullptr) {
+                StackAllocator::Dealloc(stack_, stack_size_);
+                stack_ = stack;
+                stack_size_ = size;
+            }
+        }
+        if (profiling)
+            StackProfiler::paint(stack_, stack_size_);
+        context_.make(stack_, stack_size_, &Fiber::run);
     } catch (std::exception& e) {
         ARIS_LOG_FMT_WARN("fiber reset failed, fiber id: %d, err: %s", fiber_id_, e.what());
         return;
     }
-    // normally this log will not output
-    ARIS_LOG_FMT_INFO("fiber reset successfully, fiber id: %d", fiber_id_);
 }
 
 // try to run func
 void Fiber::run() {
+    // only hold raw pointer, fiber stack must not keep its own reference after term
+    Fiber* fiber = current_fiber().get();
     try {
-        auto fiber = thread_current_fiber_;
         // main fiber has no func, can not run
-        if (fiber == thread_main_fiber_) 
+        if (fiber == main_fiber().get()) 
             throw std::logic_error("main fiber cannot run");
         // run fiber func    
         if (fiber->cb_)
             fiber->cb_();
-        // set fiber as term    
-        fiber->set_fiber_state(State::TERM);
-        // reset fiber
-        fiber->yield();
     } catch (std::exception& e) {
         ARIS_LOG_FMT_WARN("fiber run failed, err: %s",e.what());
-        return;
     }
+    // release func and local resource and set fiber as term    
+    fiber->cb_ = nullptr;
+    fiber->clear_locals();
+    // record high water of painted stack
+    if (fiber->stack_site_ && fiber->stack_)
+        StackProfiler::record(fiber->stack_site_, StackProfiler::measure(fiber->stack_, fiber->stack_size_));
+    fiber->set_fiber_state(State::TERM);
+    // term fiber stack content is useless, give up shared stack without copy
+    if (fiber->shared_stack_)
+        fiber->shared_stack_->occupant = nullptr;
+    // back to main fiber, never return
+    fiber->yield();
 }
 
 }
\ No newline at end of file
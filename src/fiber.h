@@ -3,24 +3,49 @@
 
 #include <functional>
 #include <memory>
-#include <ucontext.h>
 #include <atomic>
 
+#include "context.h"
 #include "noncopable.h"
 
 
 namespace aris {
 
+struct SharedStack;
+struct StackSite;
+
 class Fiber : Noncopable, public std::enable_shared_from_this<Fiber> {
 public:
     typedef std::shared_ptr<Fiber> ptr;
-    Fiber(std::function<void()>cb , size_t stacksize = 0);
+
+    /**
+     * @brief define fiber stack mode
+     * PRIVATE fiber own a dedicated stack,
+     * SHARED fiber run on one of the thread shared stacks, live part of stack
+     * is copied out when another fiber take over the shared stack.
+     * stack is taken from the thread which first resume the fiber,
+     * fiber must be resumed on that thread only until it term
+     */
+    enum class StackMode {PRIVATE, SHARED};
+
+    /**
+     * @brief Construct a new Fiber object
+     * @param[in] cb fiber func
+     * @param[in] stacksize private stack size, ignored by shared mode
+     * @param[in] mode stack mode
+     */
+    Fiber(std::function<void()>cb , size_t stacksize = 0, StackMode mode = StackMode::PRIVATE);
     virtual~Fiber();
     
+    /**
+     * @brief default stack size, used when stacksize is 0
+     */
+    static const uint32_t default_stack_size = 128 * 1024;
+
     /**
      * @brief define fiber state
      */
-    enum class State {Ready, RUNNING, TERM};
+    enum class State {Ready, RUNNING, HOLD, TERM};
     /**
      * @brief Set the thread main fiber object
      * @param[in] fiber set main fiber
@@ -38,12 +63,23 @@ public:
     void yield();
 
     /**
-     * @brief this fiber is put int front state
+     * @brief this fiber is put in background state and not scheduled again,
+     * until someone schedule it explicitly
      */
-    void resume();
+    void hold();
 
     /**
-     * @brief reset fiber
+     * @brief this fiber is put int front state,
+     * fiber can be resumed by any thread once it is switched out
+     * @return fiber state when it switch back
+     */
+    State resume();
+
+    /**
+     * @brief reset term fiber with new func, stack is reused when it fit new func,
+     * stack of default size is swapped for the size class new func needs,
+     * stack size given at construction is kept
+     * @param[in] cb fiber func
      */
     void reset(std::function<void()> cb);
 
@@ -67,6 +103,67 @@ public:
      */
     static Fiber::ptr get_thread_main_fiber();
 
+    /**
+     * @brief set shared stacks created by each thread, take effect on threads
+     * which have not created shared fiber yet
+     * @param[in] count shared stack count per thread
+     * @param[in] size shared stack size
+     */
+    static void set_shared_stack(size_t count, size_t size);
+
+    /**
+     * @brief get stack mode
+     */
+    StackMode get_stack_mode() { return stack_mode_; }
+
+    /**
+     * @brief check if stack size is given by creator
+     */
+    bool is_stack_fixed() { return stack_fixed_; }
+
+    /**
+     * @brief check if shared fiber hold a stack, it must resume on that thread until term
+     */
+    bool is_stack_bound() { return shared_stack_ != nullptr; }
+
+    /**
+     * @brief worker shared fiber is bound to, set by scheduler when fiber first run, -1 if none
+     */
+    int get_bound_thread() { return bound_thread_; }
+    void set_bound_thread(int thread) { bound_thread_ = thread; }
+
+    /**
+     * @brief get fiber id
+     */
+    uint64_t get_fiber_id() { return fiber_id_; }
+
+    /**
+     * @brief get current fiber id without holding fiber, 0 if thread has no fiber
+     */
+    static uint64_t get_current_fiber_id();
+
+    /// max count of FiberLocal
+    static const int max_local_slots = 16;
+
+    /**
+     * @brief alloc fiber local slot, used by FiberLocal
+     * @return slot index
+     */
+    static int alloc_local_slot();
+
+    /**
+     * @brief get current fiber local value of slot
+     */
+    static void* get_local(int index);
+
+    /**
+     * @brief set current fiber local value of slot, previous value is destroyed
+     * @param[in] index slot index
+     * @param[in] value local value
+     * @param[in] destroy called with value when slot is cleared
+     */
+    static void set_local(int index, void* value, void (*destroy)(void*));
+
 private:
     // create default fiber
     Fiber();
@@ -88,16 +185,59 @@ private:
      */
     void set_fiber_state(State state);
 
+    /**
+     * @brief take over shared stack before switch in, 
+     * save previous occupant and restore this fiber stack
+     */
+    void acquire_shared_stack();
+
+    /**
+     * @brief copy live part of shared stack to save buffer
+     */
+    void save_shared_stack();
+
+    /**
+     * @brief destroy all fiber local values
+     */
+    void clear_locals();
+
 private:
+    struct LocalSlot {
+        void* value;
+        void (*destroy)(void*);
+    };
+
     /// current fiber
     uint64_t fiber_id_ {0};
     std::function<void()> cb_ {nullptr};
     State state_;
+    /// set while fiber is running or switching out, other thread wait before resume it
+    std::atomic<bool> on_cpu_ {false};
 
     // current context
-    ucontext_t context_ {0};
+    Context context_;
     void* stack_ {nullptr};
     uint32_t stack_size_ {0};
+    /// stack size is given by creator, reset keep it
+    bool stack_fixed_ {false};
+
+    /// shared stack mode
+    StackMode stack_mode_ {StackMode::PRIVATE};
+    /// bound on first resume, released when term fiber is reset
+    std::shared_ptr<SharedStack> shared_stack_ {nullptr};
+    int bound_thread_ {-1};
+    /// context is made lazily when shared stack is acquired
+    bool context_made_ {false};
+    /// copied out stack content
+    void* save_buffer_ {nullptr};
+    size_t save_size_ {0};
+    size_t save_capacity_ {0};
+
+    /// entry point stack usage is recorded to, only set in profiling mode
+    StackSite* stack_site_ {nullptr};
+
+    /// fiber local values, index by FiberLocal slot
+    LocalSlot locals_[max_local_slots] {};
 
     /// global fiber
     // static thread_local Fiber::ptr thread_main_fiber_ ;
@@ -105,6 +245,54 @@ private:
     // static thread_local int thread_fiber_count_;
 };
 
+/**
+ * @brief value owned by each fiber, slot is released when fiber term or reset
+ * @code
+ *  static FiberLocal<RequestContext> ctx;
+ *  ctx.set(RequestContext(...));
+ *  ctx.get()->trace_id;
+ * @endcode
+ */
+template <typename T>
+class FiberLocal : Noncopable {
+public:
+    FiberLocal(): index_(Fiber::alloc_local_slot()) {}
+
+    /**
+     * @brief get current fiber value, nullptr if not set
+     */
+    T* get() {
+        return static_cast<T*>(Fiber::get_local(index_));
+    }
+
+    /**
+     * @brief set current fiber value
+     */
+    void set(T value) {
+        T* current = get();
+        if (current != nullptr) {
+            *current = std::move(value);
+            return;
+        }
+        Fiber::set_local(index_, new T(std::move(value)), &FiberLocal::destroy);
+    }
+
+    /**
+     * @brief destroy current fiber value
+     */
+    void reset() {
+        Fiber::set_local(index_, nullptr, nullptr);
+    }
+
+private:
+    static void destroy(void* value) {
+        delete static_cast<T*>(value);
+    }
+
+private:
+    int index_ {-1};
+};
+
 
 
 
@@ -0,0 +1,151 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+
+namespace aris {
+
+FiberWaiter::FiberWaiter() {
+    Scheduler* scheduler = Scheduler::get_thread_scheduler();
+    Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+    // only fiber run by scheduler can be hold, others block thread
+    if (scheduler == nullptr || fiber == nullptr || fiber == Fiber::get_thread_main_fiber())
+        return;
+    fiber_ = fiber;
+    scheduler_ = scheduler;
+    hint_ = Scheduler::get_resume_hint(fiber);
+}
+
+void FiberWaiter::wait() {
+    if (fiber_) {
+        fiber_->hold();
+        return;
+    }
+    cond_.lock();
+    while (!notified_)
+        cond_.wait();
+    cond_.unlock();
+}
+
+void FiberWaiter::notify() {
+    if (fiber_) {
+        // waiter is released by woken fiber, dont touch it after schedule,
+        // copy fiber, notify may come before wait and wait still check it
+        Scheduler* scheduler = scheduler_;
+        Scheduler::ResumeHint hint = hint_;
+        Fiber::ptr fiber = fiber_;
+        scheduler->schedule(std::move(fiber), hint);
+        return;
+    }
+    // signal with lock held, waiter may release cond once it see notified
+    cond_.lock();
+    notified_ = true;
+    cond_.signal();
+    cond_.unlock();
+}
+
+void FiberWaitList::push(FiberWaiter* waiter) {
+    waiter->next = nullptr;
+    if (tail_ == nullptr) {
+        head_ = tail_ = waiter;
+        return;
+    }
+    tail_->next = waiter;
+    tail_ = waiter;
+}
+
+FiberWaiter* FiberWaitList::pop() {
+    FiberWaiter* waiter = head_;
+    if (waiter == nullptr)
+        return nullptr;
+    head_ = waiter->next;
+    if (head_ == nullptr)
+        tail_ = nullptr;
+    return waiter;
+}
+
+void FiberMutex::lock_slow() {
+    while (true) {
+        std::unique_ptr<FiberWaiter> waiter(new FiberWaiter());
+        {
+            Mutex::Lock lock(mutex_);
+            // mark contended, got it if it was released meanwhile
+            if (state_.exchange(2, std::memory_order_acquire) == 0)
+                return;
+            waiters_.push(waiter.get());
+        }
+        waiter->wait();
+    }
+}
+
+void FiberMutex::unlock_slow() {
+    FiberWaiter* waiter = nullptr;
+    {
+        Mutex::Lock lock(mutex_);
+        waiter = waiters_.pop();
+    }
+    // woken waiter compete for mutex again
+    if (waiter != nullptr)
+        waiter->notify();
+}
+
+void FiberCondition::wait(FiberMutex & mutex) {
+    std::unique_ptr<FiberWaiter> waiter(new FiberWaiter());
+    {
+        Mutex::Lock lock(mutex_);
+        waiters_.push(waiter.get());
+    }
+    // waiter is registered before mutex release, notify cant be lost
+    mutex.unlock();
+    waiter->wait();
+    mutex.lock();
+}
+
+void FiberCondition::notify_one() {
+    FiberWaiter* waiter = nullptr;
+    {
+        Mutex::Lock lock(mutex_);
+        waiter = waiters_.pop();
+    }
+    if (waiter != nullptr)
+        waiter->notify();
+}
+
+void FiberCondition::notify_all() {
+    FiberWaitList waiters;
+    {
+        Mutex::Lock lock(mutex_);
+        std::swap(waiters, waiters_);
+    }
+    while (FiberWaiter* waiter = waiters.pop())
+        waiter->notify();
+}
+
+void FiberSemaphore::wait_slow() {
+    std::unique_ptr<FiberWaiter> waiter(new FiberWaiter());
+    {
+        Mutex::Lock lock(mutex_);
+        waiting_.fetch_add(1, std::memory_order_seq_cst);
+        // post may happen before waiting is visible, check again
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (try_wait()) {
+            waiting_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        waiters_.push(waiter.get());
+    }
+    // permit is handed over by post
+    waiter->wait();
+}
+
+void FiberSemaphore::post_slow() {
+    FiberWaiter* waiter = nullptr;
+    {
+        Mutex::Lock lock(mutex_);
+        if (waiters_.empty() || !try_wait())
+            return;
+        waiter = waiters_.pop();
+        waiting_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    waiter->notify();
+}
+
+}
@@ -0,0 +1,183 @@
+/**
+ * @file fiber_sync.h
+ * @author aris
+ * @brief fiber synchronization primitives, block fiber instead of thread
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_FIBER_SYNC_H__
+#define __STUDY_SRC_FIBER_SYNC_H__
+
+#include "fiber.h"
+#include "noncopable.h"
+#include "scheduler.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace aris {
+
+/**
+ * @brief one blocked waiter, fiber on scheduler is hold and scheduled again when notified,
+ * plain thread wait on cond. waiter is reached by other threads while fiber is hold,
+ * keep it off fiber stack, shared stack fiber stack is swapped out then
+ */
+class FiberWaiter : Noncopable {
+public:
+    /**
+     * @brief capture current fiber and scheduler
+     */
+    FiberWaiter();
+
+    /**
+     * @brief block until notify is called
+     */
+    void wait();
+
+    /**
+     * @brief wake up waiter, waiter may be released as soon as this is called
+     */
+    void notify();
+
+    /// intrusive wait list
+    FiberWaiter* next {nullptr};
+
+private:
+    /// fiber waiter
+    Fiber::ptr fiber_ {nullptr};
+    Scheduler* scheduler_ {nullptr};
+    Scheduler::ResumeHint hint_;
+
+    /// thread waiter
+    bool notified_ {false};
+    Cond cond_;
+};
+
+/**
+ * @brief fifo list of waiters, guarded by owner
+ */
+class FiberWaitList {
+public:
+    void push(FiberWaiter* waiter);
+    FiberWaiter* pop();
+    bool empty() const { return head_ == nullptr; }
+
+private:
+    FiberWaiter* head_ {nullptr};
+    FiberWaiter* tail_ {nullptr};
+};
+
+/**
+ * @brief mutex park fiber when contended,
+ * uncontended lock and unlock are single atomic operation
+ */
+class FiberMutex : Noncopable {
+public:
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    void lock() {
+        int expected = 0;
+        if (likely(state_.compare_exchange_strong(expected, 1, std::memory_order_acquire)))
+            return;
+        lock_slow();
+    }
+
+    bool try_lock() {
+        int expected = 0;
+        return state_.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        if (likely(state_.exchange(0, std::memory_order_release) == 1))
+            return;
+        unlock_slow();
+    }
+
+private:
+    void lock_slow();
+    void unlock_slow();
+
+private:
+    /// 0 unlocked, 1 locked, 2 locked and may have waiters
+    std::atomic<int> state_ {0};
+    Mutex mutex_;
+    FiberWaitList waiters_;
+};
+
+/**
+ * @brief condition variable used with FiberMutex
+ */
+class FiberCondition : Noncopable {
+public:
+    /**
+     * @brief release mutex and park until notified, mutex is locked again when return
+     */
+    void wait(FiberMutex & mutex);
+
+    /**
+     * @brief wait until pred return true
+     */
+    template <typename Pred>
+    void wait(FiberMutex & mutex, Pred pred) {
+        while (!pred())
+            wait(mutex);
+    }
+
+    void notify_one();
+    void notify_all();
+
+private:
+    Mutex mutex_;
+    FiberWaitList waiters_;
+};
+
+/**
+ * @brief counting semaphore, uncontended wait and post are single atomic operation
+ */
+class FiberSemaphore : Noncopable {
+public:
+    explicit FiberSemaphore(size_t count = 0): count_(count) {}
+
+    void wait() {
+        if (likely(try_wait()))
+            return;
+        wait_slow();
+    }
+
+    bool try_wait() {
+        size_t count = count_.load(std::memory_order_relaxed);
+        while (count > 0) {
+            if (count_.compare_exchange_weak(count, count - 1, std::memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+    void post() {
+        count_.fetch_add(1, std::memory_order_seq_cst);
+        if (likely(waiting_.load(std::memory_order_seq_cst) == 0))
+            return;
+        post_slow();
+    }
+
+private:
+    void wait_slow();
+    void post_slow();
+
+private:
+    std::atomic<size_t> count_ {0};
+    /// count of waiters registered in list
+    std::atomic<size_t> waiting_ {0};
+    Mutex mutex_;
+    FiberWaitList waiters_;
+};
+
+}
+
+#endif
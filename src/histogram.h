@@ -0,0 +1,167 @@
+/**
+ * @file histogram.h
+ * @author aris
+ * @brief log linear latency histogram
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_HISTOGRAM_H__
+#define __STUDY_SRC_HISTOGRAM_H__
+
+#include "noncopable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief hdr style histogram of 64 bit values, each power of 2 range is split into
+ * 16 linear sub buckets, so any value is kept within 1/16 of its size.
+ * one thread record, any thread can take snapshot without lock
+ */
+class Histogram : Noncopable {
+public:
+    /// sub buckets of each power of 2 range is 1 << sub_bucket_bits
+    static const int sub_bucket_bits = 4;
+    static const int sub_bucket_count = 1 << sub_bucket_bits;
+    static const int bucket_count = (64 - sub_bucket_bits + 1) << sub_bucket_bits;
+
+    /**
+     * @brief copy of histogram taken at one time, counts of different buckets are not taken atomically
+     */
+    struct Snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t count {0};
+        uint64_t sum {0};
+        uint64_t min {0};
+        uint64_t max {0};
+
+        double mean() const { return count == 0 ? 0 : static_cast<double>(sum) / count; }
+
+        /**
+         * @brief get value that percent of values are not above, bucket upper bound is returned
+         * @param[in] percent 0 to 100
+         */
+        uint64_t percentile(double percent) const {
+            if (count == 0)
+                return 0;
+            uint64_t rank = static_cast<uint64_t>(percent / 100 * count + 0.5);
+            rank = std::max<uint64_t>(1, std::min(rank, count));
+            uint64_t seen = 0;
+            for (size_t index = 0; index < counts.size(); index++) {
+                seen += counts[index];
+                if (seen >= rank)
+                    return std::max(min, std::min(max, get_bucket_high(index)));
+            }
+            return max;
+        }
+
+        /**
+         * @brief add values of other snapshot
+         */
+        void merge(const Snapshot & other) {
+            if (other.count == 0)
+                return;
+            if (counts.empty())
+                counts.assign(bucket_count, 0);
+            for (size_t index = 0; index < other.counts.size(); index++)
+                counts[index] += other.counts[index];
+            min = count == 0 ? other.min : std::min(min, other.min);
+            max = std::max(max, other.max);
+            count += other.count;
+            sum += other.sum;
+        }
+    };
+
+    Histogram() : counts_(new std::atomic<uint64_t>[bucket_count]) {
+        for (int index = 0; index < bucket_count; index++)
+            counts_[index].store(0, std::memory_order_relaxed);
+    }
+
+    ~Histogram() { delete[] counts_; }
+
+    /**
+     * @brief record one value, only called by owner thread
+     */
+    void record(uint64_t value) {
+        // single writer, plain load and store is enough and cheaper than atomic add
+        std::atomic<uint64_t>& bucket = counts_[get_bucket(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value < min_.load(std::memory_order_relaxed))
+            min_.store(value, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed))
+            max_.store(value, std::memory_order_relaxed);
+        // count is published last, snapshot may see buckets a little ahead of it
+        count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief get count of values recorded
+     */
+    uint64_t get_count() const { return count_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief get sum of values recorded
+     */
+    uint64_t get_sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    Snapshot snapshot() const {
+        Snapshot snap;
+        snap.count = count_.load(std::memory_order_acquire);
+        if (snap.count == 0)
+            return snap;
+        snap.counts.resize(bucket_count);
+        uint64_t total = 0;
+        for (int index = 0; index < bucket_count; index++) {
+            snap.counts[index] = counts_[index].load(std::memory_order_relaxed);
+            total += snap.counts[index];
+        }
+        // buckets written after count was read are counted too
+        snap.count = total;
+        snap.sum = sum_.load(std::memory_order_relaxed);
+        snap.min = min_.load(std::memory_order_relaxed);
+        snap.max = max_.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    /**
+     * @brief get bucket of value, values below 16 have one bucket each
+     */
+    static int get_bucket(uint64_t value) {
+        if (value < static_cast<uint64_t>(sub_bucket_count))
+            return static_cast<int>(value);
+        int shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+        return ((shift + 1) << sub_bucket_bits) + static_cast<int>((value >> shift) & (sub_bucket_count - 1));
+    }
+
+    /**
+     * @brief get largest value of bucket
+     */
+    static uint64_t get_bucket_high(size_t index) {
+        if (index < static_cast<size_t>(sub_bucket_count))
+            return index;
+        int shift = static_cast<int>(index >> sub_bucket_bits) - 1;
+        uint64_t sub = (index & (sub_bucket_count - 1)) | sub_bucket_count;
+        return (sub << shift) + ((1ull << shift) - 1);
+    }
+
+private:
+    std::atomic<uint64_t>* counts_;
+    std::atomic<uint64_t> count_ {0};
+    std::atomic<uint64_t> sum_ {0};
+    std::atomic<uint64_t> min_ {~0ull};
+    std::atomic<uint64_t> max_ {0};
+};
+
+}
+
+#endif
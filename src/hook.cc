@@ -0,0 +1,473 @@
+#include "hook.h"
+#include "fd_manager.h"
+#include "fiber.h"
+#include "iomanager.h"
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <cstdarg>
+#include <dlfcn.h>
+#include <memory>
+#include <poll.h>
+#include <sys/time.h>
+
+namespace aris {
+
+/// hooks enabled on current thread
+static thread_local bool thread_hook_enable_ = false;
+/// set once any thread enable hooks, unhooked process skip fd lookup
+static std::atomic<bool> hook_used_ {false};
+
+#define HOOK_FUN(XX) \
+    XX(sleep) \
+    XX(usleep) \
+    XX(nanosleep) \
+    XX(socket) \
+    XX(connect) \
+    XX(accept) \
+    XX(read) \
+    XX(readv) \
+    XX(recv) \
+    XX(recvfrom) \
+    XX(recvmsg) \
+    XX(write) \
+    XX(writev) \
+    XX(send) \
+    XX(sendto) \
+    XX(sendmsg) \
+    XX(close) \
+    XX(fcntl) \
+    XX(ioctl) \
+    XX(setsockopt)
+
+/// before static objects of any file, their constructors may call hooked syscalls
+__attribute__((constructor(101))) static void hook_init() {
+#define XX(name) name ## _f = (name ## _fun)dlsym(RTLD_NEXT, #name);
+    HOOK_FUN(XX)
+#undef XX
+}
+
+bool is_hook_enable() {
+    return thread_hook_enable_;
+}
+
+void set_hook_enable(bool flag) {
+    if (flag)
+        hook_used_.store(true, std::memory_order_relaxed);
+    thread_hook_enable_ = flag;
+}
+
+ARIS_NOINLINE int& thread_errno() {
+    return errno;
+}
+
+static uint64_t get_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief get iomanager current fiber can be hold on, null if hooks are disabled,
+ * thread is not a worker of iomanager or it is not in scheduled fiber
+ */
+static IOManager* get_hook_iomanager() {
+    if (!thread_hook_enable_)
+        return nullptr;
+    IOManager* iom = IOManager::get_thread_iomanager();
+    if (iom == nullptr)
+        return nullptr;
+    Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+    if (fiber == nullptr || fiber == Fiber::get_thread_main_fiber())
+        return nullptr;
+    return iom;
+}
+
+/**
+ * @brief get context of socket whose blocking mode is emulated, null if call should go to system directly
+ */
+static FdContext::ptr get_hook_context(int fd) {
+    if (!hook_used_.load(std::memory_order_relaxed))
+        return nullptr;
+    return FdManager::get(fd);
+}
+
+/**
+ * @brief timeout state of one wait, timer callback may outlive the wait
+ */
+struct TimerInfo {
+    std::atomic<int> cancelled {0};
+};
+
+/**
+ * @brief wait until event of fd fire, fiber is hold on iomanager, otherwise thread wait in poll
+ * @param[in] fd fd to wait
+ * @param[in] context context of fd, it remember iomanager events are registered on
+ * @param[in] event READ or WRITE
+ * @param[in] deadline steady clock time in milliseconds, ~0ull means no timeout
+ * @return false if timeout or wait failed, errno is set
+ */
+static bool wait_event(int fd, const FdContext::ptr & context, IOManager::Event event, uint64_t deadline) {
+    uint64_t timeout = ~0ull;
+    if (deadline != ~0ull) {
+        uint64_t now = get_now_ms();
+        if (now >= deadline) {
+            thread_errno() = ETIMEDOUT;
+            return false;
+        }
+        timeout = deadline - now;
+    }
+    IOManager* iom = get_hook_iomanager();
+    if (iom == nullptr) {
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = event == IOManager::READ ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        int rt = poll(&pfd, 1, timeout == ~0ull ? -1 : static_cast<int>(std::min<uint64_t>(timeout, INT_MAX)));
+        if (rt == 0) {
+            thread_errno() = ETIMEDOUT;
+            return false;
+        }
+        // interrupted wait retry the call
+        return rt > 0 || thread_errno() == EINTR;
+    }
+    // one info per wait, late callback of previous wait only cause a spurious wake up
+    std::shared_ptr<TimerInfo> info(new TimerInfo());
+    Timer::ptr timer;
+    if (timeout != ~0ull) {
+        std::weak_ptr<TimerInfo> weak_info(info);
+        timer = iom->add_timer(timeout, [weak_info, fd, event, iom]() {
+            std::shared_ptr<TimerInfo> info = weak_info.lock();
+            if (!info || info->cancelled.exchange(ETIMEDOUT) != 0)
+                return;
+            iom->cancel_event(fd, event);
+        });
+    }
+    // close from any thread find iomanager there
+    context->set_iomanager(iom);
+    if (!iom->add_event(fd, event)) {
+        if (timer)
+            timer->cancel();
+        thread_errno() = EBADF;
+        return false;
+    }
+    Fiber::get_thread_current_fiber()->hold();
+    if (timer)
+        timer->cancel();
+    int cancelled = info->cancelled.load();
+    if (cancelled != 0) {
+        thread_errno() = cancelled;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief call io func, call would block on blocking socket wait until fd is ready and retry
+ * @param[in] fd fd of call
+ * @param[in] fun original func
+ * @param[in] event event call wait for
+ * @param[in] timeout_so SO_RCVTIMEO or SO_SNDTIMEO
+ */
+template <typename OriginFun, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, IOManager::Event event, int timeout_so, Args... args) {
+    FdContext::ptr context = get_hook_context(fd);
+    if (!context)
+        return fun(fd, args...);
+    if (context->is_closed()) {
+        errno = EBADF;
+        return -1;
+    }
+    if (!context->is_socket() || context->get_user_nonblock())
+        return fun(fd, args...);
+    uint64_t timeout = context->get_timeout(timeout_so);
+    uint64_t deadline = timeout == ~0ull ? ~0ull : get_now_ms() + timeout;
+    while (true) {
+        ssize_t n = fun(fd, args...);
+        // loop may run again after hold on other thread
+        while (n == -1 && thread_errno() == EINTR)
+            n = fun(fd, args...);
+        if (n != -1 || thread_errno() != EAGAIN)
+            return n;
+        // expired timeout fail with EAGAIN as system does
+        if (!wait_event(fd, context, event, deadline)) {
+            if (thread_errno() == ETIMEDOUT)
+                thread_errno() = EAGAIN;
+            return -1;
+        }
+        // woken by close
+        if (context->is_closed()) {
+            thread_errno() = EBADF;
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief hold current fiber for ms
+ * @return false if current fiber cannot be hold, caller should sleep in system
+ */
+static bool do_sleep(uint64_t ms) {
+    IOManager* iom = get_hook_iomanager();
+    if (iom == nullptr)
+        return false;
+    Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+    Scheduler::ResumeHint hint = Scheduler::get_resume_hint(fiber);
+    iom->add_timer(ms, [iom, fiber, hint]() {
+        iom->schedule(fiber, hint);
+    });
+    fiber->hold();
+    return true;
+}
+
+}
+
+extern "C" {
+
+#define XX(name) name ## _fun name ## _f = nullptr;
+    HOOK_FUN(XX)
+#undef XX
+
+unsigned int sleep(unsigned int seconds) {
+    if (!aris::do_sleep(seconds * 1000ull))
+        return sleep_f(seconds);
+    return 0;
+}
+
+int usleep(useconds_t usec) {
+    if (!aris::do_sleep((usec + 999ull) / 1000))
+        return usleep_f(usec);
+    return 0;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+    if (req == nullptr || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000)
+        return nanosleep_f(req, rem);
+    uint64_t ms = req->tv_sec * 1000ull + (req->tv_nsec + 999999) / 1000000;
+    if (!aris::do_sleep(ms))
+        return nanosleep_f(req, rem);
+    return 0;
+}
+
+int socket(int domain, int type, int protocol) {
+    int fd = socket_f(domain, type, protocol);
+    if (fd < 0 || !aris::is_hook_enable())
+        return fd;
+    aris::FdContext::ptr context = aris::FdManager::get(fd, true);
+    if (type & SOCK_NONBLOCK)
+        context->set_user_nonblock(true);
+    return fd;
+}
+
+int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) {
+    aris::FdContext::ptr context = aris::get_hook_context(fd);
+    if (!context)
+        return connect_f(fd, addr, addrlen);
+    if (context->is_closed()) {
+        errno = EBADF;
+        return -1;
+    }
+    if (!context->is_socket() || context->get_user_nonblock())
+        return connect_f(fd, addr, addrlen);
+    uint64_t deadline = timeout_ms == ~0ull ? ~0ull : aris::get_now_ms() + timeout_ms;
+    int n = connect_f(fd, addr, addrlen);
+    if (n == 0 || errno != EINPROGRESS)
+        return n;
+    // writable once connected or failed, result is in SO_ERROR
+    while (true) {
+        if (!aris::wait_event(fd, context, aris::IOManager::WRITE, deadline))
+            return -1;
+        if (context->is_closed()) {
+            aris::thread_errno() = EBADF;
+            return -1;
+        }
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+            return -1;
+        if (error != 0) {
+            aris::thread_errno() = error;
+            return -1;
+        }
+        // spurious wake up, poll tell if it is connected
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) > 0)
+            return 0;
+    }
+}
+
+int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+    aris::FdContext::ptr context = aris::get_hook_context(sockfd);
+    uint64_t timeout = context ? context->get_timeout(SO_SNDTIMEO) : ~0ull;
+    int rt = connect_with_timeout(sockfd, addr, addrlen, timeout);
+    // connect still in progress when SO_SNDTIMEO expire, as system does
+    if (rt == -1 && aris::thread_errno() == ETIMEDOUT && timeout != ~0ull)
+        aris::thread_errno() = EINPROGRESS;
+    return rt;
+}
+
+int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen) {
+    int fd = aris::do_io(sockfd, accept_f, aris::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    if (fd >= 0 && aris::is_hook_enable())
+        aris::FdManager::get(fd, true);
+    return fd;
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+    return aris::do_io(fd, read_f, aris::IOManager::READ, SO_RCVTIMEO, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+    return aris::do_io(fd, readv_f, aris::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+    return aris::do_io(sockfd, recv_f, aris::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+}
+
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen) {
+    return aris::do_io(sockfd, recvfrom_f, aris::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+    return aris::do_io(sockfd, recvmsg_f, aris::IOManager::READ, SO_RCVTIMEO, msg, flags);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+    return aris::do_io(fd, write_f, aris::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+    return aris::do_io(fd, writev_f, aris::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+}
+
+ssize_t send(int sockfd, const void* buf, size_t len, int flags) {
+    return aris::do_io(sockfd, send_f, aris::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);
+}
+
+ssize_t sendto(int sockfd, const void* buf, size_t len, int flags, const struct sockaddr* dest_addr, socklen_t addrlen) {
+    return aris::do_io(sockfd, sendto_f, aris::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+    return aris::do_io(sockfd, sendmsg_f, aris::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+}
+
+int close(int fd) {
+    aris::FdContext::ptr context = aris::get_hook_context(fd);
+    if (context) {
+        // waiters wake up and fail with EBADF
+        context->set_closed();
+        // fd may be waited on iomanager of other thread, or closed by thread out of any
+        aris::IOManager* iom = context->get_iomanager();
+        if (iom != nullptr)
+            iom->cancel_all(fd);
+        aris::FdManager::del(fd);
+    }
+    return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ...) {
+    va_list va;
+    va_start(va, cmd);
+    switch (cmd) {
+    case F_SETFL: {
+        int arg = va_arg(va, int);
+        va_end(va);
+        aris::FdContext::ptr context = aris::get_hook_context(fd);
+        if (!context || context->is_closed() || !context->is_socket())
+            return fcntl_f(fd, cmd, arg);
+        // socket stay non blocking in system, user mode is emulated
+        context->set_user_nonblock(arg & O_NONBLOCK);
+        if (context->get_sys_nonblock())
+            arg |= O_NONBLOCK;
+        else
+            arg &= ~O_NONBLOCK;
+        return fcntl_f(fd, cmd, arg);
+    }
+    case F_GETFL: {
+        va_end(va);
+        int arg = fcntl_f(fd, cmd);
+        aris::FdContext::ptr context = aris::get_hook_context(fd);
+        if (arg == -1 || !context || context->is_closed() || !context->is_socket())
+            return arg;
+        return context->get_user_nonblock() ? arg | O_NONBLOCK : arg & ~O_NONBLOCK;
+    }
+    // int arg
+    case F_DUPFD:
+    case F_DUPFD_CLOEXEC:
+    case F_SETFD:
+    case F_SETOWN:
+    case F_SETSIG:
+    case F_SETLEASE:
+    case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+    case F_SETPIPE_SZ:
+#endif
+#ifdef F_ADD_SEALS
+    case F_ADD_SEALS:
+#endif
+    {
+        int arg = va_arg(va, int);
+        va_end(va);
+        return fcntl_f(fd, cmd, arg);
+    }
+    // no arg
+    case F_GETFD:
+    case F_GETOWN:
+    case F_GETSIG:
+    case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+    case F_GETPIPE_SZ:
+#endif
+#ifdef F_GET_SEALS
+    case F_GET_SEALS:
+#endif
+        va_end(va);
+        return fcntl_f(fd, cmd);
+    // pointer arg, locks and owner ex
+    default: {
+        void* arg = va_arg(va, void*);
+        va_end(va);
+        return fcntl_f(fd, cmd, arg);
+    }
+    }
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    va_list va;
+    va_start(va, request);
+    void* arg = va_arg(va, void*);
+    va_end(va);
+    if (request == FIONBIO && arg != nullptr) {
+        aris::FdContext::ptr context = aris::get_hook_context(fd);
+        if (context && !context->is_closed() && context->is_socket()) {
+            // socket stay non blocking in system
+            context->set_user_nonblock(*static_cast<int*>(arg) != 0);
+            return 0;
+        }
+    }
+    return ioctl_f(fd, request, arg);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen) {
+    if (level == SOL_SOCKET && (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)
+        && optval != nullptr && optlen >= sizeof(timeval)) {
+        aris::FdContext::ptr context = aris::get_hook_context(sockfd);
+        if (context) {
+            const timeval* tv = static_cast<const timeval*>(optval);
+            uint64_t ms = tv->tv_sec * 1000ull + (tv->tv_usec + 999) / 1000;
+            // zero means wait forever as system does
+            context->set_timeout(optname, ms == 0 ? ~0ull : ms);
+        }
+    }
+    return setsockopt_f(sockfd, level, optname, optval, optlen);
+}
+
+}
@@ -0,0 +1,120 @@
+/**
+ * @file hook.h
+ * @author aris
+ * @brief syscall hooks, blocking call in fiber hold fiber instead of worker thread
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_HOOK_H__
+#define __STUDY_SRC_HOOK_H__
+
+#include <cstdint>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace aris {
+
+/**
+ * @brief check if hooks are enabled on current thread
+ */
+bool is_hook_enable();
+
+/**
+ * @brief enable or disable hooks on current thread, disabled by default.
+ * socket created by socket or accept on hooked thread is non blocking in system,
+ * blocking mode user set is emulated: in fiber run by IOManager call would block
+ * add event and hold fiber until fd is ready or SO_RCVTIMEO, SO_SNDTIMEO expire,
+ * elsewhere it wait in poll. sleep in fiber hold fiber on timer
+ * @param[in] flag enable hooks
+ */
+void set_hook_enable(bool flag);
+
+/**
+ * @brief errno of running thread, fiber may be resumed on another thread after hold,
+ * errno after it is accessed through this instead of address cached before hold
+ */
+int& thread_errno();
+
+}
+
+extern "C" {
+
+// original syscalls, found by dlsym with RTLD_NEXT
+typedef unsigned int (*sleep_fun)(unsigned int seconds);
+extern sleep_fun sleep_f;
+
+typedef int (*usleep_fun)(useconds_t usec);
+extern usleep_fun usleep_f;
+
+typedef int (*nanosleep_fun)(const struct timespec* req, struct timespec* rem);
+extern nanosleep_fun nanosleep_f;
+
+typedef int (*socket_fun)(int domain, int type, int protocol);
+extern socket_fun socket_f;
+
+typedef int (*connect_fun)(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+extern connect_fun connect_f;
+
+typedef int (*accept_fun)(int sockfd, struct sockaddr* addr, socklen_t* addrlen);
+extern accept_fun accept_f;
+
+typedef ssize_t (*read_fun)(int fd, void* buf, size_t count);
+extern read_fun read_f;
+
+typedef ssize_t (*readv_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern readv_fun readv_f;
+
+typedef ssize_t (*recv_fun)(int sockfd, void* buf, size_t len, int flags);
+extern recv_fun recv_f;
+
+typedef ssize_t (*recvfrom_fun)(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen);
+extern recvfrom_fun recvfrom_f;
+
+typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr* msg, int flags);
+extern recvmsg_fun recvmsg_f;
+
+typedef ssize_t (*write_fun)(int fd, const void* buf, size_t count);
+extern write_fun write_f;
+
+typedef ssize_t (*writev_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern writev_fun writev_f;
+
+typedef ssize_t (*send_fun)(int sockfd, const void* buf, size_t len, int flags);
+extern send_fun send_f;
+
+typedef ssize_t (*sendto_fun)(int sockfd, const void* buf, size_t len, int flags, const struct sockaddr* dest_addr, socklen_t addrlen);
+extern sendto_fun sendto_f;
+
+typedef ssize_t (*sendmsg_fun)(int sockfd, const struct msghdr* msg, int flags);
+extern sendmsg_fun sendmsg_f;
+
+typedef int (*close_fun)(int fd);
+extern close_fun close_f;
+
+typedef int (*fcntl_fun)(int fd, int cmd, ...);
+extern fcntl_fun fcntl_f;
+
+typedef int (*ioctl_fun)(int fd, unsigned long request, ...);
+extern ioctl_fun ioctl_f;
+
+typedef int (*setsockopt_fun)(int sockfd, int level, int optname, const void* optval, socklen_t optlen);
+extern setsockopt_fun setsockopt_f;
+
+/**
+ * @brief connect with timeout, fiber is hold until connected or timeout when hooks are enabled
+ * @param[in] timeout_ms timeout in milliseconds, ~0ull means no timeout
+ */
+int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms);
+
+}
+
+#endif
@@ -0,0 +1,562 @@
+#include "iomanager.h"
+#include "fd_manager.h"
+#include "hook.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace aris {
+
+/// max events taken by one epoll_wait
+static const int max_poll_events = 256;
+
+IOManager::IOManager(int thread_count, const std::string & name, bool use_caller)
+    : Scheduler(thread_count, name, use_caller) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+        ARIS_LOG_FMT_ERROR("create epoll failed, err: %s", strerror(errno));
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0)
+        ARIS_LOG_FMT_ERROR("create eventfd failed, err: %s", strerror(errno));
+    // level triggered, poller drain it after wake up, null data tell it from fd contexts
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) != 0)
+        ARIS_LOG_FMT_ERROR("add eventfd to epoll failed, err: %s", strerror(errno));
+    fd_contexts_.resize(64);
+}
+
+IOManager::~IOManager() {
+    // workers call park and unpark of this object, they must exit first
+    stop();
+    // later close of fds waited here must not reach this object
+    FdManager::forget_iomanager(this);
+    if (event_fd_ >= 0)
+        close(event_fd_);
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+}
+
+bool IOManager::set_io_backend(IoBackend backend, unsigned entries, unsigned batch) {
+    if (backend == IoBackend::EPOLL) {
+        for (auto & ring : rings_) {
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, ring->get_fd(), nullptr) != 0)
+                ARIS_LOG_FMT_WARN("remove io_uring from epoll failed, err: %s", strerror(errno));
+        }
+        rings_.clear();
+        return true;
+    }
+    if (!rings_.empty())
+        return true;
+    std::vector<Uring::ptr> rings;
+    for (int index = 0; index < get_thread_count(); index++) {
+        Uring::ptr ring(new Uring(entries));
+        if (!ring->is_valid() || !ring->probe()) {
+            ARIS_LOG_FMT_WARN("io_uring is not supported, use epoll, scheduler: %d", index);
+            return false;
+        }
+        rings.emplace_back(std::move(ring));
+    }
+    // ring is readable when it has completions, odd tag tell it from fd context
+    for (size_t index = 0; index < rings.size(); index++) {
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = (index << 1) | 1;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, rings[index]->get_fd(), &event) != 0) {
+            ARIS_LOG_FMT_ERROR("add io_uring to epoll failed, err: %s", strerror(errno));
+            for (size_t added = 0; added < index; added++)
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, rings[added]->get_fd(), nullptr);
+            return false;
+        }
+    }
+    rings_.swap(rings);
+    uring_batch_ = std::max(1u, batch);
+    return true;
+}
+
+bool IOManager::register_buffers(const std::vector<iovec> & buffers) {
+    for (auto & ring : rings_) {
+        if (!ring->register_buffers(buffers)) {
+            ARIS_LOG_FMT_WARN("register io_uring buffers failed, err: %s", strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IOManager::register_files(const std::vector<int> & fds) {
+    for (auto & ring : rings_) {
+        if (!ring->register_files(fds)) {
+            ARIS_LOG_FMT_WARN("register io_uring files failed, err: %s", strerror(errno));
+            return false;
+        }
+    }
+    RWMutex::Lock lock(mutex_);
+    registered_files_ = fds;
+    return true;
+}
+
+int IOManager::get_op_fd(int fd, int flags) {
+    if (!(flags & IO_FIXED_FILE))
+        return fd;
+    RWMutex::ReadLock lock(mutex_);
+    if (fd < 0 || static_cast<size_t>(fd) >= registered_files_.size())
+        return -1;
+    return registered_files_[fd];
+}
+
+template <typename Prepare>
+bool IOManager::submit_op(Prepare prepare, int flags, int32_t & res) {
+    int index = Scheduler::get_thread_worker_index();
+    if (rings_.empty() || index < 0 || Scheduler::get_thread_scheduler() != this)
+        return false;
+    Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+    if (fiber == nullptr || fiber == Fiber::get_thread_main_fiber())
+        return false;
+    Uring& ring = *rings_[index];
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (sqe == nullptr) {
+        ring.submit();
+        sqe = ring.get_sqe();
+        if (sqe == nullptr)
+            return false;
+    }
+    std::unique_ptr<IoOp> op(new IoOp());
+    op->hint = Scheduler::get_resume_hint(fiber);
+    op->fiber = fiber;
+    prepare(sqe);
+    if (flags & IO_FIXED_FILE)
+        sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->user_data = reinterpret_cast<uint64_t>(op.get());
+    pending_op_count_.fetch_add(1, std::memory_order_relaxed);
+    // the rest wait until worker run out of tasks, ops of many fibers go in one syscall
+    if (ring.get_pending() >= uring_batch_ && ring.submit() < 0)
+        ARIS_LOG_FMT_WARN("submit io_uring failed, err: %s", strerror(errno));
+    fiber->hold();
+    res = op->res;
+    return true;
+}
+
+size_t IOManager::reap_ring(int index, bool wait) {
+    return rings_[index]->reap([this](uint64_t data, int32_t res) {
+        IoOp* op = reinterpret_cast<IoOp*>(data);
+        op->res = res;
+        Fiber::ptr fiber = std::move(op->fiber);
+        Scheduler::ResumeHint hint = op->hint;
+        // op belong to fiber, it may be gone once fiber is scheduled
+        schedule(std::move(fiber), hint);
+        if (pending_op_count_.fetch_sub(1, std::memory_order_relaxed) == 1 && Scheduler::stopping())
+            tickle(get_thread_count());
+    }, wait);
+}
+
+bool IOManager::on_worker_flush(int index) {
+    if (rings_.empty())
+        return false;
+    Uring& ring = *rings_[index];
+    if (ring.get_pending() > 0 && ring.submit() < 0)
+        ARIS_LOG_FMT_WARN("submit io_uring failed, err: %s", strerror(errno));
+    return reap_ring(index, false) > 0;
+}
+
+template <typename Func>
+ssize_t IOManager::wait_io(int fd, Event event, Func fun) {
+    while (true) {
+        ssize_t n = fun();
+        // loop may run again after hold on other thread
+        while (n == -1 && thread_errno() == EINTR)
+            n = fun();
+        if (n != -1 || thread_errno() != EAGAIN)
+            return n;
+        Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+        if (Scheduler::get_thread_scheduler() != this || fiber == nullptr || fiber == Fiber::get_thread_main_fiber())
+            return n;
+        if (!add_event(fd, event)) {
+            thread_errno() = EBADF;
+            return -1;
+        }
+        fiber->hold();
+    }
+}
+
+/**
+ * @brief get result of ring op as syscall return, called after fiber is resumed
+ */
+static ssize_t get_op_result(int32_t res) {
+    if (res >= 0)
+        return res;
+    thread_errno() = -res;
+    return -1;
+}
+
+ssize_t IOManager::io_read(int fd, void* buf, size_t len, int64_t offset, int flags) {
+    int32_t res = 0;
+    while (submit_op([&](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buf);
+            sqe->len = len;
+            sqe->off = static_cast<uint64_t>(offset);
+        }, flags, res)) {
+        // non blocking socket is not waited by ring
+        if (res != -EAGAIN || !add_event(get_op_fd(fd, flags), READ))
+            return get_op_result(res);
+        Fiber::get_thread_current_fiber()->hold();
+    }
+    int real_fd = get_op_fd(fd, flags);
+    return wait_io(real_fd, READ, [&]() {
+        return offset < 0 ? read(real_fd, buf, len) : pread(real_fd, buf, len, offset);
+    });
+}
+
+ssize_t IOManager::io_write(int fd, const void* buf, size_t len, int64_t offset, int flags) {
+    int32_t res = 0;
+    while (submit_op([&](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buf);
+            sqe->len = len;
+            sqe->off = static_cast<uint64_t>(offset);
+        }, flags, res)) {
+        if (res != -EAGAIN || !add_event(get_op_fd(fd, flags), WRITE))
+            return get_op_result(res);
+        Fiber::get_thread_current_fiber()->hold();
+    }
+    int real_fd = get_op_fd(fd, flags);
+    return wait_io(real_fd, WRITE, [&]() {
+        return offset < 0 ? write(real_fd, buf, len) : pwrite(real_fd, buf, len, offset);
+    });
+}
+
+ssize_t IOManager::io_read_fixed(int fd, void* buf, size_t len, int64_t offset, int buf_index, int flags) {
+    int32_t res = 0;
+    while (submit_op([&](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buf);
+            sqe->len = len;
+            sqe->off = static_cast<uint64_t>(offset);
+            sqe->buf_index = buf_index;
+        }, flags, res)) {
+        if (res != -EAGAIN || !add_event(get_op_fd(fd, flags), READ))
+            return get_op_result(res);
+        Fiber::get_thread_current_fiber()->hold();
+    }
+    return io_read(fd, buf, len, offset, flags);
+}
+
+ssize_t IOManager::io_write_fixed(int fd, const void* buf, size_t len, int64_t offset, int buf_index, int flags) {
+    int32_t res = 0;
+    while (submit_op([&](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buf);
+            sqe->len = len;
+            sqe->off = static_cast<uint64_t>(offset);
+            sqe->buf_index = buf_index;
+        }, flags, res)) {
+        if (res != -EAGAIN || !add_event(get_op_fd(fd, flags), WRITE))
+            return get_op_result(res);
+        Fiber::get_thread_current_fiber()->hold();
+    }
+    return io_write(fd, buf, len, offset, flags);
+}
+
+int IOManager::io_accept(int fd, sockaddr* addr, socklen_t* addrlen, int flags) {
+    int32_t res = 0;
+    while (submit_op([&](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(addr);
+            sqe->addr2 = reinterpret_cast<uint64_t>(addrlen);
+        }, flags, res)) {
+        if (res != -EAGAIN || !add_event(get_op_fd(fd, flags), READ))
+            return get_op_result(res);
+        Fiber::get_thread_current_fiber()->hold();
+    }
+    int real_fd = get_op_fd(fd, flags);
+    return wait_io(real_fd, READ, [&]() {
+        return accept(real_fd, addr, addrlen);
+    });
+}
+
+int IOManager::io_fsync(int fd, bool datasync, int flags) {
+    int32_t res = 0;
+    if (submit_op([&](io_uring_sqe* sqe) {
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = fd;
+            sqe->fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+        }, flags, res))
+        return get_op_result(res);
+    int real_fd = get_op_fd(fd, flags);
+    return datasync ? fdatasync(real_fd) : fsync(real_fd);
+}
+
+IOManager* IOManager::get_thread_iomanager() {
+    return dynamic_cast<IOManager*>(Scheduler::get_thread_scheduler());
+}
+
+IOManager::FdContext* IOManager::get_fd_context(int fd, bool create) {
+    if (fd < 0)
+        return nullptr;
+    {
+        RWMutex::ReadLock lock(mutex_);
+        if (static_cast<size_t>(fd) < fd_contexts_.size() && fd_contexts_[fd])
+            return fd_contexts_[fd].get();
+    }
+    if (!create)
+        return nullptr;
+    RWMutex::Lock lock(mutex_);
+    if (static_cast<size_t>(fd) >= fd_contexts_.size())
+        fd_contexts_.resize(std::max<size_t>(fd + 1, fd_contexts_.size() * 3 / 2));
+    if (!fd_contexts_[fd]) {
+        fd_contexts_[fd].reset(new FdContext());
+        fd_contexts_[fd]->fd = fd;
+    }
+    return fd_contexts_[fd].get();
+}
+
+bool IOManager::add_event(int fd, Event event, std::function<void()> cb) {
+    if (event != READ && event != WRITE) {
+        ARIS_LOG_FMT_WARN("add event failed, fd: %d, invalid event: %d", fd, event);
+        return false;
+    }
+    FdContext* context = get_fd_context(fd, true);
+    if (context == nullptr) {
+        ARIS_LOG_FMT_WARN("add event failed, invalid fd: %d", fd);
+        return false;
+    }
+    EventContext waiter;
+    Scheduler* scheduler = Scheduler::get_thread_scheduler();
+    waiter.scheduler = scheduler ? scheduler : this;
+    if (cb) {
+        waiter.cb.swap(cb);
+    } else {
+        // only fiber run by scheduler can be hold
+        Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+        if (scheduler == nullptr || fiber == nullptr || fiber == Fiber::get_thread_main_fiber()) {
+            ARIS_LOG_FMT_WARN("add event failed, fd: %d, only fiber on scheduler can wait without func", fd);
+            return false;
+        }
+        waiter.hint = Scheduler::get_resume_hint(fiber);
+        waiter.fiber = std::move(fiber);
+    }
+    // poller lock context before it fire, waiter is set before it can see the event
+    Mutex::Lock lock(context->mutex);
+    if (context->events & event) {
+        ARIS_LOG_FMT_WARN("add event failed, fd: %d, event: %d is already waited", fd, event);
+        return false;
+    }
+    epoll_event epevent;
+    memset(&epevent, 0, sizeof(epevent));
+    epevent.events = EPOLLET | context->events | event;
+    epevent.data.ptr = context;
+    int op = context->events == NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(epoll_fd_, op, fd, &epevent) != 0) {
+        ARIS_LOG_FMT_ERROR("add event failed, fd: %d, event: %d, err: %s", fd, event, strerror(errno));
+        return false;
+    }
+    context->events |= event;
+    context->get_context(event) = std::move(waiter);
+    pending_event_count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool IOManager::del_event(int fd, Event event) {
+    FdContext* context = get_fd_context(fd, false);
+    if (context == nullptr)
+        return false;
+    Mutex::Lock lock(context->mutex);
+    return remove_event(context, event, false);
+}
+
+bool IOManager::cancel_event(int fd, Event event) {
+    FdContext* context = get_fd_context(fd, false);
+    if (context == nullptr)
+        return false;
+    Mutex::Lock lock(context->mutex);
+    return remove_event(context, event, true);
+}
+
+bool IOManager::cancel_all(int fd) {
+    FdContext* context = get_fd_context(fd, false);
+    if (context == nullptr)
+        return false;
+    Mutex::Lock lock(context->mutex);
+    bool read = remove_event(context, READ, true);
+    bool write = remove_event(context, WRITE, true);
+    return read || write;
+}
+
+bool IOManager::remove_event(FdContext* context, Event event, bool fire) {
+    if (!(context->events & event))
+        return false;
+    uint32_t left = context->events & ~event;
+    epoll_event epevent;
+    memset(&epevent, 0, sizeof(epevent));
+    epevent.events = EPOLLET | left;
+    epevent.data.ptr = context;
+    int op = left == NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    // fd closed before remove is already gone from epoll, waiter is still released
+    if (epoll_ctl(epoll_fd_, op, context->fd, &epevent) != 0)
+        ARIS_LOG_FMT_WARN("remove event failed, fd: %d, event: %d, err: %s", context->fd, event, strerror(errno));
+    context->events = left;
+    if (fire) {
+        fire_event(context, event);
+        return true;
+    }
+    context->get_context(event) = EventContext();
+    if (pending_event_count_.fetch_sub(1, std::memory_order_relaxed) == 1 && Scheduler::stopping())
+        tickle(get_thread_count());
+    return true;
+}
+
+void IOManager::fire_event(FdContext* context, Event event) {
+    EventContext waiter = std::move(context->get_context(event));
+    context->get_context(event) = EventContext();
+    if (waiter.cb)
+        waiter.scheduler->schedule(std::move(waiter.cb));
+    else
+        waiter.scheduler->schedule(std::move(waiter.fiber), waiter.hint);
+    // last waiter gone, stopped workers can exit now
+    if (pending_event_count_.fetch_sub(1, std::memory_order_relaxed) == 1 && Scheduler::stopping())
+        tickle(get_thread_count());
+}
+
+void IOManager::park(int index) {
+    int expected = -1;
+    if (!poller_.compare_exchange_strong(expected, index, std::memory_order_seq_cst)) {
+        Scheduler::park(index);
+        return;
+    }
+    poll(index);
+}
+
+void IOManager::unpark(int index) {
+    Scheduler::unpark(index);
+    // parker must be notified before poller is read, poller do the opposite
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (poller_.load(std::memory_order_relaxed) == index) {
+        uint64_t value = 1;
+        if (write(event_fd_, &value, sizeof(value)) != sizeof(value))
+            ARIS_LOG_FMT_WARN("wake up poller failed, err: %s", strerror(errno));
+    }
+}
+
+bool IOManager::stopping() {
+    // cancelled stop abandon waiters
+    return Scheduler::stopping() && (cancelling() || !has_pending());
+}
+
+bool IOManager::has_pending() {
+    return pending_event_count_.load(std::memory_order_relaxed) > 0
+        || pending_op_count_.load(std::memory_order_relaxed) > 0 || has_timer();
+}
+
+void IOManager::on_timer_front_changed() {
+    if (poller_.load(std::memory_order_seq_cst) == -1) {
+        // next idle worker poll with new timeout
+        tickle();
+        return;
+    }
+    uint64_t value = 1;
+    if (write(event_fd_, &value, sizeof(value)) != sizeof(value))
+        ARIS_LOG_FMT_WARN("wake up poller failed, err: %s", strerror(errno));
+}
+
+void IOManager::on_worker_start(int /*index*/) {
+    if (hook_enable_)
+        aris::set_hook_enable(true);
+}
+
+void IOManager::on_worker_exit(int /*index*/) {
+    if (hook_enable_)
+        aris::set_hook_enable(false);
+}
+
+void IOManager::poll(int index) {
+    Parker& parker = get_parker(index);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // unpark came before this worker became poller
+    if (!parker.try_consume()) {
+        uint64_t next = get_next_timer();
+        // wake up at stop deadline to cancel what is left
+        uint64_t deadline = get_stop_deadline();
+        if (deadline != ~0ull && Scheduler::stopping()) {
+            uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            next = std::min(next, deadline > now ? (deadline - now + 999999) / 1000000 : 0);
+        }
+        int timeout = next == ~0ull ? -1 : static_cast<int>(std::min<uint64_t>(next, INT_MAX));
+        epoll_event events[max_poll_events];
+        int count = 0;
+        do {
+            count = epoll_wait(epoll_fd_, events, max_poll_events, timeout);
+        } while (count < 0 && errno == EINTR);
+        if (count < 0)
+            ARIS_LOG_FMT_ERROR("epoll wait failed, err: %s", strerror(errno));
+        for (int n = 0; n < count; n++) {
+            epoll_event & event = events[n];
+            if (event.data.ptr == nullptr) {
+                uint64_t value = 0;
+                while (read(event_fd_, &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
+            if (event.data.u64 & 1) {
+                reap_ring(static_cast<int>(event.data.u64 >> 1), true);
+                continue;
+            }
+            FdContext* context = static_cast<FdContext*>(event.data.ptr);
+            Mutex::Lock lock(context->mutex);
+            // error or hang up wake up both sides, their next call see it
+            uint32_t fired = event.events;
+            if (fired & (EPOLLERR | EPOLLHUP))
+                fired |= READ | WRITE;
+            fired &= context->events;
+            if (fired == NONE)
+                continue;
+            uint32_t left = context->events & ~fired;
+            epoll_event epevent;
+            memset(&epevent, 0, sizeof(epevent));
+            epevent.events = EPOLLET | left;
+            epevent.data.ptr = context;
+            int op = left == NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+            if (epoll_ctl(epoll_fd_, op, context->fd, &epevent) != 0)
+                ARIS_LOG_FMT_WARN("remove fired event failed, fd: %d, err: %s", context->fd, strerror(errno));
+            context->events = left;
+            if (fired & READ)
+                fire_event(context, READ);
+            if (fired & WRITE)
+                fire_event(context, WRITE);
+        }
+    }
+    std::vector<std::function<void()>> cbs;
+    list_expired_cbs(cbs);
+    if (!cbs.empty())
+        schedule_batch(cbs.begin(), cbs.end());
+    if (Scheduler::stopping())
+        check_stop_deadline();
+    poller_.store(-1, std::memory_order_seq_cst);
+    // woken by fd event or timer is still in sleeper list, if tickle took it first drop its unpark
+    bool tickled = !remove_sleeper(index);
+    if (tickled)
+        parker.try_consume();
+    if (stopping()) {
+        tickle(get_thread_count());
+    } else if (tickled && has_pending()) {
+        // this worker leave to run task, hand poller role over to other idle worker
+        tickle();
+    }
+}
+
+}
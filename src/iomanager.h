@@ -0,0 +1,342 @@
+/**
+ * @file iomanager.h
+ * @author aris
+ * @brief scheduler waiting fd events with epoll
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_IOMANAGER_H__
+#define __STUDY_SRC_IOMANAGER_H__
+
+#include "scheduler.h"
+#include "timer.h"
+#include "uring.h"
+#include "utils.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief scheduler whose idle worker wait fd events and timers, one idle worker block in epoll_wait
+ * as poller until next timer, other idle workers park as usual. waiter is fired once and removed,
+ * events and timers are only checked by idle worker.
+ * io ops run on per worker io_uring when uring backend is set, otherwise readiness is waited with epoll
+ */
+class IOManager : public Scheduler, public TimerManager {
+public:
+    typedef std::shared_ptr<IOManager> ptr;
+
+    /**
+     * @brief fd event, same value as epoll
+     */
+    enum Event {
+        NONE = 0x0,
+        READ = EPOLLIN,
+        WRITE = EPOLLOUT,
+    };
+
+    /**
+     * @brief how io ops are carried out
+     */
+    enum class IoBackend {
+        /// wait readiness with epoll, then call syscall
+        EPOLL,
+        /// submit ops to io_uring of current worker, batched until worker idle or batch is full,
+        /// completions are reaped from ring without syscall
+        URING,
+    };
+
+    /// io op flag, fd is index in registered files
+    static const int IO_FIXED_FILE = 0x1;
+
+    /**
+     * @brief Construct a new IOManager object
+     * @param[in] thread_count worker count
+     * @param[in] name scheduler name
+     * @param[in] use_caller thread calling start is worker 0
+     */
+    IOManager(int thread_count = 1, const std::string & name = "iomanager", bool use_caller = false);
+
+    ~IOManager();
+
+    /**
+     * @brief wait event of fd, fd should be non blocking
+     * @code
+     *  iom->add_event(fd, IOManager::READ);
+     *  Fiber::get_thread_current_fiber()->hold();
+     * @endcode
+     * @param[in] fd fd to wait
+     * @param[in] event READ or WRITE
+     * @param[in] cb func scheduled when event fire, null means current fiber,
+     * it should hold after add and is resumed when event fire
+     * @return false if event is already waited or epoll fail
+     */
+    bool add_event(int fd, Event event, std::function<void()> cb = nullptr);
+
+    /**
+     * @brief remove waiter of event without firing it
+     * @return false if event is not waited
+     */
+    bool del_event(int fd, Event event);
+
+    /**
+     * @brief remove waiter of event and fire it at once
+     * @return false if event is not waited
+     */
+    bool cancel_event(int fd, Event event);
+
+    /**
+     * @brief remove and fire all waiters of fd
+     * @return false if fd has no waiter
+     */
+    bool cancel_all(int fd);
+
+    /**
+     * @brief get count of events waited
+     */
+    size_t get_pending_event_count() const { return pending_event_count_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief set io backend, call before start
+     * @param[in] backend io backend
+     * @param[in] entries submission queue size of each worker ring
+     * @param[in] batch pending submissions flushed at once before worker idle
+     * @return false if kernel lack io_uring ops, epoll is kept
+     */
+    bool set_io_backend(IoBackend backend, unsigned entries = 256, unsigned batch = 32);
+
+    /**
+     * @brief get io backend in use
+     */
+    IoBackend get_io_backend() const { return rings_.empty() ? IoBackend::EPOLL : IoBackend::URING; }
+
+    /**
+     * @brief register buffers for io_read_fixed and io_write_fixed on all worker rings,
+     * previous buffers are replaced
+     * @return false if registration failed
+     */
+    bool register_buffers(const std::vector<iovec> & buffers);
+
+    /**
+     * @brief register fds for op with IO_FIXED_FILE flag, previous fds are replaced
+     * @return false if registration failed
+     */
+    bool register_files(const std::vector<int> & fds);
+
+    /**
+     * @brief read in fiber, fiber is hold until data is read, in other context call syscall directly.
+     * io ops return -1 and set errno when they fail as syscalls do,
+     * buffer must stay valid until op return, not on shared stack
+     * @param[in] fd fd, or index of registered files with IO_FIXED_FILE
+     * @param[in] offset file offset, -1 means current position
+     * @param[in] flags io op flags
+     */
+    ssize_t io_read(int fd, void* buf, size_t len, int64_t offset = -1, int flags = 0);
+
+    /**
+     * @brief write in fiber
+     */
+    ssize_t io_write(int fd, const void* buf, size_t len, int64_t offset = -1, int flags = 0);
+
+    /**
+     * @brief read into registered buffer
+     * @param[in] buf address inside registered buffer
+     * @param[in] buf_index index of registered buffer
+     */
+    ssize_t io_read_fixed(int fd, void* buf, size_t len, int64_t offset, int buf_index, int flags = 0);
+
+    /**
+     * @brief write from registered buffer
+     */
+    ssize_t io_write_fixed(int fd, const void* buf, size_t len, int64_t offset, int buf_index, int flags = 0);
+
+    /**
+     * @brief accept connection in fiber
+     */
+    int io_accept(int fd, sockaddr* addr, socklen_t* addrlen, int flags = 0);
+
+    /**
+     * @brief sync file in fiber
+     * @param[in] datasync only sync data as fdatasync
+     */
+    int io_fsync(int fd, bool datasync = false, int flags = 0);
+
+    /**
+     * @brief enable syscall hooks on all workers, call before start
+     */
+    void set_hook_enable(bool flag) { hook_enable_ = flag; }
+
+    /**
+     * @brief get iomanager current thread belongs to, null if not a worker of iomanager
+     */
+    static IOManager* get_thread_iomanager();
+
+protected:
+    /**
+     * @brief first idle worker become poller and block in epoll_wait, others park
+     */
+    void park(int index) override;
+
+    /**
+     * @brief poller is woken by eventfd, others by parker
+     */
+    void unpark(int index) override;
+
+    /**
+     * @brief workers exit when all waited events, io ops and timers are fired or removed,
+     * recurring timers should be cancelled before stop. cancelled stop abandon them
+     */
+    bool stopping() override;
+
+    /**
+     * @brief wake up poller to wait with new timeout
+     */
+    void on_timer_front_changed() override;
+
+    /**
+     * @brief enable hooks on worker if asked
+     */
+    void on_worker_start(int index) override;
+
+    /**
+     * @brief restore hooks of worker thread, caller thread in use_caller mode go on as plain thread
+     */
+    void on_worker_exit(int index) override;
+
+    /**
+     * @brief submit pending io ops of worker ring and reap its completions
+     */
+    bool on_worker_flush(int index) override;
+
+private:
+    /**
+     * @brief one waiter of fd event
+     */
+    struct EventContext {
+        /// scheduler waiter run on
+        Scheduler* scheduler {nullptr};
+        Fiber::ptr fiber {nullptr};
+        std::function<void()> cb {nullptr};
+        /// worker and band fiber resume in
+        Scheduler::ResumeHint hint;
+    };
+
+    /**
+     * @brief waiters of one fd, never freed before iomanager, epoll keep its address
+     */
+    struct FdContext {
+        EventContext & get_context(Event event) {
+            return event == READ ? read : write;
+        }
+
+        Mutex mutex;
+        int fd {-1};
+        /// events registered in epoll
+        uint32_t events {NONE};
+        EventContext read;
+        EventContext write;
+    };
+
+    /**
+     * @brief io op in flight on ring, on heap so shared stack fiber can be switched out
+     */
+    struct IoOp {
+        Fiber::ptr fiber {nullptr};
+        Scheduler::ResumeHint hint;
+        int32_t res {0};
+    };
+
+private:
+    /**
+     * @brief get context of fd
+     * @param[in] create create context if fd has none
+     */
+    FdContext* get_fd_context(int fd, bool create);
+
+    /**
+     * @brief remove event from fd, lock of context should be held
+     * @param[in] fire schedule waiter of event
+     */
+    bool remove_event(FdContext* context, Event event, bool fire);
+
+    /**
+     * @brief schedule waiter of event and reset it, lock of context should be held
+     */
+    void fire_event(FdContext* context, Event event);
+
+    /**
+     * @brief wait fd events as poller and schedule waiters and expired timers
+     */
+    void poll(int index);
+
+    /**
+     * @brief check if events, io ops or timers are waited
+     */
+    bool has_pending();
+
+    /**
+     * @brief run op on ring of current worker and hold fiber until it complete
+     * @param[in] prepare fill submission entry
+     * @param[in] flags io op flags
+     * @param[out] res op result, negative errno if failed
+     * @return false if op cannot run on ring, caller should fall back
+     */
+    template <typename Prepare>
+    bool submit_op(Prepare prepare, int flags, int32_t & res);
+
+    /**
+     * @brief reap completions of worker ring and schedule their fibers
+     * @param[in] wait wait if other thread is reaping
+     * @return count of completions
+     */
+    size_t reap_ring(int index, bool wait);
+
+    /**
+     * @brief call syscall, fiber wait with epoll while fd is not ready
+     * @param[in] fd fd of call
+     * @param[in] event event call wait for
+     * @param[in] fun syscall
+     */
+    template <typename Func>
+    ssize_t wait_io(int fd, Event event, Func fun);
+
+    /**
+     * @brief get fd of op, registered fd when IO_FIXED_FILE is set
+     * @return -1 if index is invalid
+     */
+    int get_op_fd(int fd, int flags);
+
+private:
+    int epoll_fd_ {-1};
+    /// wake up poller
+    int event_fd_ {-1};
+    /// worker blocking in epoll_wait, -1 if none
+    std::atomic<int> poller_ {-1};
+    std::atomic<size_t> pending_event_count_ {0};
+    /// enable syscall hooks on workers
+    bool hook_enable_ {false};
+    /// io_uring of each worker, empty when epoll backend is used
+    std::vector<Uring::ptr> rings_;
+    unsigned uring_batch_ {32};
+    std::atomic<size_t> pending_op_count_ {0};
+    /// fds registered to rings
+    std::vector<int> registered_files_;
+    RWMutex mutex_;
+    std::vector<std::unique_ptr<FdContext>> fd_contexts_;
+};
+
+}
+
+#endif
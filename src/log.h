@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <chrono>
 
+#include "fiber.h"
 #include "singelton.h"
 #include "utils.h"
 
@@ -37,7 +38,7 @@
 
 #define ARIS_LOG_FMT_SIMPLE(level, fmt, ...) \
     aris::SingeltonPtr<aris::LogMgr>::get_instance()->log(level, aris::LogEvent::ptr(new aris::LogEvent(__FILE__, \
-        __func__ , __LINE__, getpid(), pthread_self(), 0, std::chrono::system_clock::now(), aris::StringGenerator::format(fmt, __VA_ARGS__))))
+        __func__ , __LINE__, getpid(), pthread_self(), aris::Fiber::get_current_fiber_id(), std::chrono::system_clock::now(), aris::StringGenerator::format(fmt, __VA_ARGS__))))
 
 namespace aris {
 
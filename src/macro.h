@@ -5,6 +5,24 @@ namespace aris {
 #define unlikely(x) __builtin_expect(!!(x), 0)
 
 
+/// never inline or analyze across this function, thread local read inside is not cached by caller
+#if defined(__clang__)
+#define ARIS_NOINLINE __attribute__((noinline))
+#else
+#define ARIS_NOINLINE __attribute__((noinline, noipa))
+#endif
+
+
+/// pause in spin loop, let sibling hyper thread run
+#if defined(__x86_64__) || defined(__i386__)
+#define ARIS_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define ARIS_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ARIS_CPU_RELAX() do {} while (0)
+#endif
+
+
 #define ARIS_ASSERT(x) \
     if(unlikely(x)) { \
         assert(x);  \
@@ -0,0 +1,142 @@
+/**
+ * @file mpmc_queue.h
+ * @author aris
+ * @brief bounded lock free mpmc queue
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_MPMC_QUEUE_H__
+#define __STUDY_SRC_MPMC_QUEUE_H__
+
+#include "noncopable.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace aris {
+
+/**
+ * @brief bounded mpmc queue, each cell carry a sequence number telling
+ * whether it is ready for push or pop in current round, no lock and no allocation after construct
+ */
+template <typename T>
+class MPMCQueue : Noncopable {
+public:
+    /**
+     * @brief Construct a new MPMCQueue object
+     * @param[in] capacity max item count, rounded up to power of 2
+     */
+    explicit MPMCQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        cells_ = new Cell[size];
+        for (size_t index = 0; index < size; index++)
+            cells_[index].sequence.store(index, std::memory_order_relaxed);
+    }
+
+    ~MPMCQueue() {
+        delete[] cells_;
+    }
+
+    /**
+     * @brief push item
+     * @return false if queue is full, item is not moved
+     */
+    bool push(T & item) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // cell still hold item of last round
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief pop item
+     * @return false if queue is empty
+     */
+    bool pop(T & item) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // cell not filled in this round
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->value);
+        // cell is ready for push of next round
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief get item count, only a hint under concurrent access
+     */
+    size_t size() const {
+        size_t enqueue = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t dequeue = dequeue_pos_.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+private:
+    /**
+     * @brief each cell own a cache line, neighbour cells are pushed and popped by different
+     * threads at the same time and would bounce one line otherwise. costs 64 bytes a cell,
+     * 256KB for the 4096 cell inject queue of scheduler
+     */
+    struct alignas(cache_line_size) Cell {
+        std::atomic<size_t> sequence {0};
+        T value {};
+    };
+
+private:
+    Cell* cells_ {nullptr};
+    size_t mask_ {0};
+    /// producers and consumers spin on different cache lines
+    alignas(cache_line_size) std::atomic<size_t> enqueue_pos_ {0};
+    alignas(cache_line_size) std::atomic<size_t> dequeue_pos_ {0};
+};
+
+}
+
+#endif
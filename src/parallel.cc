@@ -0,0 +1,80 @@
+#include "parallel.h"
+
+#include <algorithm>
+
+namespace aris {
+
+namespace detail {
+
+/// each claim take this share of what is left per participant, smaller share balance better
+static const size_t chunk_divisor = 2;
+
+ParallelRange::ParallelRange(size_t begin, size_t end, size_t grain, size_t participants)
+    : end_(end), grain_(std::max<size_t>(grain, 1)), divisor_(std::max<size_t>(participants, 1) * chunk_divisor),
+    total_(end - begin), next_(begin) {
+}
+
+bool ParallelRange::next(size_t & begin, size_t & end) {
+    size_t current = next_.load(std::memory_order_relaxed);
+    while (current < end_) {
+        size_t left = end_ - current;
+        size_t chunk = std::min(left, std::max(grain_, left / divisor_));
+        if (next_.compare_exchange_weak(current, current + chunk, std::memory_order_relaxed)) {
+            begin = current;
+            end = current + chunk;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ParallelRange::finish(size_t count) {
+    if (count == 0)
+        return;
+    // done count is a release sequence, caller see all writes of participants
+    if (done_.fetch_add(count, std::memory_order_acq_rel) + count != total_)
+        return;
+    if (signal_.exchange(true, std::memory_order_acq_rel))
+        waiter_.notify();
+}
+
+void ParallelRange::cancel(std::exception_ptr exception) {
+    if (!failed_.exchange(true, std::memory_order_acq_rel))
+        exception_ = exception;
+    // indexes not claimed are counted done without running
+    size_t current = next_.exchange(end_, std::memory_order_relaxed);
+    if (current < end_)
+        finish(end_ - current);
+}
+
+void ParallelRange::wait() {
+    // last finisher passed already if signal is set
+    if (done_.load(std::memory_order_acquire) != total_ && !signal_.exchange(true, std::memory_order_acq_rel))
+        waiter_.wait();
+    if (failed_.load(std::memory_order_acquire))
+        std::rethrow_exception(exception_);
+}
+
+void fork_join(Scheduler* scheduler, const ParallelRange::ptr & range, size_t helpers,
+    const std::function<void()> & participant) {
+    // one push each, every push wake up one idle worker
+    for (size_t index = 0; index < helpers; index++)
+        scheduler->schedule(participant);
+    // caller help instead of blocking, it may finish all before helpers start
+    participant();
+    range->wait();
+}
+
+size_t get_participant_count(Scheduler* scheduler, size_t count, size_t grain) {
+    if (scheduler == nullptr || count <= grain)
+        return 1;
+    // calling worker is one of participants, caller from outside help beside all workers
+    size_t participants = scheduler->get_active_count();
+    if (Scheduler::get_thread_scheduler() != scheduler)
+        participants++;
+    return std::min(participants, (count + grain - 1) / grain);
+}
+
+}
+
+}
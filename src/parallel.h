@@ -0,0 +1,316 @@
+/**
+ * @file parallel.h
+ * @author aris
+ * @brief fork join parallel algorithms run on scheduler
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_PARALLEL_H__
+#define __STUDY_SRC_PARALLEL_H__
+
+#include "fiber_sync.h"
+#include "noncopable.h"
+#include "scheduler.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace aris {
+
+namespace detail {
+
+/**
+ * @brief index range shared by caller and helpers, each participant claim chunks until none left.
+ * chunk is a share of what is left, so early chunks are big and tail chunks are small
+ */
+class ParallelRange : Noncopable {
+public:
+    typedef std::shared_ptr<ParallelRange> ptr;
+
+    /**
+     * @brief waiter of caller is captured here, range is made by fiber that wait on it
+     * @param[in] begin first index
+     * @param[in] end end index
+     * @param[in] grain min chunk size
+     * @param[in] participants threads working on range, used to size chunks
+     */
+    ParallelRange(size_t begin, size_t end, size_t grain, size_t participants);
+
+    /**
+     * @brief claim next chunk
+     * @return false if no index left
+     */
+    bool next(size_t & begin, size_t & end);
+
+    /**
+     * @brief report claimed indexes are done, last one wake up caller
+     */
+    void finish(size_t count);
+
+    /**
+     * @brief keep first exception and drop indexes not claimed yet
+     */
+    void cancel(std::exception_ptr exception);
+
+    /**
+     * @brief block caller until all indexes are done, fiber is hold instead of thread,
+     * exception thrown by body is rethrown here
+     */
+    void wait();
+
+private:
+    const size_t end_;
+    const size_t grain_;
+    const size_t divisor_;
+    const size_t total_;
+    std::atomic<size_t> next_;
+    std::atomic<size_t> done_ {0};
+    /// set by caller before it wait and by last finisher, second one go on
+    std::atomic<bool> signal_ {false};
+    /// kept off caller stack, finisher reach it while caller is hold
+    FiberWaiter waiter_;
+    std::atomic<bool> failed_ {false};
+    std::exception_ptr exception_ {nullptr};
+};
+
+/**
+ * @brief run participant on helpers and calling thread until range is done
+ * @param[in] scheduler helpers run on it
+ * @param[in] range shared range
+ * @param[in] helpers helper count
+ * @param[in] participant claim and run chunks of range until none left
+ */
+void fork_join(Scheduler* scheduler, const ParallelRange::ptr & range, size_t helpers,
+    const std::function<void()> & participant);
+
+/**
+ * @brief count of participants worth starting, calling thread included
+ * @param[in] scheduler scheduler helpers run on, null means calling thread do all work
+ * @param[in] count index count
+ * @param[in] grain min chunk size
+ */
+size_t get_participant_count(Scheduler* scheduler, size_t count, size_t grain);
+
+/**
+ * @brief run fn(begin, end) on chunks of [begin, end)
+ */
+template <typename Func>
+void parallel_chunks(Scheduler* scheduler, size_t begin, size_t end, size_t grain, Func && fn) {
+    if (begin >= end)
+        return;
+    if (scheduler == nullptr)
+        scheduler = Scheduler::get_thread_scheduler();
+    grain = std::max<size_t>(grain, 1);
+    size_t participants = get_participant_count(scheduler, end - begin, grain);
+    if (participants <= 1) {
+        fn(begin, end);
+        return;
+    }
+    ParallelRange::ptr range = std::make_shared<ParallelRange>(begin, end, grain, participants);
+    // helper starting late may outlive this call, it only find range empty and leave
+    auto body = std::make_shared<typename std::decay<Func>::type>(std::forward<Func>(fn));
+    fork_join(scheduler, range, participants - 1, [range, body]() {
+        size_t first = 0;
+        size_t last = 0;
+        while (range->next(first, last)) {
+            try {
+                (*body)(first, last);
+            } catch (...) {
+                range->cancel(std::current_exception());
+            }
+            range->finish(last - first);
+        }
+    });
+}
+
+}
+
+/**
+ * @brief call fn(index) for each index in [begin, end) on workers of scheduler,
+ * calling fiber run chunks too and return when all are done.
+ * first exception thrown by fn is rethrown, indexes not started yet are skipped.
+ * shared stack caller is swapped out while it wait, fn should not reach its stack locals
+ * @param[in] scheduler workers to run on, null means current scheduler, run serially if none
+ * @param[in] begin first index
+ * @param[in] end end index
+ * @param[in] fn body called with index
+ * @param[in] grain min indexes run in a row, raise it when fn is tiny
+ */
+template <typename Func>
+void parallel_for(Scheduler* scheduler, size_t begin, size_t end, Func fn, size_t grain = 1) {
+    detail::parallel_chunks(scheduler, begin, end, grain, [fn](size_t first, size_t last) mutable {
+        for (size_t index = first; index < last; index++)
+            fn(index);
+    });
+}
+
+/**
+ * @brief reduce map(index) of each index in [begin, end),
+ * chunks are reduced in any order, reduce should be associative and commutative
+ * @param[in] scheduler workers to run on, null means current scheduler, run serially if none
+ * @param[in] identity start value of each chunk, reduce(identity, x) should be x
+ * @param[in] map func called with index
+ * @param[in] reduce func combine two values
+ * @param[in] grain min indexes run in a row
+ */
+template <typename T, typename Map, typename Reduce>
+T parallel_reduce(Scheduler* scheduler, size_t begin, size_t end, T identity, Map map, Reduce reduce, size_t grain = 1) {
+    struct Shared {
+        Mutex mutex;
+        T result;
+    };
+    auto shared = std::make_shared<Shared>();
+    shared->result = identity;
+    detail::parallel_chunks(scheduler, begin, end, grain, [shared, identity, map, reduce](size_t first, size_t last) mutable {
+        T value = identity;
+        for (size_t index = first; index < last; index++)
+            value = reduce(std::move(value), map(index));
+        // merged before chunk is reported done, caller see it when it wake up
+        Mutex::Lock lock(shared->mutex);
+        shared->result = reduce(std::move(shared->result), std::move(value));
+    });
+    return std::move(shared->result);
+}
+
+/**
+ * @brief write op(*it) of each it in [first, last) to out, ranges are random access
+ * @param[in] scheduler workers to run on, null means current scheduler, run serially if none
+ * @return end of output range
+ */
+template <typename InputIt, typename OutputIt, typename Op>
+OutputIt parallel_transform(Scheduler* scheduler, InputIt first, InputIt last, OutputIt out, Op op, size_t grain = 1) {
+    size_t count = std::distance(first, last);
+    detail::parallel_chunks(scheduler, 0, count, grain, [first, out, op](size_t begin, size_t end) mutable {
+        std::transform(first + begin, first + end, out + begin, op);
+    });
+    return out + count;
+}
+
+namespace detail {
+
+/**
+ * @brief get count of a taken before merge of a and b output d elements,
+ * a go first on tie so merge is stable
+ */
+template <typename It, typename Compare>
+size_t merge_split(It a, size_t a_size, It b, size_t b_size, size_t d, Compare & comp) {
+    size_t low = d > b_size ? d - b_size : 0;
+    size_t high = std::min(d, a_size);
+    while (low < high) {
+        size_t i = low + (high - low) / 2;
+        // a[i] come before b[d - i - 1], more of a is taken
+        if (!comp(b[d - i - 1], a[i]))
+            low = i + 1;
+        else
+            high = i;
+    }
+    return low;
+}
+
+}
+
+/**
+ * @brief sort random access range, blocks are sorted in parallel then merged pairwise,
+ * each merge is split by merge path so all workers join every round. not stable
+ * @param[in] scheduler workers to run on, null means current scheduler, run serially if none
+ * @param[in] cutoff block size below which range is sorted serially
+ */
+template <typename It, typename Compare>
+void parallel_sort(Scheduler* scheduler, It first, It last, Compare comp, size_t cutoff = 4096) {
+    typedef typename std::iterator_traits<It>::value_type Value;
+    size_t count = std::distance(first, last);
+    if (scheduler == nullptr)
+        scheduler = Scheduler::get_thread_scheduler();
+    cutoff = std::max<size_t>(cutoff, 2);
+    size_t participants = detail::get_participant_count(scheduler, count, cutoff);
+    if (participants <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+    // power of 2 blocks so every round merge pairs, a few per participant for balance
+    size_t blocks = 1;
+    while (blocks < participants * 2 && count / (blocks * 2) >= cutoff)
+        blocks <<= 1;
+    auto block_begin = [count, blocks](size_t block) { return count * block / blocks; };
+    detail::parallel_chunks(scheduler, 0, blocks, 1, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++)
+            std::sort(first + block_begin(block), first + block_begin(block + 1), comp);
+    });
+    if (blocks == 1)
+        return;
+    // values are moved into buffer by chunk, buffer need no default constructor
+    std::allocator<Value> allocator;
+    Value* buffer = allocator.allocate(count);
+    detail::parallel_chunks(scheduler, 0, count, cutoff, [&](size_t begin, size_t end) {
+        std::uninitialized_move(first + begin, first + end, buffer + begin);
+    });
+    size_t parts = participants * 2;
+    bool in_buffer = true;
+    for (size_t width = 1; width < blocks; width <<= 1) {
+        size_t pairs = blocks / (width * 2);
+        size_t pair_parts = std::max<size_t>(1, parts / pairs);
+        auto merge = [&](auto src, auto dst) {
+            // parts move values out of src, so all splits are found before any part run
+            std::vector<size_t> splits(pairs * (pair_parts + 1));
+            for (size_t pair = 0; pair < pairs; pair++) {
+                size_t base = block_begin(pair * width * 2);
+                size_t middle = block_begin(pair * width * 2 + width);
+                size_t size = block_begin(pair * width * 2 + width * 2) - base;
+                for (size_t part = 0; part <= pair_parts; part++) {
+                    splits[pair * (pair_parts + 1) + part] = detail::merge_split(src + base, middle - base,
+                        src + middle, size - (middle - base), size * part / pair_parts, comp);
+                }
+            }
+            detail::parallel_chunks(scheduler, 0, pairs * pair_parts, 1, [&](size_t begin, size_t end) {
+                for (size_t task = begin; task < end; task++) {
+                    size_t pair = task / pair_parts;
+                    size_t part = task % pair_parts;
+                    size_t base = block_begin(pair * width * 2);
+                    size_t middle = block_begin(pair * width * 2 + width);
+                    size_t size = block_begin(pair * width * 2 + width * 2) - base;
+                    auto a = src + base;
+                    auto b = src + middle;
+                    size_t d_first = size * part / pair_parts;
+                    size_t d_last = size * (part + 1) / pair_parts;
+                    size_t i_first = splits[pair * (pair_parts + 1) + part];
+                    size_t i_last = splits[pair * (pair_parts + 1) + part + 1];
+                    std::merge(std::make_move_iterator(a + i_first), std::make_move_iterator(a + i_last),
+                        std::make_move_iterator(b + (d_first - i_first)), std::make_move_iterator(b + (d_last - i_last)),
+                        dst + base + d_first, comp);
+                }
+            });
+        };
+        if (in_buffer)
+            merge(buffer, first);
+        else
+            merge(first, buffer);
+        in_buffer = !in_buffer;
+    }
+    detail::parallel_chunks(scheduler, 0, count, cutoff, [&](size_t begin, size_t end) {
+        if (in_buffer)
+            std::move(buffer + begin, buffer + end, first + begin);
+        std::destroy(buffer + begin, buffer + end);
+    });
+    allocator.deallocate(buffer, count);
+}
+
+template <typename It>
+void parallel_sort(Scheduler* scheduler, It first, It last) {
+    parallel_sort(scheduler, first, last, std::less<typename std::iterator_traits<It>::value_type>());
+}
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "scheduler.h"
+#include "cpu_topology.h"
 #include "fiber.h"
 #include "log.h"
 #include "thread.h"
@@ -8,94 +9,1052 @@
 #include <cstddef>
 #include <functional>
 #include <algorithm>
+#include <chrono>
 #include <memory>
 #include <queue>
 #include <string>
 #include <unistd.h>
 #include <csignal>
+#include <sched.h>
 
 namespace aris {
 
-Scheduler::Scheduler(int thread_count, const std::string & name) {
+/// scheduler current worker belongs to
+static thread_local Scheduler* thread_scheduler_ = nullptr;
+/// term fibers waiting to be reset
+static thread_local std::vector<Fiber::ptr> thread_free_fibers_;
+/// worker index in scheduler
+static thread_local int thread_worker_index_ = -1;
+/// worker the running task is pinned to, -1 if not pinned
+static thread_local int thread_task_pin_ = -1;
+/// band of the running task
+static thread_local Scheduler::Priority thread_task_priority_ = Scheduler::Priority::NORMAL;
+static thread_local uint64_t thread_task_deadline_ = 0;
+
+/// local tasks taken before global queue must be checked, so global tasks dont starve
+static const uint32_t global_check_interval = 61;
+/// inject queue capacity, overflow goes to locked global queue
+static const size_t inject_queue_capacity = 4096;
+/// max tasks moved from inject queue to local queue at once
+static const size_t inject_batch_size = 32;
+/// high or deadline tasks taken in a row before one normal task get a turn
+static const uint32_t high_streak_limit = 32;
+/// tasks run by busy worker between flushes
+static const uint32_t flush_interval = 16;
+/// free queue nodes kept by each thread
+static const size_t task_node_cache_size = 512;
+/// free queue nodes shared by all threads of one scheduler
+static const size_t shared_node_pool_size = 1024;
+
+static uint64_t get_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief free queue nodes of one thread, node go back to thread which take it from queue,
+ * worker feeding its own queue reuse the same nodes without malloc.
+ * nodes over its size go to shared pool of scheduler, where outside pushers take them
+ */
+template <typename T>
+struct TaskNodeCache {
+    ~TaskNodeCache() {
+        for (T* node : nodes)
+            delete node;
+    }
+    std::vector<T*> nodes;
+};
+
+template <typename T>
+static TaskNodeCache<T>& get_task_node_cache() {
+    static thread_local TaskNodeCache<T> cache;
+    return cache;
+}
+
+Scheduler::Scheduler(int thread_count, const std::string & name, bool use_caller)
+    : inject_(inject_queue_capacity), free_nodes_(shared_node_pool_size) {
     // save name
     name_ = name;
-    // create thread
+    thread_count_ = thread_count;
+    active_count_ = thread_count;
+    use_caller_ = use_caller;
+    // create thread and its local queue
     for (int index = 0; index < thread_count; index++) {
+        workers_.emplace_back(new Worker());
+        workers_.back()->seed = index + 1;
+        // caller run worker 0 itself
+        if (use_caller && index == 0) {
+            threads_.emplace_back(nullptr);
+            continue;
+        }
         // append create thread
-        threads_.emplace_back(Thread::ptr(new Thread(std::bind(&Scheduler::run, this), 
+        threads_.emplace_back(Thread::ptr(new Thread(std::bind(&Scheduler::run, this, index), 
             "scheduler_thread+" + std::to_string(index))));
     }
 }
 
 Scheduler::~Scheduler() {
-    sleep(1000000);
+    // workers must exit before queues are freed
+    stop();
     threads_.clear();
-    std::queue<ScheduleTask::ptr> tmp;
+    std::deque<ScheduleTask> tmp;
     tasks_.swap(tmp);
-    stop_ = true;
+    ScheduleTask* task = nullptr;
+    while (inject_.pop(task))
+        delete task;
+    while (free_nodes_.pop(task))
+        delete task;
+    for (auto & worker : workers_)
+        worker->pinned.clear();
+    high_tasks_.clear();
+    low_tasks_.clear();
+    deadline_tasks_.clear();
+    for (auto & worker : workers_) {
+        while (worker->queue.pop(task))
+            delete task;
+    }
+}
+
+Scheduler* Scheduler::get_thread_scheduler() {
+    return thread_scheduler_;
+}
+
+int Scheduler::get_thread_worker_index() {
+    return thread_worker_index_;
+}
+
+int Scheduler::get_resume_thread(const Fiber::ptr & fiber) {
+    if (fiber->get_stack_mode() == Fiber::StackMode::SHARED)
+        return fiber->get_bound_thread() != -1 ? fiber->get_bound_thread() : thread_worker_index_;
+    // task scheduled to a worker keep running on it
+    return thread_task_pin_;
+}
+
+Scheduler::ResumeHint Scheduler::get_resume_hint(const Fiber::ptr & fiber) {
+    return ResumeHint{get_resume_thread(fiber), thread_task_priority_, thread_task_deadline_};
+}
+
+bool Scheduler::switch_to(Scheduler* scheduler, int thread) {
+    Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+    if (scheduler == nullptr || fiber == nullptr || fiber == Fiber::get_thread_main_fiber()) {
+        ARIS_LOG_FMT_WARN("switch scheduler failed, %s", "only fiber can switch scheduler");
+        return false;
+    }
+    if (scheduler == thread_scheduler_ && (thread == -1 || thread == thread_worker_index_))
+        return true;
+    if (fiber->get_stack_mode() == Fiber::StackMode::SHARED) {
+        ARIS_LOG_FMT_WARN("switch scheduler failed, fiber id: %lu, shared stack fiber cannot migrate", fiber->get_fiber_id());
+        return false;
+    }
+    // target worker wait until this fiber is switched out, fiber keep its band
+    ResumeHint hint = get_resume_hint(fiber);
+    hint.thread = thread;
+    scheduler->schedule(fiber, hint);
+    fiber->hold();
+    return true;
 }
 
 // schedule
-void Scheduler::schedule(std::function<void ()> cb) {
-    // push task
-    tasks_.push(ScheduleTask::ptr(new ScheduleTask(cb)));
+void Scheduler::schedule(std::function<void ()> cb, int thread) {
+    push_task(ScheduleTask(std::move(cb), thread));
+}
+
+void Scheduler::schedule(Fiber::ptr fiber, int thread) {
+    push_task(ScheduleTask(std::move(fiber), thread));
+}
+
+void Scheduler::schedule(void (*func)(void*), void* arg, int thread) {
+    push_task(ScheduleTask(func, arg, thread));
+}
+
+void Scheduler::schedule(std::function<void()> cb, Priority priority, int thread) {
+    ScheduleTask task(std::move(cb), thread);
+    task.priority = priority;
+    push_task(std::move(task));
+}
+
+void Scheduler::schedule(Fiber::ptr fiber, Priority priority, int thread) {
+    ScheduleTask task(std::move(fiber), thread);
+    task.priority = priority;
+    push_task(std::move(task));
+}
+
+void Scheduler::schedule(Fiber::ptr fiber, const ResumeHint & hint) {
+    ScheduleTask task(std::move(fiber), hint.thread);
+    task.priority = hint.priority;
+    task.deadline = hint.deadline;
+    push_task(std::move(task));
+}
+
+void Scheduler::schedule_deadline(std::function<void()> cb, std::chrono::steady_clock::time_point deadline, int thread) {
+    ScheduleTask task(std::move(cb), thread);
+    // 0 means no deadline
+    task.deadline = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        deadline.time_since_epoch()).count(), 1);
+    push_task(std::move(task));
+}
+
+Scheduler::ScheduleTask* Scheduler::new_task_node(ScheduleTask && task) {
+    TaskNodeCache<ScheduleTask>& cache = get_task_node_cache<ScheduleTask>();
+    ScheduleTask* node = nullptr;
+    if (!cache.nodes.empty()) {
+        node = cache.nodes.back();
+        cache.nodes.pop_back();
+    } else if (!free_nodes_.pop(node)) {
+        // thread out of scheduler never get node back to its cache, it live on shared pool
+        return new ScheduleTask(std::move(task));
+    }
+    *node = std::move(task);
+    return node;
+}
+
+void Scheduler::take_task_node(ScheduleTask* node, ScheduleTask & task) {
+    TaskNodeCache<ScheduleTask>& cache = get_task_node_cache<ScheduleTask>();
+    task = std::move(*node);
+    node->reset();
+    if (cache.nodes.size() < task_node_cache_size)
+        cache.nodes.push_back(node);
+    else if (!free_nodes_.push(node))
+        delete node;
+}
+
+void Scheduler::push_task(ScheduleTask && task, bool local) {
+    // stopped scheduler take no new work from outside, woken fibers still run
+    if (!task.fiber && thread_scheduler_ != this && stop_.load(std::memory_order_relaxed)) {
+        ARIS_LOG_FMT_WARN("schedule task after stop, task rejected, scheduler name: %s", name_.c_str());
+        return;
+    }
+    // shared fiber only run on worker owning its stack, never enter stealable queues
+    if (task.fiber && task.fiber->get_stack_mode() == Fiber::StackMode::SHARED && task.fiber->is_stack_bound()) {
+        if (task.fiber->get_bound_thread() == -1) {
+            ARIS_LOG_FMT_ERROR("shared fiber bound to thread out of scheduler, task rejected, fiber id: %lu, scheduler name: %s",
+                task.fiber->get_fiber_id(), name_.c_str());
+            return;
+        }
+        task.thread = task.fiber->get_bound_thread();
+    }
+    task.push_time = get_now_ns();
+    int band = task.band();
+    // own worker push to local queue without lock
+    if (local && task.thread == -1 && band == static_cast<int>(Priority::NORMAL) && thread_scheduler_ == this) {
+        workers_[thread_worker_index_]->queue.push(new_task_node(std::move(task)));
+        tickle();
+        return;
+    }
+    task.thread = check_worker(task.thread);
+    if (task.thread != -1) {
+        // pinned task go to mailbox of its worker
+        int thread = task.thread;
+        Worker& worker = *workers_[thread];
+        Mutex::Lock lock(worker.mutex);
+        if (worker.running.load(std::memory_order_relaxed)) {
+            worker.pinned.emplace_back(std::move(task));
+            worker.pinned_count.fetch_add(1, std::memory_order_relaxed);
+            lock.unlock();
+            tickle_worker(thread);
+            return;
+        }
+        // retired worker take no task, run it on any worker
+        lock.unlock();
+        task.thread = -1;
+    }
+    if (band != static_cast<int>(Priority::NORMAL)) {
+        {
+            Mutex::Lock lock(band_mutex_);
+            if (band == deadline_band) {
+                uint64_t deadline = task.deadline;
+                deadline_tasks_.emplace(deadline, std::move(task));
+            } else if (band == static_cast<int>(Priority::HIGH)) {
+                high_tasks_.emplace_back(std::move(task));
+            } else {
+                low_tasks_.emplace_back(std::move(task));
+            }
+            band_task_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        tickle();
+        return;
+    }
+    {
+        ScheduleTask* item = new_task_node(std::move(task));
+        if (inject_.push(item)) {
+            tickle();
+            return;
+        }
+        // inject queue is full
+        take_task_node(item, task);
+    }
+    {
+        Mutex::Lock lock(mutex_);
+        tasks_.emplace_back(std::move(task));
+        global_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    tickle();
+}
+
+void Scheduler::push_tasks(std::vector<ScheduleTask> & tasks, int thread) {
+    size_t count = tasks.size();
+    if (count == 0)
+        return;
+    if (thread_scheduler_ != this && stop_.load(std::memory_order_relaxed)) {
+        ARIS_LOG_FMT_WARN("schedule %zu tasks after stop, tasks rejected, scheduler name: %s", count, name_.c_str());
+        return;
+    }
+    uint64_t now = get_now_ns();
+    for (auto & task : tasks)
+        task.push_time = now;
+    thread = check_worker(thread);
+    if (thread != -1) {
+        Worker& worker = *workers_[thread];
+        Mutex::Lock lock(worker.mutex);
+        if (worker.running.load(std::memory_order_relaxed)) {
+            for (auto & task : tasks)
+                worker.pinned.emplace_back(std::move(task));
+            worker.pinned_count.fetch_add(count, std::memory_order_relaxed);
+            lock.unlock();
+            tickle_worker(thread);
+            return;
+        }
+        // retired worker take no task, run them on any worker
+        lock.unlock();
+        for (auto & task : tasks)
+            task.thread = -1;
+        thread = -1;
+    }
+    if (thread_scheduler_ == this) {
+        // own worker run one of them, others are stolen by woken workers
+        WorkStealQueue<ScheduleTask*>& queue = workers_[thread_worker_index_]->queue;
+        for (auto & task : tasks)
+            queue.push(new_task_node(std::move(task)));
+        tickle(count - 1);
+        return;
+    }
+    {
+        Mutex::Lock lock(mutex_);
+        for (auto & task : tasks)
+            tasks_.emplace_back(std::move(task));
+        global_count_.fetch_add(count, std::memory_order_relaxed);
+    }
+    tickle(count);
+}
+
+int Scheduler::check_worker(int thread) {
+    if (thread >= -1 && thread < thread_count_)
+        return thread;
+    ARIS_LOG_FMT_WARN("schedule task to invalid worker %d, scheduler name: %s, run on any worker",
+        thread, name_.c_str());
+    return -1;
+}
+
+void Scheduler::tickle(size_t count) {
+    // task must be visible before idle count is read, idle worker do the opposite
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (count == 0 || idle_count_.load(std::memory_order_relaxed) == 0)
+        return;
+    // spinning worker will take it, and wake next one if it was the last spinner
+    if (count == 1 && spinning_count_.load(std::memory_order_relaxed) > 0)
+        return;
+    std::vector<int> woken;
+    {
+        Mutex::Lock lock(sleep_mutex_);
+        while (count-- > 0 && !sleepers_.empty()) {
+            woken.push_back(sleepers_.back());
+            sleepers_.pop_back();
+        }
+        idle_count_.store(sleepers_.size(), std::memory_order_relaxed);
+    }
+    for (int index : woken)
+        unpark(index);
+}
+
+void Scheduler::tickle_worker(int index) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_count_.load(std::memory_order_relaxed) == 0)
+        return;
+    if (remove_sleeper(index))
+        unpark(index);
+}
+
+bool Scheduler::remove_sleeper(int index) {
+    Mutex::Lock lock(sleep_mutex_);
+    auto it = std::find(sleepers_.begin(), sleepers_.end(), index);
+    if (it == sleepers_.end())
+        return false;
+    sleepers_.erase(it);
+    idle_count_.store(sleepers_.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool Scheduler::take_task(ScheduleTask & task) {
+    Worker& worker = *workers_[thread_worker_index_];
+    bool found = take_pinned_task(task) || take_band_task(task, false);
+    if (!found && ++worker.tick % global_check_interval == 0)
+        found = take_global_task(task);
+    ScheduleTask* local = nullptr;
+    if (!found && worker.queue.pop(local)) {
+        take_task_node(local, task);
+        found = true;
+    }
+    // low band run when normal queues are empty
+    found = found || take_global_task(task) || steal_task(task) || take_band_task(task, true);
+    if (found)
+        record_wait(task);
+    return found;
+}
+
+bool Scheduler::take_pinned_task(ScheduleTask & task) {
+    Worker& worker = *workers_[thread_worker_index_];
+    if (worker.pinned_count.load(std::memory_order_relaxed) == 0)
+        return false;
+    Mutex::Lock lock(worker.mutex);
+    if (worker.pinned.empty())
+        return false;
+    task = std::move(worker.pinned.front());
+    worker.pinned.pop_front();
+    worker.pinned_count.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool Scheduler::take_band_task(ScheduleTask & task, bool starving) {
+    if (band_task_count_.load(std::memory_order_relaxed) == 0)
+        return false;
+    Worker& worker = *workers_[thread_worker_index_];
+    Mutex::Lock lock(band_mutex_);
+    // aged low task run before all others, so flood of urgent work cannot starve it
+    if (!low_tasks_.empty() && (starving || get_now_ns() - low_tasks_.front().push_time > aging_ns_)) {
+        task = std::move(low_tasks_.front());
+        low_tasks_.pop_front();
+    } else if (high_tasks_.empty() && deadline_tasks_.empty()) {
+        return false;
+    } else if (!starving && worker.high_streak >= high_streak_limit) {
+        // normal task get a turn
+        worker.high_streak = 0;
+        return false;
+    } else {
+        if (!high_tasks_.empty()) {
+            task = std::move(high_tasks_.front());
+            high_tasks_.pop_front();
+        } else {
+            auto it = deadline_tasks_.begin();
+            task = std::move(it->second);
+            deadline_tasks_.erase(it);
+        }
+        worker.high_streak = starving ? 0 : worker.high_streak + 1;
+    }
+    band_task_count_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Scheduler::record_wait(const ScheduleTask & task) {
+    if (task.push_time == 0)
+        return;
+    uint64_t wait = get_now_ns() - task.push_time;
+    // only owner write its counters, plain load and store is enough
+    BandCounter& counter = workers_[thread_worker_index_]->counters[task.band()];
+    counter.count.store(counter.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    counter.wait_total_ns.store(counter.wait_total_ns.load(std::memory_order_relaxed) + wait, std::memory_order_relaxed);
+    if (wait > counter.wait_max_ns.load(std::memory_order_relaxed))
+        counter.wait_max_ns.store(wait, std::memory_order_relaxed);
+#ifndef ARIS_DISABLE_STATS
+    workers_[thread_worker_index_]->wait_hist.record(wait);
+#endif
+    if (spawn_wait_ns_ != 0 && wait > spawn_wait_ns_)
+        grow_on_wait(wait);
+}
+
+std::vector<Scheduler::BandStats> Scheduler::get_band_stats() {
+    static const char* names[band_count] = {"high", "normal", "low", "deadline"};
+    std::vector<BandStats> stats(band_count);
+    for (int band = 0; band < band_count; band++)
+        stats[band].name = names[band];
+    {
+        Mutex::Lock lock(band_mutex_);
+        stats[static_cast<int>(Priority::HIGH)].depth = high_tasks_.size();
+        stats[static_cast<int>(Priority::LOW)].depth = low_tasks_.size();
+        stats[deadline_band].depth = deadline_tasks_.size();
+    }
+    // pinned tasks are counted as normal whatever their band is
+    BandStats& normal = stats[static_cast<int>(Priority::NORMAL)];
+    normal.depth = inject_.size() + global_count_.load(std::memory_order_relaxed);
+    for (auto & worker : workers_) {
+        normal.depth += worker->queue.size() + worker->pinned_count.load(std::memory_order_relaxed);
+        for (int band = 0; band < band_count; band++) {
+            BandCounter& counter = worker->counters[band];
+            stats[band].count += counter.count.load(std::memory_order_relaxed);
+            stats[band].wait_total_us += counter.wait_total_ns.load(std::memory_order_relaxed) / 1000;
+            stats[band].wait_max_us = std::max<uint64_t>(stats[band].wait_max_us,
+                counter.wait_max_ns.load(std::memory_order_relaxed) / 1000);
+        }
+    }
+    return stats;
+}
+
+Scheduler::Stats Scheduler::get_stats() {
+    Stats stats;
+    {
+        Mutex::Lock lock(band_mutex_);
+        stats.depth = high_tasks_.size() + low_tasks_.size() + deadline_tasks_.size();
+    }
+    stats.depth += inject_.size() + global_count_.load(std::memory_order_relaxed);
+    stats.workers.resize(workers_.size());
+    for (size_t index = 0; index < workers_.size(); index++) {
+        Worker& worker = *workers_[index];
+        WorkerStats& item = stats.workers[index];
+        item.index = index;
+        item.active = worker.running.load(std::memory_order_relaxed) && !worker.retiring.load(std::memory_order_relaxed);
+        item.depth = worker.queue.size() + worker.pinned_count.load(std::memory_order_relaxed);
+#ifndef ARIS_DISABLE_STATS
+        item.wait = worker.wait_hist.snapshot();
+        item.run = worker.run_hist.snapshot();
+        item.idle = worker.idle_hist.snapshot();
+        item.tasks = item.run.count;
+        item.stolen = worker.stolen_count.load(std::memory_order_relaxed);
+        item.busy_ns = item.run.sum;
+        item.idle_ns = item.idle.sum;
+        if (item.busy_ns + item.idle_ns > 0)
+            item.utilization = static_cast<double>(item.busy_ns) / (item.busy_ns + item.idle_ns);
+#endif
+        WorkerStats& total = stats.total;
+        total.depth += item.depth;
+        total.tasks += item.tasks;
+        total.stolen += item.stolen;
+        total.busy_ns += item.busy_ns;
+        total.idle_ns += item.idle_ns;
+        total.wait.merge(item.wait);
+        total.run.merge(item.run);
+        total.idle.merge(item.idle);
+    }
+    if (stats.total.busy_ns + stats.total.idle_ns > 0)
+        stats.total.utilization = static_cast<double>(stats.total.busy_ns) / (stats.total.busy_ns + stats.total.idle_ns);
+    return stats;
+}
+
+bool Scheduler::take_global_task(ScheduleTask & task) {
+    ScheduleTask* item = nullptr;
+    if (inject_.pop(item)) {
+        take_task_node(item, task);
+        // take fair share of the rest, so other workers dont come back to inject queue at once
+        Worker& worker = *workers_[thread_worker_index_];
+        size_t batch = std::min(inject_.size() / std::max(get_active_count(), 1) + 1, inject_batch_size);
+        for (size_t n = 1; n < batch && inject_.pop(item); n++)
+            worker.queue.push(item);
+        // let idle worker steal part of the batch
+        if (batch > 1)
+            tickle();
+        return true;
+    }
+    if (global_count_.load(std::memory_order_relaxed) == 0)
+        return false;
+    Mutex::Lock lock(mutex_);
+    if (tasks_.empty())
+        return false;
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+    // batch pushed from outside is spread the same way
+    Worker& worker = *workers_[thread_worker_index_];
+    size_t batch = std::min(tasks_.size() / std::max(get_active_count(), 1) + 1, inject_batch_size);
+    for (size_t n = 1; n < batch && !tasks_.empty(); n++) {
+        worker.queue.push(new_task_node(std::move(tasks_.front())));
+        tasks_.pop_front();
+    }
+    global_count_.store(tasks_.size(), std::memory_order_relaxed);
+    lock.unlock();
+    if (batch > 1)
+        tickle();
+    return true;
+}
+
+bool Scheduler::steal_task(ScheduleTask & task) {
+    size_t count = workers_.size();
+    if (count < 2)
+        return false;
+    // start from random victim, so thieves dont crowd on the same queue
+    Worker& worker = *workers_[thread_worker_index_];
+    worker.seed ^= worker.seed << 13;
+    worker.seed ^= worker.seed >> 17;
+    worker.seed ^= worker.seed << 5;
+    size_t start = worker.seed % count;
+    // same node pass first, stealing across node pull cold cache lines
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t n = 0; n < count; n++) {
+            size_t index = (start + n) % count;
+            Worker& victim = *workers_[index];
+            if (static_cast<int>(index) == thread_worker_index_ || (victim.node == worker.node) != (pass == 0)
+                || !victim.running.load(std::memory_order_relaxed))
+                continue;
+            ScheduleTask* stolen = nullptr;
+            if (victim.queue.steal(stolen)) {
+                take_task_node(stolen, task);
+#ifndef ARIS_DISABLE_STATS
+                worker.stolen_count.store(worker.stolen_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#endif
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool Scheduler::has_task() {
+    if (!inject_.empty() || global_count_.load(std::memory_order_relaxed) > 0
+        || band_task_count_.load(std::memory_order_relaxed) > 0)
+        return true;
+    if (workers_[thread_worker_index_]->pinned_count.load(std::memory_order_relaxed) > 0)
+        return true;
+    for (auto & worker : workers_) {
+        if (!worker->queue.empty())
+            return true;
+    }
+    return false;
 }
 
 // 
+void Scheduler::set_affinity(Affinity affinity) {
+    affinity_ = affinity;
+}
+
+void Scheduler::set_worker_cpus(int index, const std::vector<int> & cpus) {
+    if (index < 0 || index >= thread_count_) {
+        ARIS_LOG_FMT_WARN("set worker cpus failed, invalid worker %d, scheduler name: %s", index, name_.c_str());
+        return;
+    }
+    Worker& worker = *workers_[index];
+    worker.cpus = cpus;
+    worker.cpus_set = true;
+    worker.node = cpus.empty() ? 0 : std::max(CpuTopology::get_cpu_node(cpus.front()), 0);
+}
+
+int Scheduler::get_worker_node(int index) const {
+    if (index < 0 || index >= thread_count_)
+        return -1;
+    return workers_[index]->node;
+}
+
 void Scheduler::start() {
     stop_ = false;
-    // start to run all thread
-    for_each(threads_.cbegin(), threads_.cend(), [](Thread::ptr thread) {
-        thread->run();
-    });
-    // this thread should also added to fiber
-    // run();
+    started_ = true;
+    // split workers into contiguous groups, one group per node
+    int node_count = CpuTopology::get_node_count();
+    for (int index = 0; index < thread_count_; index++) {
+        Worker& worker = *workers_[index];
+        if (!worker.cpus_set && affinity_ != Affinity::NONE) {
+            int node = index * node_count / thread_count_;
+            // first worker of node
+            int first = (node * thread_count_ + node_count - 1) / node_count;
+            const std::vector<int> & cpus = CpuTopology::get_node_cpus(node);
+            worker.node = node;
+            if (affinity_ == Affinity::CPU)
+                worker.cpus = {cpus[(index - first) % cpus.size()]};
+            else
+                worker.cpus = cpus;
+        }
+        if (threads_[index])
+            threads_[index]->set_affinity(worker.cpus);
+    }
+    // start to run all thread, free slots of elastic pool start when load grow
+    for (int index = 0; index < thread_count_; index++) {
+        if (threads_[index] && workers_[index]->running.load(std::memory_order_relaxed))
+            threads_[index]->run();
+    }
+    if (use_caller_) {
+        // caller is worker 0 now, what it schedule go to its local queue
+        caller_thread_ = pthread_self();
+        Thread::set_current_affinity(workers_[0]->cpus);
+        thread_scheduler_ = this;
+        thread_worker_index_ = 0;
+    }
 }
 
-void Scheduler::run() {
+bool Scheduler::stop(StopPolicy policy, uint64_t timeout_ms) {
+    if (policy == StopPolicy::CANCEL)
+        cancel_ = true;
+    else if (timeout_ms != ~0ull)
+        stop_deadline_ = get_now_ns() + timeout_ms * 1000000;
+    bool stopped = false;
+    {
+        // no worker is spawned or retired after this
+        Mutex::Lock lock(resize_mutex_);
+        stopped = stop_.exchange(true);
+    }
+    if (stopped)
+        return cancelled_count_.load(std::memory_order_relaxed) == 0;
+    // parked workers see stop and exit once queues are drained
+    tickle(thread_count_);
+    if (use_caller_ && started_) {
+        if (pthread_equal(caller_thread_, pthread_self()))
+            run(0);
+        else
+            ARIS_LOG_FMT_ERROR("stop should be called by thread which start scheduler, scheduler name: %s", name_.c_str());
+    }
+    for (auto & thread : threads_) {
+        if (thread)
+            thread->join();
+    }
+    uint64_t cancelled = cancelled_count_.load(std::memory_order_relaxed);
+    if (cancelled != 0)
+        ARIS_LOG_FMT_WARN("%lu tasks cancelled by stop, scheduler name: %s", cancelled, name_.c_str());
+    return cancelled == 0;
+}
+
+void Scheduler::check_stop_deadline() {
+    uint64_t deadline = stop_deadline_.load(std::memory_order_relaxed);
+    if (deadline == ~0ull || cancel_.load(std::memory_order_relaxed) || get_now_ns() < deadline)
+        return;
+    if (!cancel_.exchange(true))
+        tickle(thread_count_);
+}
+
+bool Scheduler::set_elastic_policy(const ElasticPolicy & policy) {
+    Mutex::Lock lock(resize_mutex_);
+    if (started_) {
+        ARIS_LOG_FMT_WARN("set elastic policy after start, scheduler name: %s", name_.c_str());
+        return false;
+    }
+    int active = active_count_.load(std::memory_order_relaxed);
+    if (policy.min_threads < 1 || policy.min_threads > active || policy.max_threads < thread_count_) {
+        ARIS_LOG_FMT_WARN("invalid elastic bounds [%d, %d], worker count: %d, scheduler name: %s",
+            policy.min_threads, policy.max_threads, active, name_.c_str());
+        return false;
+    }
+    // slots of all max workers exist from now on, they are started when needed
+    for (int index = thread_count_; index < policy.max_threads; index++) {
+        workers_.emplace_back(new Worker());
+        workers_.back()->seed = index + 1;
+        workers_.back()->running = false;
+        threads_.emplace_back(Thread::ptr(new Thread(std::bind(&Scheduler::run, this, index),
+            "scheduler_thread+" + std::to_string(index))));
+    }
+    thread_count_ = policy.max_threads;
+    min_threads_ = policy.min_threads;
+    spawn_wait_ns_ = policy.spawn_wait_us * 1000;
+    retire_idle_ns_ = policy.retire_idle_ms * 1000000;
+    return true;
+}
+
+bool Scheduler::resize(int count) {
+    if (count < min_threads_ || count > thread_count_) {
+        ARIS_LOG_FMT_WARN("resize to %d out of bounds [%d, %d], scheduler name: %s",
+            count, min_threads_, thread_count_, name_.c_str());
+        return false;
+    }
+    Mutex::Lock lock(resize_mutex_);
+    if (stop_.load(std::memory_order_relaxed))
+        return false;
+    while (active_count_.load(std::memory_order_relaxed) < count && add_worker()) {
+    }
+    // highest workers retire first, caller worker never retire
+    for (int index = thread_count_ - 1; index >= 0 && active_count_.load(std::memory_order_relaxed) > count; index--) {
+        Worker& worker = *workers_[index];
+        if ((use_caller_ && index == 0) || !worker.running.load(std::memory_order_relaxed)
+            || worker.retiring.load(std::memory_order_relaxed) || worker.bound_count.load(std::memory_order_relaxed) > 0)
+            continue;
+        worker.retiring = true;
+        active_count_.fetch_sub(1, std::memory_order_relaxed);
+        // parked worker see it at once, busy worker after its task
+        tickle_worker(index);
+    }
+    return true;
+}
+
+bool Scheduler::add_worker() {
+    // worker not gone yet is cheaper to keep than a new thread
+    for (int index = 0; index < thread_count_; index++) {
+        Worker& worker = *workers_[index];
+        if (worker.running.load(std::memory_order_relaxed) && worker.retiring.load(std::memory_order_relaxed)) {
+            worker.retiring = false;
+            active_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (int index = 0; index < thread_count_; index++) {
+        Worker& worker = *workers_[index];
+        if (worker.running.load(std::memory_order_relaxed))
+            continue;
+        // last thread of slot has left run loop, wait for it to exit
+        threads_[index]->join();
+        worker.retiring = false;
+        {
+            Mutex::Lock lock(worker.mutex);
+            worker.running = true;
+        }
+        active_count_.fetch_add(1, std::memory_order_relaxed);
+        // cpus of slot are set at start, new thread is bound the same
+        if (started_)
+            threads_[index]->run();
+        return true;
+    }
+    return false;
+}
+
+void Scheduler::grow_on_wait(uint64_t wait) {
+    if (active_count_.load(std::memory_order_relaxed) >= thread_count_)
+        return;
+    // new worker get one period to take load before next one is spawned
+    uint64_t now = get_now_ns();
+    uint64_t last = last_spawn_ns_.load(std::memory_order_relaxed);
+    if (now - last < spawn_wait_ns_ || !last_spawn_ns_.compare_exchange_strong(last, now, std::memory_order_relaxed))
+        return;
+    Mutex::Lock lock(resize_mutex_);
+    if (stop_.load(std::memory_order_relaxed) || !add_worker())
+        return;
+    ARIS_LOG_FMT_INFO("task waited %lu us, worker count grow to %d, scheduler name: %s",
+        wait / 1000, active_count_.load(std::memory_order_relaxed), name_.c_str());
+}
+
+bool Scheduler::try_retire(int index) {
+    Mutex::Lock lock(resize_mutex_);
+    Worker& worker = *workers_[index];
+    if (stop_.load(std::memory_order_relaxed) || (use_caller_ && index == 0) || worker.retiring.load(std::memory_order_relaxed)
+        || active_count_.load(std::memory_order_relaxed) <= min_threads_ || worker.bound_count.load(std::memory_order_relaxed) > 0)
+        return false;
+    worker.retiring = true;
+    active_count_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool Scheduler::retire_worker(int index) {
+    Worker& worker = *workers_[index];
+    Mutex::Lock lock(resize_mutex_);
+    if (!worker.retiring.load(std::memory_order_relaxed))
+        return false;
+    // stop drain queues with all workers, pool size no longer matter,
+    // shared fibers bound here would lose the only thread they can run on
+    if (stop_.load(std::memory_order_relaxed) || worker.bound_count.load(std::memory_order_relaxed) > 0) {
+        worker.retiring = false;
+        active_count_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::deque<ScheduleTask> tasks;
+    {
+        // pusher check running under this lock, nothing is pinned to this worker after it
+        Mutex::Lock worker_lock(worker.mutex);
+        worker.running = false;
+        for (auto & task : worker.pinned) {
+            task.thread = -1;
+            tasks.emplace_back(std::move(task));
+        }
+        worker.pinned.clear();
+        worker.pinned_count.store(0, std::memory_order_relaxed);
+    }
+    ScheduleTask* item = nullptr;
+    while (worker.queue.pop(item)) {
+        tasks.emplace_back(std::move(*item));
+        delete item;
+    }
+    size_t count = tasks.size();
+    if (count > 0) {
+        {
+            Mutex::Lock global_lock(mutex_);
+            for (auto & task : tasks)
+                tasks_.emplace_back(std::move(task));
+            global_count_.fetch_add(count, std::memory_order_relaxed);
+        }
+        tickle(count);
+    }
+    ARIS_LOG_FMT_INFO("worker %d retired, %zu tasks handed over, scheduler name: %s", index, count, name_.c_str());
+    return true;
+}
+
+void Scheduler::run(int index) {
     Fiber::create_main_fiber();
-    if (idle_fiber_ == nullptr)
-        idle_fiber_ = Fiber::ptr(new Fiber(std::bind(&Scheduler::idle, this)));
-    ScheduleTask::ptr task;
+    thread_scheduler_ = this;
+    thread_worker_index_ = index;
+    // term fibers are kept here and reset with next func
+    thread_free_fibers_.reserve(fiber_cache_size_);
+    // each worker has its own idle fiber
+    Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+    Worker& worker = *workers_[index];
+    on_worker_start(index);
+    ScheduleTask task;
+    uint32_t flush_tick = 0;
     while (true) {
-        // if tasks is now empty, should idle here
-        {
-            CondType::Wait cond(cond_);
-            if (tasks_.empty()) {
-                if (stop_) {
-                    ARIS_LOG_FMT_INFO("schedule stop, should end, scheduler name: %s", name_.c_str());
-                    return;
-                }
-                idle_fiber_->resume();
-                continue;
-            }
-            task = tasks_.front();
-            tasks_.pop();
+        task.reset();
+        if (worker.retiring.load(std::memory_order_relaxed)) {
+            // submit deferred work, what it wake up is handed over with queued tasks
+            on_worker_flush(index);
+            if (retire_worker(index))
+                break;
         }
-        std::weak_ptr<ScheduleTask> weak(task);
-        if (weak.expired()) {
-            ARIS_LOG_FMT_INFO("fiber has already expired, %s", "inspire");
+        if (stop_.load(std::memory_order_relaxed))
+            check_stop_deadline();
+        bool taken = take_task(task);
+        if (!taken) {
+            // deferred work may wake up tasks before worker go idle
+            flush_tick = 0;
+            if (on_worker_flush(index))
+                taken = take_task(task);
+        } else if (++flush_tick == flush_interval) {
+            flush_tick = 0;
+            on_worker_flush(index);
+        }
+        if (!taken && stopping()) {
+            ARIS_LOG_FMT_INFO("schedule stop, should end, scheduler name: %s", name_.c_str());
+            break;
+        }
+        // cancelled funcs are dropped, fibers already started still run
+        if (taken && !task.fiber && cancel_.load(std::memory_order_relaxed)) {
+            cancelled_count_.fetch_add(1, std::memory_order_relaxed);
             continue;
         }
-        std::weak_ptr<Fiber> fiber(task->fiber);
-        if (fiber.expired()) {
-            ARIS_LOG_FMT_INFO("fiber has already expired, %s", "inspire");
+        // if tasks is now empty, should idle here
+        if (task.empty()) {
+#ifndef ARIS_DISABLE_STATS
+            uint64_t idle_start = get_now_ns();
+            Fiber::State idle_state = idle_fiber->resume();
+            worker.idle_hist.record(get_now_ns() - idle_start);
+#else
+            Fiber::State idle_state = idle_fiber->resume();
+#endif
+            // idle end once it see stopping, draining task may add pending work after that,
+            // run loop decide to leave, so idle is ready to be resumed again
+            if (idle_state == Fiber::State::TERM)
+                idle_fiber->reset(std::bind(&Scheduler::idle, this));
             continue;
         }
-        // check if task is in ready state
-        ARIS_ASSERT(task->fiber->get_fiber_state() == Fiber::State::Ready);
-        // run task
-        // task->run();
+#ifndef ARIS_DISABLE_STATS
+        uint64_t run_start = get_now_ns();
+        run_task(task);
+        worker.run_hist.record(get_now_ns() - run_start);
+#else
+        run_task(task);
+#endif
     }
+    on_worker_exit(index);
+    thread_free_fibers_.clear();
+    thread_scheduler_ = nullptr;
+    thread_worker_index_ = -1;
+}
+
+void Scheduler::run_task(ScheduleTask & task) {
+    // raw func run on worker main fiber directly
+    if (task.func) {
+        task.func(task.arg);
+        return;
+    }
+    Fiber::ptr fiber;
+    if (task.cb) {
+        // reuse term fiber, only create new fiber when cache is empty
+        if (!thread_free_fibers_.empty()) {
+            fiber = std::move(thread_free_fibers_.back());
+            thread_free_fibers_.pop_back();
+            fiber->reset(std::move(task.cb));
+        } else {
+            fiber = Fiber::ptr(new Fiber(std::move(task.cb)));
+        }
+    } else {
+        fiber.swap(task.fiber);
+    }
+    // shared fiber take stack of this worker on first resume, it stay here until term
+    bool shared = fiber->get_stack_mode() == Fiber::StackMode::SHARED;
+    if (shared && !fiber->is_stack_bound()) {
+        fiber->set_bound_thread(thread_worker_index_);
+        workers_[thread_worker_index_]->bound_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    thread_task_pin_ = task.thread;
+    thread_task_priority_ = task.priority;
+    thread_task_deadline_ = task.deadline;
+    // woken fiber may still be switching out on other worker, resume wait for it,
+    // state is taken when fiber switch out, hold fiber may already run on other worker
+    switch (fiber->resume()) {
+    case Fiber::State::TERM:
+        if (shared && fiber->get_bound_thread() == thread_worker_index_)
+            workers_[thread_worker_index_]->bound_count.fetch_sub(1, std::memory_order_relaxed);
+        // give fiber back to cache, only private default stack fiber fit any func
+        if (thread_free_fibers_.size() < fiber_cache_size_
+            && fiber->get_stack_mode() == Fiber::StackMode::PRIVATE && !fiber->is_stack_fixed())
+            thread_free_fibers_.emplace_back(std::move(fiber));
+        break;
+    case Fiber::State::Ready:
+        // fiber yield, should be scheduled again, put it in global queue behind others,
+        // shared stack belong to this thread, keep shared fiber on this worker
+        {
+            int thread = get_resume_thread(fiber);
+            ScheduleTask ready(std::move(fiber), thread);
+            ready.priority = task.priority;
+            ready.deadline = task.deadline;
+            push_task(std::move(ready), false);
+        }
+        break;
+    default:
+        // hold fiber will be scheduled by whom wake it up
+        break;
+    }
+    thread_task_pin_ = -1;
+    thread_task_priority_ = Priority::NORMAL;
+    thread_task_deadline_ = 0;
 }
 
 void Scheduler::idle() {
-    if (stop_) 
+    int index = thread_worker_index_;
+    Worker& worker = *workers_[index];
+    while (!stopping()) {
+        // retiring worker go back to leave run loop instead of parking
+        if (!worker.retiring.load(std::memory_order_relaxed) && !idle_spin()) {
+            {
+                Mutex::Lock lock(sleep_mutex_);
+                sleepers_.push_back(index);
+                idle_count_.store(sleepers_.size(), std::memory_order_relaxed);
+            }
+            // idle count must be visible before queues are checked, pusher do the opposite
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // tickle which already took this worker from list will unpark it soon
+            if (!(has_task() || stopping() || worker.retiring.load(std::memory_order_relaxed)) || !remove_sleeper(index)) {
+                uint64_t park_start = get_now_ns();
+                park(index);
+                // still in sleeper list after retire period, nobody woke it up
+                if (retire_idle_ns_ != 0 && get_now_ns() - park_start >= retire_idle_ns_ && remove_sleeper(index))
+                    try_retire(index);
+            }
+        }
+        // back to scheduler to pick up task
+        Fiber::get_thread_current_fiber()->yield();
+    }
+}
+
+void Scheduler::park(int index) {
+    // worker that may retire wake up after retire period to check it
+    if (retire_idle_ns_ != 0 && active_count_.load(std::memory_order_relaxed) > min_threads_) {
+        workers_[index]->parker.park_for(retire_idle_ns_);
         return;
-    // ARIS_LOG_FMT_INFO("begin to idle, %s", "sleeping");
-    // it
-    CondType::Wait cond(cond_);
-    cond.wait();
+    }
+    workers_[index]->parker.park();
+}
+
+void Scheduler::unpark(int index) {
+    workers_[index]->parker.unpark();
+}
+
+bool Scheduler::stopping() {
+    return stop_;
+}
+
+bool Scheduler::idle_spin() {
+    IdlePolicy policy = idle_policy_;
+    if (policy.spin_us == 0 && policy.yield_us == 0)
+        return false;
+    // at most half of workers spin, the rest park and leave cpu to others
+    if (spinning_count_.load(std::memory_order_relaxed) * 2 >= active_count_.load(std::memory_order_relaxed))
+        return false;
+    spinning_count_.fetch_add(1, std::memory_order_seq_cst);
+    auto start = std::chrono::steady_clock::now();
+    bool found = false;
+    while (!stopping()) {
+        if (has_task()) {
+            found = true;
+            break;
+        }
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (elapsed < policy.spin_us)
+            ARIS_CPU_RELAX();
+        else if (elapsed < policy.spin_us + policy.yield_us)
+            sched_yield();
+        else
+            break;
+    }
+    // pusher skip tickle while someone spin, last spinner hand over to a parked worker
+    if (spinning_count_.fetch_sub(1, std::memory_order_seq_cst) == 1 && found)
+        tickle();
+    return found;
 }
 
 }
\ No newline at end of file
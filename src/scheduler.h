@@ -2,14 +2,20 @@
 #define __STUDY_SRC_SCHEDULER_H__
 
 #include "fiber.h"
+#include "histogram.h"
+#include "mpmc_queue.h"
 #include "noncopable.h"
 #include "thread.h"
 #include "utils.h"
+#include "work_steal_queue.h"
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <pthread.h>
-#include <queue>
+#include <deque>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -17,33 +23,432 @@ namespace aris {
 
 class Scheduler : Noncopable {
 public:
-    typedef Cond CondType;
     typedef std::shared_ptr<Scheduler> ptr;
 
+    /**
+     * @brief how workers are bound to cpus
+     */
+    enum class Affinity {
+        /// no binding
+        NONE,
+        /// workers are grouped by numa node, each bound to one cpu of its node
+        CPU,
+        /// workers are grouped by numa node, each may run on any cpu of its node
+        NODE,
+    };
+
+    /**
+     * @brief what worker does when it run out of tasks,
+     * busy spin first, then give up cpu with sched_yield, then park until tickled
+     */
+    struct IdlePolicy {
+        /// busy spin time in microseconds
+        uint32_t spin_us {0};
+        /// sched_yield time in microseconds after spin
+        uint32_t yield_us {0};
+
+        /**
+         * @brief park at once, for batch hosts
+         */
+        static IdlePolicy park() { return IdlePolicy{0, 0}; }
+
+        /**
+         * @brief spin before park, for latency critical service
+         */
+        static IdlePolicy spin(uint32_t spin_us, uint32_t yield_us = 0) { return IdlePolicy{spin_us, yield_us}; }
+    };
+
+    /**
+     * @brief strict priority bands, tasks of higher band run first,
+     * deadline tasks run after HIGH and before NORMAL, earliest deadline first
+     */
+    enum class Priority {
+        HIGH,
+        NORMAL,
+        LOW,
+    };
+
+    /**
+     * @brief where and in which band a fiber resume, captured before it is hold
+     */
+    struct ResumeHint {
+        /// exec thread, -1 means any thread
+        int thread {-1};
+        Priority priority {Priority::NORMAL};
+        /// steady clock time in nanoseconds, 0 means no deadline
+        uint64_t deadline {0};
+    };
+
+    /**
+     * @brief queue stats of one band, wait is time from push to run
+     */
+    struct BandStats {
+        std::string name;
+        /// queued tasks, only a hint
+        size_t depth {0};
+        /// tasks taken to run
+        uint64_t count {0};
+        uint64_t wait_total_us {0};
+        uint64_t wait_max_us {0};
+    };
+
+    /**
+     * @brief run stats of one worker, times are in nanoseconds, wait is time from push to run.
+     * counters and histograms are written by owner worker only, reading them take no lock.
+     * define ARIS_DISABLE_STATS to compile collection out, only depth is reported then
+     */
+    struct WorkerStats {
+        /// worker index, -1 for sum of all workers
+        int index {-1};
+        /// worker thread is running, retired workers keep their stats
+        bool active {false};
+        /// local and pinned tasks queued, only a hint
+        size_t depth {0};
+        /// tasks run, a fiber resumed again is counted again
+        uint64_t tasks {0};
+        /// tasks stolen from other workers
+        uint64_t stolen {0};
+        /// time spent running tasks and in idle
+        uint64_t busy_ns {0};
+        uint64_t idle_ns {0};
+        /// busy share of busy and idle time
+        double utilization {0};
+        Histogram::Snapshot wait;
+        Histogram::Snapshot run;
+        Histogram::Snapshot idle;
+    };
+
+    /**
+     * @brief run stats of scheduler
+     */
+    struct Stats {
+        /// tasks queued in inject, global and band queues, only a hint
+        size_t depth {0};
+        std::vector<WorkerStats> workers;
+        /// all workers merged
+        WorkerStats total;
+    };
+
+    /**
+     * @brief bounds and triggers of elastic worker pool,
+     * worker count given to constructor is the initial count
+     */
+    struct ElasticPolicy {
+        /// running workers are kept in [min_threads, max_threads]
+        int min_threads {1};
+        int max_threads {1};
+        /// spawn a worker when a task waited longer than this in queue, in microseconds, 0 never spawn
+        uint64_t spawn_wait_us {0};
+        /// retire a worker parked longer than this, in milliseconds, 0 never retire
+        uint64_t retire_idle_ms {0};
+    };
+
+    /**
+     * @brief what stop does with queued tasks
+     */
+    enum class StopPolicy {
+        /// run queued tasks before workers exit
+        DRAIN,
+        /// drop queued funcs not started yet, started fibers still run until they end or hold
+        CANCEL,
+    };
+
     /**
      * @brief Construct a new Scheduler object
      * 
-     * @param[in] thread_count create thread count
+     * @param[in] thread_count worker count
      * @param[in] name scheduler name
+     * @param[in] use_caller thread calling start is worker 0, it runs tasks when it call stop,
+     * only thread_count - 1 threads are created
      */
-    Scheduler(int thread_count = 1, const std::string & name = "scheduler");
+    Scheduler(int thread_count = 1, const std::string & name = "scheduler", bool use_caller = false);
 
     virtual~Scheduler();
 
     /**
      * @brief 
      * @param[in] cb exec func, should regard as fiber task
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    void schedule(std::function<void()> cb, int thread = -1);
+
+    /**
+     * @brief schedule fiber, fiber should be in ready state.
+     * shared stack fiber run on worker it first run on whatever thread is given
+     * @param[in] fiber fiber task
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    void schedule(Fiber::ptr fiber, int thread = -1);
+
+    /**
+     * @brief schedule raw func, func is called on worker directly without fiber,
+     * it must not block or yield
+     * @param[in] func exec func
+     * @param[in] arg func arg
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    void schedule(void (*func)(void*), void* arg, int thread = -1);
+
+    /**
+     * @brief schedule func in priority band, fiber keep its band when it yield or is woken,
+     * task pinned to a worker run in its mailbox order whatever its band is
+     * @param[in] cb exec func
+     * @param[in] priority band
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    void schedule(std::function<void()> cb, Priority priority, int thread = -1);
+
+    /**
+     * @brief schedule fiber in priority band
+     * @param[in] fiber fiber task
+     * @param[in] priority band
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    void schedule(Fiber::ptr fiber, Priority priority, int thread = -1);
+
+    /**
+     * @brief schedule fiber as hint says, used to wake up hold fiber
+     */
+    void schedule(Fiber::ptr fiber, const ResumeHint & hint);
+
+    /**
+     * @brief schedule func in deadline band, task with earliest deadline run first,
+     * missed deadline only make it more urgent
+     * @param[in] cb exec func
+     * @param[in] deadline time func should run before
+     * @param[in] thread exec thread, -1 means any thread
      */
-    void schedule(std::function<void()> cb);
+    void schedule_deadline(std::function<void()> cb, std::chrono::steady_clock::time_point deadline, int thread = -1);
+
+    /**
+     * @brief schedule range of funcs with one queue operation,
+     * wake up at most as many idle workers as the funcs can keep busy
+     * @param[in] begin first func
+     * @param[in] end end of funcs
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    template <typename Iterator>
+    void schedule_batch(Iterator begin, Iterator end, int thread = -1) {
+        std::vector<ScheduleTask> tasks;
+        for (; begin != end; ++begin)
+            tasks.emplace_back(std::function<void()>(*begin), thread);
+        push_tasks(tasks, thread);
+    }
+
+    /**
+     * @brief schedule fn(0) to fn(count - 1) with one queue operation
+     * @param[in] count task count
+     * @param[in] fn func called with task index, shared by all tasks
+     * @param[in] thread exec thread, -1 means any thread
+     */
+    template <typename Func>
+    void schedule_n(size_t count, Func fn, int thread = -1) {
+        auto shared = std::make_shared<Func>(std::move(fn));
+        std::vector<ScheduleTask> tasks;
+        tasks.reserve(count);
+        for (size_t index = 0; index < count; index++)
+            tasks.emplace_back(std::function<void()>([shared, index]() { (*shared)(index); }), thread);
+        push_tasks(tasks, thread);
+    }
 
     /**
      * @brief start all thread to exec
      */
     void start();
 
+    /**
+     * @brief stop scheduler, return when all workers exit, in use_caller mode calling thread
+     * run as worker 0 until then. new funcs from threads out of scheduler are rejected since stop,
+     * fibers woken up are still scheduled. running task is never interrupted
+     * @param[in] policy drain or cancel queued tasks
+     * @param[in] timeout_ms drain time limit, tasks still queued after it are cancelled,
+     * ~0ull means no limit
+     * @return false if any task is cancelled
+     */
+    bool stop(StopPolicy policy = StopPolicy::DRAIN, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief get count of tasks dropped by stop
+     */
+    uint64_t get_cancelled_count() const { return cancelled_count_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Set max count of term fibers kept by each worker for reuse
+     * @param[in] size cache size, 0 disable fiber reuse
+     */
+    void set_fiber_cache_size(size_t size) { fiber_cache_size_ = size; }
+
+    /**
+     * @brief set idle policy of all workers
+     */
+    void set_idle_policy(const IdlePolicy & policy) { idle_policy_ = policy; }
+
+    /**
+     * @brief set aging of low band, low task waiting longer than this run before normal tasks
+     * @param[in] aging_us wait time in microseconds
+     */
+    void set_aging(uint64_t aging_us) { aging_ns_ = aging_us * 1000; }
+
+    /**
+     * @brief get depth and wait time of each band, high, normal, low, deadline
+     */
+    std::vector<BandStats> get_band_stats();
+
+    /**
+     * @brief get queue depth, latency histograms and utilization of each worker
+     */
+    Stats get_stats();
+
+    /**
+     * @brief bind workers to cpus, call before start,
+     * workers are split into contiguous groups, one group per numa node
+     * @param[in] affinity binding mode
+     */
+    void set_affinity(Affinity affinity);
+
+    /**
+     * @brief bind one worker to cpu set, call before start, override set_affinity for this worker
+     * @param[in] index worker index
+     * @param[in] cpus cpu ids
+     */
+    void set_worker_cpus(int index, const std::vector<int> & cpus);
+
+    /**
+     * @brief get numa node worker is assigned to
+     */
+    int get_worker_node(int index) const;
+
+    /**
+     * @brief get worker slot count, max workers that can run
+     */
+    int get_thread_count() const { return thread_count_; }
+
+    /**
+     * @brief get count of running workers, retiring workers are not counted
+     */
+    int get_active_count() const { return active_count_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief let worker count grow and shrink with load, call before start and before
+     * anything sized by worker count, such as io backend of IOManager.
+     * cpus of all max_threads workers are assigned at start, respawned worker is bound the same.
+     * tasks queued on a retiring worker move to global queue and tasks pinned to it run on any worker,
+     * so keep shared stack fibers on workers below min_threads
+     * @return false if bounds are invalid or scheduler is started
+     */
+    bool set_elastic_policy(const ElasticPolicy & policy);
+
+    /**
+     * @brief set running worker count, new workers start at once,
+     * extra workers retire after their current task, highest index first.
+     * workers with live shared stack fibers bound to them are kept
+     * @param[in] count worker count within bounds of elastic policy
+     * @return false if count is out of bounds or scheduler is stopped
+     */
+    bool resize(int count);
+
+    /**
+     * @brief Get the scheduler current thread belongs to
+     */
+    static Scheduler* get_thread_scheduler();
+
+    /**
+     * @brief Get current worker index in its scheduler, -1 if not a worker
+     */
+    static int get_thread_worker_index();
+
+    /**
+     * @brief get worker a yielded fiber should resume on, shared stack fiber
+     * stay on worker it is bound to, fiber of pinned task stay on its worker,
+     * others can resume on any worker
+     */
+    static int get_resume_thread(const Fiber::ptr & fiber);
+
+    /**
+     * @brief get worker and band a hold fiber should resume in, band of running task is kept
+     */
+    static ResumeHint get_resume_hint(const Fiber::ptr & fiber);
+
+    /**
+     * @brief move current fiber to scheduler, fiber continue on one of its workers when return
+     * @param[in] scheduler target scheduler
+     * @param[in] thread target worker, -1 means any worker
+     * @return false if current fiber cannot migrate
+     */
+    static bool switch_to(Scheduler* scheduler, int thread = -1);
+
+protected:
+    /**
+     * @brief block idle worker until unpark, parked worker is already in sleeper list
+     * @param[in] index worker index
+     */
+    virtual void park(int index);
+
+    /**
+     * @brief wake worker taken from sleeper list, may come before it park
+     * @param[in] index worker index
+     */
+    virtual void unpark(int index);
+
+    /**
+     * @brief check if workers can exit, queued tasks are still drained first
+     */
+    virtual bool stopping();
+
+    /**
+     * @brief called on worker thread before it take first task
+     * @param[in] index worker index
+     */
+    virtual void on_worker_start(int /*index*/) {}
+
+    /**
+     * @brief called on worker thread before it idle and every few tasks,
+     * worker submit deferred work and collect finished work here
+     * @param[in] index worker index
+     * @return true if tasks may be queued
+     */
+    virtual bool on_worker_flush(int /*index*/) { return false; }
+
+    /**
+     * @brief called on worker thread after it leave run loop
+     * @param[in] index worker index
+     */
+    virtual void on_worker_exit(int /*index*/) {}
+
+    /**
+     * @brief check if stop cancel queued work, waiters of subclass are abandoned too
+     */
+    bool cancelling() const { return cancel_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief get steady clock time in nanoseconds stop turn to cancel at, ~0ull if none
+     */
+    uint64_t get_stop_deadline() const { return stop_deadline_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief turn to cancel and wake up all workers if stop deadline has passed
+     */
+    void check_stop_deadline();
+
+    /**
+     * @brief get parker of worker
+     */
+    Parker& get_parker(int index) { return workers_[index]->parker; }
+
+    /**
+     * @brief wake up parked workers, skipped if a spinning worker will find the task
+     * @param[in] count workers to wake up
+     */
+    void tickle(size_t count = 1);
+
+    /**
+     * @brief remove worker from parked list
+     * @return false if it is already taken by tickle
+     */
+    bool remove_sleeper(int index);
+
 private:
     struct ScheduleTask {
-        typedef std::shared_ptr<ScheduleTask> ptr;
         ScheduleTask() {
 
         }
@@ -57,66 +462,328 @@ private:
             thread = thr;
         }
         /**
-         * @brief Construct a new Schedule Task object
+         * @brief Construct a new Schedule Task object,
+         * fiber is taken from worker cache when task run
          * @param[in] cb fiber func
          * @param[in] thread exec thread
          */
-        ScheduleTask(std::function<void()> cb, int thr = -1):
-        fiber(new Fiber(cb)) {            
+        ScheduleTask(std::function<void()> f, int thr = -1) {
+            cb.swap(f);
             thread = thr;
         }
+        /**
+         * @brief Construct a new Schedule Task object, run on worker without fiber
+         * @param[in] fn raw func
+         * @param[in] a func arg
+         * @param[in] thread exec thread
+         */
+        ScheduleTask(void (*fn)(void*), void* a, int thr = -1) {
+            func = fn;
+            arg = a;
+            thread = thr;
+        }
+        /**
+         * @brief check if task is empty
+         */
+        bool empty() const {
+            return !fiber && !cb && !func;
+        }
         /**
          * @brief reset task
          */
         void reset() {
             fiber = nullptr;
+            cb = nullptr;
+            func = nullptr;
+            arg = nullptr;
+            thread = -1;
+            priority = Priority::NORMAL;
+            deadline = 0;
+            push_time = 0;
         }
-
         /**
-         * @brief execute fiber
+         * @brief get band index of task in stats
          */
-        void run() {
-            // check if fiber eixst
-            if (!fiber)
-                return;
-            fiber->resume();
+        int band() const {
+            return deadline != 0 ? deadline_band : static_cast<int>(priority);
         }
 
         /// fiber task
         Fiber::ptr fiber {nullptr};
+        /// func task
+        std::function<void()> cb {nullptr};
+        /// raw func task
+        void (*func)(void*) {nullptr};
+        void* arg {nullptr};
         /// add task to which 
         int thread {-1};
+        /// band, deadline task ignore priority
+        Priority priority {Priority::NORMAL};
+        uint64_t deadline {0};
+        /// steady clock time in nanoseconds when task is pushed
+        uint64_t push_time {0};
+    };
+
+    /// band count, deadline band follow priority bands
+    static const int deadline_band = 3;
+    static const int band_count = 4;
+
+    /**
+     * @brief wait time of tasks one worker took, written by owner only
+     */
+    struct BandCounter {
+        std::atomic<uint64_t> count {0};
+        std::atomic<uint64_t> wait_total_ns {0};
+        std::atomic<uint64_t> wait_max_ns {0};
+    };
+
+    /**
+     * @brief worker local state, owner push and pop its queue, idle workers steal from it
+     */
+    struct Worker {
+        WorkStealQueue<ScheduleTask*> queue;
+        /// tasks pinned to this worker
+        Mutex mutex;
+        std::deque<ScheduleTask> pinned;
+        std::atomic<size_t> pinned_count {0};
+        /// numa node and cpus, empty cpus means no binding
+        int node {0};
+        std::vector<int> cpus;
+        bool cpus_set {false};
+        /// park here when idle
+        Parker parker;
+        /// tasks taken since global queue was checked
+        uint32_t tick {0};
+        /// random seed to choose steal victim
+        uint32_t seed {0};
+        /// high tasks taken in a row, normal task get a turn when it reach limit
+        uint32_t high_streak {0};
+        BandCounter counters[band_count];
+        /// thread of this slot run, changed under mutex so no pinned task is left on retired worker
+        std::atomic<bool> running {true};
+        /// asked to exit, set under resize mutex
+        std::atomic<bool> retiring {false};
+        /// shared fibers bound to stacks of this thread and not term yet, worker cant retire while any
+        std::atomic<size_t> bound_count {0};
+#ifndef ARIS_DISABLE_STATS
+        /// written by owner only
+        Histogram wait_hist;
+        Histogram run_hist;
+        Histogram idle_hist;
+        std::atomic<uint64_t> stolen_count {0};
+#endif
     };
 
 private:
     /**
      * @brief run scheduler
+     * @param[in] index worker index
      */
-    void run();
+    void run(int index);
 
     /**
-     * @brief idle 
+     * @brief park worker until task come, return once scheduler is stopping
      */
     void idle();
 
+    /**
+     * @brief run task on current worker
+     * @param[in] task task to run
+     */
+    void run_task(ScheduleTask & task);
+
+    /**
+     * @brief push task and wake up idle worker
+     * @param[in] task task to push
+     * @param[in] local push unpinned task scheduled by own worker to its local queue,
+     * otherwise task goes to inject queue, or global queue if pinned or inject queue is full
+     */
+    void push_task(ScheduleTask && task, bool local = true);
+
+    /**
+     * @brief push tasks with one queue operation, tasks are moved out
+     * @param[in] tasks tasks to push
+     * @param[in] thread exec thread of all tasks
+     */
+    void push_tasks(std::vector<ScheduleTask> & tasks, int thread);
+
+    /**
+     * @brief get node of local or inject queue from thread cache, then from shared pool,
+     * allocate when both are empty
+     */
+    ScheduleTask* new_task_node(ScheduleTask && task);
+
+    /**
+     * @brief move task out of queue node and give node to thread cache,
+     * shared pool take it when cache is full
+     */
+    void take_task_node(ScheduleTask* node, ScheduleTask & task);
+
+    /**
+     * @brief check worker index, invalid index is logged and treated as any worker
+     */
+    int check_worker(int thread);
+
+    /**
+     * @brief take task current worker can run, local queue first, then global queue,
+     * then steal from other workers
+     * @param[out] task task taken
+     * @return false if no task
+     */
+    bool take_task(ScheduleTask & task);
+
+    /**
+     * @brief take task pinned to current worker
+     */
+    bool take_pinned_task(ScheduleTask & task);
+
+    /**
+     * @brief take a batch from inject queue or global queue,
+     * first one is returned and others go to local queue
+     */
+    bool take_global_task(ScheduleTask & task);
+
+    /**
+     * @brief steal one task from other workers, workers of same numa node first
+     */
+    bool steal_task(ScheduleTask & task);
+
+    /**
+     * @brief take task of high, deadline or low band
+     * @param[in] starving true if normal queues are empty, low and high task are always taken
+     */
+    bool take_band_task(ScheduleTask & task, bool starving);
+
+    /**
+     * @brief record wait time of task taken by current worker
+     */
+    void record_wait(const ScheduleTask & task);
+
+    /**
+     * @brief check if current worker may have task to run, no lock needed
+     */
+    bool has_task();
+
+    /**
+     * @brief wake up worker if it is parked, used for pinned task
+     */
+    void tickle_worker(int index);
+
+    /**
+     * @brief spin and yield as idle policy says
+     * @return true if task is found
+     */
+    bool idle_spin();
+
+    /**
+     * @brief bring one more worker to run, retiring worker is kept first,
+     * then lowest free slot is started, called with resize mutex held
+     * @return false if all slots are running
+     */
+    bool add_worker();
+
+    /**
+     * @brief spawn one worker when queue wait is over threshold, at most one per threshold period
+     * @param[in] wait wait time of task just taken in nanoseconds
+     */
+    void grow_on_wait(uint64_t wait);
+
+    /**
+     * @brief mark idle worker to retire if pool is above min size
+     */
+    bool try_retire(int index);
+
+    /**
+     * @brief give queued tasks of retiring worker to others
+     * @return false if stop came first, worker stay and drain with others
+     */
+    bool retire_worker(int index);
+
 private:
     /// state
-    bool stop_ {false};
-    
-    /// idle fiber
-    Fiber::ptr idle_fiber_;
+    std::atomic<bool> stop_ {false};
+    /// drop queued funcs instead of running them
+    std::atomic<bool> cancel_ {false};
+    std::atomic<uint64_t> stop_deadline_ {~0ull};
+    std::atomic<uint64_t> cancelled_count_ {0};
+    bool started_ {false};
+    /// thread calling start is worker 0
+    bool use_caller_ {false};
+    pthread_t caller_thread_ {};
 
     // thread
     std::string name_ {""};
     int thread_count_ {0};
+    /// thread of each worker, null for caller worker
     std::vector<Thread::ptr> threads_ {};
 
-    /// task queu
-    CondType cond_;
-    std::queue<ScheduleTask::ptr> tasks_ ;
+    /// max term fibers cached by one worker
+    size_t fiber_cache_size_ {64};
+
+    /// tasks from other threads and yielded fibers
+    MPMCQueue<ScheduleTask*> inject_;
+    /// free queue nodes worker caches cannot keep, threads out of scheduler push with them
+    MPMCQueue<ScheduleTask*> free_nodes_;
+    /// global task queue, for inject queue overflow and batch from outside
+    Mutex mutex_;
+    std::deque<ScheduleTask> tasks_ ;
+    /// global task count, read without lock
+    std::atomic<size_t> global_count_ {0};
+
+    /// high and low band queues, normal band use queues above
+    Mutex band_mutex_;
+    std::deque<ScheduleTask> high_tasks_;
+    std::deque<ScheduleTask> low_tasks_;
+    /// deadline band ordered by deadline
+    std::multimap<uint64_t, ScheduleTask> deadline_tasks_;
+    /// task count of three bands, read without lock
+    std::atomic<size_t> band_task_count_ {0};
+    /// low task waiting longer than this run before normal tasks
+    uint64_t aging_ns_ {100 * 1000 * 1000};
+
+    /// per worker queues
+    std::vector<std::unique_ptr<Worker>> workers_;
+    /// parked workers, last parked is woken first, its cache is warmer
+    Mutex sleep_mutex_;
+    std::vector<int> sleepers_;
+    std::atomic<int> idle_count_ {0};
+    /// workers spinning for task
+    std::atomic<int> spinning_count_ {0};
+    IdlePolicy idle_policy_ {};
+    /// elastic pool, slot changes are serialized by resize mutex
+    Mutex resize_mutex_;
+    int min_threads_ {1};
+    std::atomic<int> active_count_ {0};
+    uint64_t spawn_wait_ns_ {0};
+    uint64_t retire_idle_ns_ {0};
+    std::atomic<uint64_t> last_spawn_ns_ {0};
+    /// worker binding
+    Affinity affinity_ {Affinity::NONE};
 };
 
+/**
+ * @brief run current fiber on target scheduler in this scope, switch back when destroyed
+ * @code
+ *  {
+ *      SchedulerSwitcher switcher(cpu_scheduler);
+ *      heavy_compute();
+ *  }
+ * @endcode
+ */
+class SchedulerSwitcher : Noncopable {
+public:
+    explicit SchedulerSwitcher(Scheduler* target, int thread = -1) {
+        caller_ = Scheduler::get_thread_scheduler();
+        Scheduler::switch_to(target, thread);
+    }
+    ~SchedulerSwitcher() {
+        if (caller_ != nullptr)
+            Scheduler::switch_to(caller_);
+    }
 
+private:
+    Scheduler* caller_ {nullptr};
+};
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "stack_allocator.h"
+#include "log.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace aris {
+
+static std::atomic<bool> stack_huge_page_ {false};
+static std::atomic<size_t> stack_max_cached_ {64};
+/// cached bytes per thread, count alone would let 64 large stacks pin hundreds of MB
+static std::atomic<size_t> stack_max_cached_bytes_ {16 * 1024 * 1024};
+static std::atomic<size_t> stack_prewarm_size_ {0};
+static std::atomic<size_t> stack_prewarm_count_ {0};
+/// thread cache may be destroyed before fibers owned by other thread_local at thread exit
+static thread_local bool stack_cache_destroyed_ = false;
+
+static size_t get_page_size() {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+// get size class index, -1 means not cached
+static int get_class_index(size_t size) {
+    size_t class_size = StackAllocator::min_class_size;
+    for (int index = 0; index < StackAllocator::class_count; index++) {
+        if (size <= class_size)
+            return index;
+        class_size <<= 1;
+    }
+    return -1;
+}
+
+// map stack with guard page below
+static void* map_stack(size_t size, bool populate) {
+    size_t guard = get_page_size();
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    if (populate)
+        flags |= MAP_POPULATE;
+    void* base = mmap(nullptr, size + guard, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (base == MAP_FAILED) {
+        ARIS_LOG_FMT_ERROR("map stack failed, size: %zu, err: %s", size, strerror(errno));
+        return nullptr;
+    }
+    // stack grow down, protect lowest page
+    if (mprotect(base, guard, PROT_NONE) != 0)
+        ARIS_LOG_FMT_WARN("protect guard page failed, err: %s", strerror(errno));
+    void* stack = static_cast<char*>(base) + guard;
+    if (stack_huge_page_.load(std::memory_order_relaxed))
+        madvise(stack, size, MADV_HUGEPAGE);
+    return stack;
+}
+
+static void unmap_stack(void* p, size_t size) {
+    size_t guard = get_page_size();
+    munmap(static_cast<char*>(p) - guard, size + guard);
+}
+
+/**
+ * @brief per-thread cache, free stacks are linked through first word of stack bottom
+ */
+struct StackCache {
+    struct Node {
+        Node* next;
+    };
+
+    StackCache() {
+        size_t class_size = StackAllocator::min_class_size;
+        for (int index = 0; index < StackAllocator::class_count; index++) {
+            sizes[index] = class_size;
+            class_size <<= 1;
+        }
+        size_t count = stack_prewarm_count_.load(std::memory_order_relaxed);
+        if (count == 0)
+            return;
+        fill(stack_prewarm_size_.load(std::memory_order_relaxed), count);
+    }
+
+    ~StackCache() {
+        stack_cache_destroyed_ = true;
+        size_t class_size = StackAllocator::min_class_size;
+        for (int index = 0; index < StackAllocator::class_count; index++) {
+            while (heads[index] != nullptr) {
+                Node* node = heads[index];
+                heads[index] = node->next;
+                unmap_stack(node, class_size);
+            }
+            class_size <<= 1;
+        }
+    }
+
+    void* pop(int index) {
+        Node* node = heads[index];
+        if (node == nullptr)
+            return nullptr;
+        heads[index] = node->next;
+        counts[index]--;
+        bytes -= sizes[index];
+        return node;
+    }
+
+    bool push(int index, void* p) {
+        if (counts[index] >= stack_max_cached_.load(std::memory_order_relaxed))
+            return false;
+        if (bytes + sizes[index] > stack_max_cached_bytes_.load(std::memory_order_relaxed))
+            return false;
+        Node* node = static_cast<Node*>(p);
+        node->next = heads[index];
+        heads[index] = node;
+        counts[index]++;
+        bytes += sizes[index];
+        return true;
+    }
+
+    void fill(size_t size, size_t count) {
+        int index = get_class_index(size);
+        if (index < 0)
+            return;
+        size_t class_size = StackAllocator::get_class_size(size);
+        for (size_t n = 0; n < count; n++) {
+            void* stack = map_stack(class_size, true);
+            if (stack == nullptr)
+                return;
+            if (!push(index, stack)) {
+                unmap_stack(stack, class_size);
+                return;
+            }
+        }
+    }
+
+    Node* heads[StackAllocator::class_count] {};
+    size_t counts[StackAllocator::class_count] {};
+    size_t sizes[StackAllocator::class_count] {};
+    /// total size of cached stacks
+    size_t bytes {0};
+};
+
+static StackCache& get_thread_stack_cache() {
+    static thread_local StackCache cache;
+    return cache;
+}
+
+size_t StackAllocator::get_class_size(size_t size) {
+    int index = get_class_index(size);
+    if (index < 0) {
+        // round up to page
+        size_t page = get_page_size();
+        return (size + page - 1) / page * page;
+    }
+    return min_class_size << index;
+}
+
+void* StackAllocator::Alloc(size_t size) {
+    int index = get_class_index(size);
+    if (index >= 0 && !stack_cache_destroyed_) {
+        void* stack = get_thread_stack_cache().pop(index);
+        if (stack != nullptr)
+            return stack;
+    }
+    return map_stack(get_class_size(size), false);
+}
+
+void StackAllocator::Dealloc(void* p, size_t size) {
+    if (p == nullptr)
+        return;
+    int index = get_class_index(size);
+    if (index >= 0 && !stack_cache_destroyed_ && get_thread_stack_cache().push(index, p))
+        return;
+    unmap_stack(p, get_class_size(size));
+}
+
+void StackAllocator::prewarm(size_t size, size_t count) {
+    get_thread_stack_cache().fill(size, count);
+}
+
+void StackAllocator::set_prewarm(size_t size, size_t count) {
+    stack_prewarm_size_.store(size, std::memory_order_relaxed);
+    stack_prewarm_count_.store(count, std::memory_order_relaxed);
+}
+
+void StackAllocator::set_huge_page(bool enable) {
+    stack_huge_page_.store(enable, std::memory_order_relaxed);
+}
+
+void StackAllocator::set_max_cached(size_t count) {
+    stack_max_cached_.store(count, std::memory_order_relaxed);
+}
+
+void StackAllocator::set_max_cached_bytes(size_t bytes) {
+    stack_max_cached_bytes_.store(bytes, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,86 @@
+/**
+ * @file stack_allocator.h
+ * @author aris
+ * @brief fiber stack allocator
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_STACK_ALLOCATOR_H__
+#define __STUDY_SRC_STACK_ALLOCATOR_H__
+
+#include <cstddef>
+
+namespace aris {
+
+/**
+ * @brief fiber stacks are mapped with mmap, each stack has a PROT_NONE guard page below it.
+ * stacks are rounded up to power of two size classes, freed stacks are kept
+ * in per-thread free list and reused by next Alloc of the same class,
+ * cache is bounded by both count per class and total bytes
+ */
+class StackAllocator {
+public:
+    /// smallest size class
+    static const size_t min_class_size = 16 * 1024;
+    /// largest cached size class, bigger stacks are mapped and unmapped directly
+    static const size_t max_class_size = 8 * 1024 * 1024;
+    /// count of size classes
+    static const int class_count = 10;
+
+    /**
+     * @brief alloc stack
+     * @param[in] size stack size, rounded up to size class
+     * @return stack bottom, usable range is [p, p + get_class_size(size))
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief return stack to current thread free list
+     * @param[in] p stack bottom returned by Alloc
+     * @param[in] size size passed to Alloc
+     */
+    static void Dealloc(void* p, size_t size);
+
+    /**
+     * @brief get size class stack size will be rounded up to
+     */
+    static size_t get_class_size(size_t size);
+
+    /**
+     * @brief fill current thread free list, pages are populated as well
+     * @param[in] size stack size
+     * @param[in] count stack count
+     */
+    static void prewarm(size_t size, size_t count);
+
+    /**
+     * @brief prewarm every thread on its first Alloc
+     * @param[in] size stack size
+     * @param[in] count stack count, 0 disable prewarm
+     */
+    static void set_prewarm(size_t size, size_t count);
+
+    /**
+     * @brief back stacks with transparent huge pages, only stacks larger than 2MB benefit
+     */
+    static void set_huge_page(bool enable);
+
+    /**
+     * @brief max count of cached stacks per size class per thread
+     */
+    static void set_max_cached(size_t count);
+
+    /**
+     * @brief max total size of cached stacks per thread, stack freed above it is unmapped,
+     * so large classes keep only a few stacks. default 16MB
+     */
+    static void set_max_cached_bytes(size_t bytes);
+};
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "stack_profiler.h"
+#include "stack_allocator.h"
+#include "utils.h"
+
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <memory>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace aris {
+
+/// paint pattern, unlikely to be written by real code
+static const uint64_t stack_paint_pattern = 0xA5A5A5A5A5A5A5A5ULL;
+
+static std::atomic<bool> stack_profiling_ {false};
+static std::atomic<bool> stack_adaptive_ {false};
+static std::atomic<size_t> stack_margin_percent_ {50};
+static std::atomic<size_t> stack_margin_extra_ {8 * 1024};
+
+/**
+ * @brief entry point key, func type plus address of plain function
+ */
+struct StackSiteKey {
+    const std::type_info* type;
+    const void* address;
+
+    bool operator==(const StackSiteKey & other) const {
+        return *type == *other.type && address == other.address;
+    }
+};
+
+struct StackSiteKeyHash {
+    size_t operator()(const StackSiteKey & key) const {
+        return key.type->hash_code() ^ (reinterpret_cast<uintptr_t>(key.address) * 31);
+    }
+};
+
+/**
+ * @brief sites never removed, pointers stay valid
+ */
+struct StackSiteTable {
+    RWMutex mutex;
+    std::unordered_map<StackSiteKey, StackSite*, StackSiteKeyHash> by_key;
+    std::unordered_map<std::string, std::unique_ptr<StackSite>> by_name;
+
+    // create site by name, lock should be held
+    StackSite* get_or_create(const std::string & name) {
+        auto & site = by_name[name];
+        if (!site) {
+            site.reset(new StackSite());
+            site->name = name;
+        }
+        return site.get();
+    }
+};
+
+static StackSiteTable& get_site_table() {
+    static StackSiteTable* table = new StackSiteTable();
+    return *table;
+}
+
+static std::string demangle(const char* name) {
+    int status = 0;
+    char* readable = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (readable == nullptr)
+        return name;
+    std::string ret(readable);
+    free(readable);
+    return ret;
+}
+
+// name should be stable between runs, plain function use symbol or module offset
+static std::string get_site_name(const StackSiteKey & key) {
+    std::string name = demangle(key.type->name());
+    if (key.address == nullptr)
+        return name;
+    Dl_info info;
+    if (dladdr(key.address, &info) != 0) {
+        if (info.dli_sname != nullptr)
+            return name + "@" + demangle(info.dli_sname);
+        uintptr_t offset = reinterpret_cast<uintptr_t>(key.address) - reinterpret_cast<uintptr_t>(info.dli_fbase);
+        return name + "@" + (info.dli_fname ? info.dli_fname : "") + StringGenerator::format("+0x%zx", offset);
+    }
+    return name + StringGenerator::format("@%p", key.address);
+}
+
+void StackProfiler::set_profiling(bool enable) {
+    stack_profiling_.store(enable, std::memory_order_relaxed);
+}
+
+bool StackProfiler::is_profiling() {
+    return stack_profiling_.load(std::memory_order_relaxed);
+}
+
+void StackProfiler::set_adaptive(bool enable) {
+    stack_adaptive_.store(enable, std::memory_order_relaxed);
+}
+
+bool StackProfiler::is_adaptive() {
+    return stack_adaptive_.load(std::memory_order_relaxed);
+}
+
+void StackProfiler::set_safety_margin(size_t percent, size_t extra) {
+    stack_margin_percent_.store(percent, std::memory_order_relaxed);
+    stack_margin_extra_.store(extra, std::memory_order_relaxed);
+}
+
+StackSite* StackProfiler::get_site(const std::function<void()> & cb) {
+    if (!cb)
+        return nullptr;
+    StackSiteKey key {&cb.target_type(), nullptr};
+    // plain functions share one type, tell them apart by address
+    if (auto fn = cb.target<void(*)()>())
+        key.address = reinterpret_cast<const void*>(*fn);
+    StackSiteTable& table = get_site_table();
+    {
+        RWMutex::ReadLock lock(table.mutex);
+        auto it = table.by_key.find(key);
+        if (it != table.by_key.end())
+            return it->second;
+    }
+    std::string name = get_site_name(key);
+    RWMutex::Lock lock(table.mutex);
+    StackSite* site = table.get_or_create(name);
+    table.by_key.emplace(key, site);
+    return site;
+}
+
+size_t StackProfiler::choose_size(StackSite* site, size_t fallback) {
+    if (site == nullptr || site->samples.load(std::memory_order_relaxed) == 0)
+        return fallback;
+    size_t peak = site->peak.load(std::memory_order_relaxed);
+    size_t size = peak * (100 + stack_margin_percent_.load(std::memory_order_relaxed)) / 100
+        + stack_margin_extra_.load(std::memory_order_relaxed);
+    size = StackAllocator::get_class_size(size);
+    site->class_size.store(size, std::memory_order_relaxed);
+    site->adaptive_count.fetch_add(1, std::memory_order_relaxed);
+    return size;
+}
+
+void StackProfiler::paint(void* stack, size_t size) {
+    uint64_t* word = static_cast<uint64_t*>(stack);
+    for (size_t index = 0; index < size / sizeof(uint64_t); index++)
+        word[index] = stack_paint_pattern;
+}
+
+size_t StackProfiler::measure(const void* stack, size_t size) {
+    // lowest touched word mark the high water
+    const uint64_t* word = static_cast<const uint64_t*>(stack);
+    size_t count = size / sizeof(uint64_t);
+    size_t index = 0;
+    while (index < count && word[index] == stack_paint_pattern)
+        index++;
+    return size - index * sizeof(uint64_t);
+}
+
+void StackProfiler::record(StackSite* site, size_t used) {
+    if (site == nullptr)
+        return;
+    site->samples.fetch_add(1, std::memory_order_relaxed);
+    size_t peak = site->peak.load(std::memory_order_relaxed);
+    while (used > peak && !site->peak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+    }
+}
+
+void StackProfiler::set_peak(const std::string & name, size_t peak) {
+    StackSiteTable& table = get_site_table();
+    RWMutex::Lock lock(table.mutex);
+    StackSite* site = table.get_or_create(name);
+    site->peak.store(peak, std::memory_order_relaxed);
+    if (site->samples.load(std::memory_order_relaxed) == 0)
+        site->samples.store(1, std::memory_order_relaxed);
+}
+
+std::vector<StackSiteStats> StackProfiler::get_stats() {
+    std::vector<StackSiteStats> stats;
+    StackSiteTable& table = get_site_table();
+    RWMutex::ReadLock lock(table.mutex);
+    for (auto & it : table.by_name) {
+        StackSite* site = it.second.get();
+        stats.emplace_back(StackSiteStats{site->name, site->samples.load(), site->peak.load(),
+            site->class_size.load(), site->adaptive_count.load()});
+    }
+    return stats;
+}
+
+}
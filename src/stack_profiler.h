@@ -0,0 +1,116 @@
+/**
+ * @file stack_profiler.h
+ * @author aris
+ * @brief fiber stack high water mark and adaptive stack size
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_STACK_PROFILER_H__
+#define __STUDY_SRC_STACK_PROFILER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief stack usage of one fiber entry point
+ */
+struct StackSite {
+    /// readable entry point name
+    std::string name;
+    /// term fibers measured
+    std::atomic<uint64_t> samples {0};
+    /// max stack bytes used
+    std::atomic<size_t> peak {0};
+    /// last size class chosen by adaptive mode
+    std::atomic<size_t> class_size {0};
+    /// fibers created with adaptive size
+    std::atomic<uint64_t> adaptive_count {0};
+};
+
+/**
+ * @brief snapshot of StackSite
+ */
+struct StackSiteStats {
+    std::string name;
+    uint64_t samples;
+    size_t peak;
+    size_t class_size;
+    uint64_t adaptive_count;
+};
+
+/**
+ * @brief profiling mode paint private fiber stacks and record peak usage per entry point
+ * when fiber term, entry point is the type of fiber func, plus address for plain functions.
+ * adaptive mode give fibers created with stacksize 0 the smallest size class
+ * which cover recorded peak with safety margin
+ */
+class StackProfiler {
+public:
+    /**
+     * @brief enable stack painting and measuring, cost a full stack write per fiber
+     */
+    static void set_profiling(bool enable);
+    static bool is_profiling();
+
+    /**
+     * @brief enable adaptive stack size
+     */
+    static void set_adaptive(bool enable);
+    static bool is_adaptive();
+
+    /**
+     * @brief adaptive size is peak * (100 + percent) / 100 + extra bytes
+     */
+    static void set_safety_margin(size_t percent, size_t extra);
+
+    /**
+     * @brief find or create site of fiber func
+     */
+    static StackSite* get_site(const std::function<void()> & cb);
+
+    /**
+     * @brief get adaptive size of site
+     * @param[in] site entry point
+     * @param[in] fallback size used when site has no sample
+     */
+    static size_t choose_size(StackSite* site, size_t fallback);
+
+    /**
+     * @brief fill stack with pattern
+     */
+    static void paint(void* stack, size_t size);
+
+    /**
+     * @brief get used bytes of painted stack, stack grow down from stack + size
+     */
+    static size_t measure(const void* stack, size_t size);
+
+    /**
+     * @brief record used bytes of site
+     */
+    static void record(StackSite* site, size_t used);
+
+    /**
+     * @brief set peak of site by name, used to load profile from previous run
+     */
+    static void set_peak(const std::string & name, size_t peak);
+
+    /**
+     * @brief get snapshot of all sites
+     */
+    static std::vector<StackSiteStats> get_stats();
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include "task.h"
+
+#include <atomic>
+#include <new>
+
+namespace aris {
+
+static const size_t frame_class_count = FrameAllocator::max_class_size / FrameAllocator::class_granularity;
+
+static std::atomic<size_t> frame_max_cached_ {1024};
+/// thread cache may be destroyed before frames owned by other thread_local at thread exit
+static thread_local bool frame_cache_destroyed_ = false;
+
+/**
+ * @brief per-thread cache, free frames are linked through first word of frame
+ */
+struct FrameCache {
+    struct Node {
+        Node* next;
+    };
+
+    ~FrameCache() {
+        frame_cache_destroyed_ = true;
+        for (size_t index = 0; index < frame_class_count; index++) {
+            while (heads[index] != nullptr) {
+                Node* node = heads[index];
+                heads[index] = node->next;
+                ::operator delete(node);
+            }
+        }
+    }
+
+    Node* heads[frame_class_count] {};
+    size_t counts[frame_class_count] {};
+};
+
+static FrameCache& get_thread_frame_cache() {
+    static thread_local FrameCache cache;
+    return cache;
+}
+
+static size_t get_class_index(size_t size) {
+    return (size + FrameAllocator::class_granularity - 1) / FrameAllocator::class_granularity - 1;
+}
+
+void* FrameAllocator::Alloc(size_t size) {
+    if (size > max_class_size || frame_cache_destroyed_)
+        return ::operator new(size);
+    size_t index = get_class_index(size);
+    FrameCache& cache = get_thread_frame_cache();
+    FrameCache::Node* node = cache.heads[index];
+    if (node == nullptr)
+        return ::operator new((index + 1) * class_granularity);
+    cache.heads[index] = node->next;
+    cache.counts[index]--;
+    return node;
+}
+
+void FrameAllocator::Dealloc(void* p, size_t size) {
+    if (p == nullptr)
+        return;
+    if (size > max_class_size || frame_cache_destroyed_) {
+        ::operator delete(p);
+        return;
+    }
+    size_t index = get_class_index(size);
+    FrameCache& cache = get_thread_frame_cache();
+    if (cache.counts[index] >= frame_max_cached_.load(std::memory_order_relaxed)) {
+        ::operator delete(p);
+        return;
+    }
+    FrameCache::Node* node = static_cast<FrameCache::Node*>(p);
+    node->next = cache.heads[index];
+    cache.heads[index] = node;
+    cache.counts[index]++;
+}
+
+void FrameAllocator::set_max_cached(size_t count) {
+    frame_max_cached_.store(count, std::memory_order_relaxed);
+}
+
+}
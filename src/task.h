@@ -0,0 +1,347 @@
+/**
+ * @file task.h
+ * @author aris
+ * @brief stackless coroutine task run on scheduler
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_TASK_H__
+#define __STUDY_SRC_TASK_H__
+
+#include <cstddef>
+
+namespace aris {
+
+/**
+ * @brief coroutine frame allocator, frames are rounded up to 64 bytes classes
+ * and kept in per-thread free list, frames bigger than max_class_size use operator new
+ */
+class FrameAllocator {
+public:
+    /// size class granularity
+    static const size_t class_granularity = 64;
+    /// largest pooled frame
+    static const size_t max_class_size = 2048;
+
+    /**
+     * @brief alloc coroutine frame
+     * @param[in] size frame size
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief give coroutine frame back to current thread free list
+     * @param[in] p frame returned by Alloc
+     * @param[in] size size passed to Alloc
+     */
+    static void Dealloc(void* p, size_t size);
+
+    /**
+     * @brief max count of cached frames per size class per thread
+     */
+    static void set_max_cached(size_t count);
+};
+
+}
+
+#if defined(__cpp_impl_coroutine)
+
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace aris {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+/**
+ * @brief resume coroutine, used as raw scheduler task
+ */
+inline void resume_coroutine(void* address) {
+    std::coroutine_handle<>::from_address(address).resume();
+}
+
+struct PromiseBase {
+    /**
+     * @brief final awaiter, transfer to awaiting coroutine,
+     * detached coroutine destroy itself
+     */
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            PromiseBase& promise = handle.promise();
+            if (promise.continuation_)
+                return promise.continuation_;
+            if (promise.detached_) {
+                if (promise.exception_)
+                    ARIS_LOG_FMT_WARN("detached task exit with exception, %s", "ignored");
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    static void* operator new(size_t size) {
+        return FrameAllocator::Alloc(size);
+    }
+
+    static void operator delete(void* p, size_t size) {
+        FrameAllocator::Dealloc(p, size);
+    }
+
+    /// task is lazy, run when awaited or spawned
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { exception_ = std::current_exception(); }
+
+    void rethrow() {
+        if (exception_)
+            std::rethrow_exception(exception_);
+    }
+
+    /// coroutine resumed when this task finish
+    std::coroutine_handle<> continuation_ {nullptr};
+    std::exception_ptr exception_ {nullptr};
+    /// nobody own this task, destroy frame when finish
+    bool detached_ {false};
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    Task<T> get_return_object() noexcept;
+
+    template <typename V>
+    void return_value(V && value) {
+        value_.emplace(std::forward<V>(value));
+    }
+
+    T result() {
+        rethrow();
+        return std::move(*value_);
+    }
+
+    std::optional<T> value_ {};
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() {
+        rethrow();
+    }
+};
+
+}
+
+/**
+ * @brief lazy stackless task, start when co_await or spawn,
+ * awaiting coroutine is resumed on the thread task finish
+ */
+template <typename T>
+class Task : Noncopable {
+public:
+    typedef detail::Promise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    explicit Task(handle_type handle): handle_(handle) {}
+    Task(Task && other) noexcept: handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task && other) noexcept {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~Task() {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return !handle_ || handle_.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation_ = awaiting;
+        return handle_;
+    }
+
+    T await_resume() {
+        return handle_.promise().result();
+    }
+
+    /**
+     * @brief give up frame ownership
+     */
+    handle_type release() {
+        return std::exchange(handle_, nullptr);
+    }
+
+private:
+    handle_type handle_ {nullptr};
+};
+
+namespace detail {
+
+template <typename T>
+inline Task<T> Promise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief hop awaiting coroutine onto scheduler worker
+ */
+struct ScheduleAwaiter {
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        scheduler->schedule(&resume_coroutine, handle.address(), thread);
+    }
+    void await_resume() noexcept {}
+
+    Scheduler* scheduler;
+    int thread;
+};
+
+/**
+ * @brief run func in fiber, resume awaiting coroutine on scheduler when func return
+ */
+template <typename F, typename R = std::invoke_result_t<F>>
+struct FiberAwaiter {
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        scheduler->schedule([this, handle]() {
+            try {
+                if constexpr (std::is_void_v<R>)
+                    func();
+                else
+                    value.emplace(func());
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            scheduler->schedule(&resume_coroutine, handle.address());
+        });
+    }
+    R await_resume() {
+        if (exception)
+            std::rethrow_exception(exception);
+        if constexpr (!std::is_void_v<R>)
+            return std::move(*value);
+    }
+
+    Scheduler* scheduler;
+    F func;
+    std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> value {};
+    std::exception_ptr exception {nullptr};
+};
+
+/**
+ * @brief result of task awaited by fiber, kept off fiber stack,
+ * stack of shared stack fiber is swapped out while it is hold
+ */
+template <typename T>
+struct AwaitResult {
+    std::conditional_t<std::is_void_v<T>, bool, std::optional<T>> value {};
+    std::exception_ptr exception {nullptr};
+};
+
+/**
+ * @brief wrap task awaited by fiber, wake fiber up when task finish
+ */
+template <typename T>
+Task<void> wake_fiber_when_done(Task<T> task, std::shared_ptr<AwaitResult<T>> result,
+    Scheduler* scheduler, Fiber::ptr fiber, Scheduler::ResumeHint hint) {
+    try {
+        if constexpr (std::is_void_v<T>)
+            co_await std::move(task);
+        else
+            result->value.emplace(co_await std::move(task));
+    } catch (...) {
+        result->exception = std::current_exception();
+    }
+    scheduler->schedule(std::move(fiber), hint);
+}
+
+}
+
+/**
+ * @brief co_await resume_on(scheduler) continue coroutine on scheduler worker
+ * @param[in] scheduler target scheduler
+ * @param[in] thread exec thread, -1 means any thread
+ */
+inline detail::ScheduleAwaiter resume_on(Scheduler* scheduler, int thread = -1) {
+    return detail::ScheduleAwaiter{scheduler, thread};
+}
+
+/**
+ * @brief co_await run_in_fiber(scheduler, func) run blocking or yielding func in fiber,
+ * coroutine is resumed with its result
+ */
+template <typename F>
+detail::FiberAwaiter<std::decay_t<F>> run_in_fiber(Scheduler* scheduler, F && func) {
+    return detail::FiberAwaiter<std::decay_t<F>>{scheduler, std::forward<F>(func)};
+}
+
+/**
+ * @brief start task on scheduler, frame is destroyed when task finish
+ */
+inline void spawn(Scheduler* scheduler, Task<void> task, int thread = -1) {
+    auto handle = task.release();
+    if (!handle)
+        return;
+    handle.promise().detached_ = true;
+    scheduler->schedule(&detail::resume_coroutine, handle.address(), thread);
+}
+
+/**
+ * @brief wait task in fiber, fiber is hold until task finish,
+ * should be called by fiber running on scheduler
+ */
+template <typename T>
+T await_in_fiber(Task<T> task) {
+    Scheduler* scheduler = Scheduler::get_thread_scheduler();
+    Fiber::ptr fiber = Fiber::get_thread_current_fiber();
+    if (scheduler == nullptr || fiber == Fiber::get_thread_main_fiber())
+        throw std::logic_error("await_in_fiber must be called by scheduler fiber");
+    // frame of wrapper share result, it may still hold it when fiber is resumed
+    auto result = std::make_shared<detail::AwaitResult<T>>();
+    // shared stack fiber can only resume on this worker, band and deadline are kept too
+    spawn(scheduler, detail::wake_fiber_when_done(std::move(task), result,
+        scheduler, fiber, Scheduler::get_resume_hint(fiber)));
+    fiber->hold();
+    if (result->exception)
+        std::rethrow_exception(result->exception);
+    if constexpr (!std::is_void_v<T>)
+        return std::move(*result->value);
+}
+
+}
+
+#endif
+
+#endif
@@ -26,6 +26,44 @@ void Thread::run() {
         ARIS_LOG_FMT_ERROR("create failed, thread name: %s, err: %s", name_.c_str(), strerror(errno));
 }
 
+bool Thread::set_affinity(const std::vector<int> & cpus) {
+    cpus_ = cpus;
+    // not started yet, bind in wrap before func run
+    if (thread_id_ == 0)
+        return true;
+    return apply_affinity(thread_id_, cpus_);
+}
+
+bool Thread::set_current_affinity(const std::vector<int> & cpus) {
+    return apply_affinity(pthread_self(), cpus);
+}
+
+bool Thread::apply_affinity(pthread_t thread_id, const std::vector<int> & cpus) {
+    if (cpus.empty())
+        return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    int err = pthread_setaffinity_np(thread_id, sizeof(set), &set);
+    if (err != 0) {
+        ARIS_LOG_FMT_WARN("set thread affinity failed, err: %s", strerror(err));
+        return false;
+    }
+    return true;
+}
+
+void Thread::join() {
+    if (thread_id_ == 0)
+        return;
+    int err = pthread_join(thread_id_, nullptr);
+    if (err != 0)
+        ARIS_LOG_FMT_ERROR("pthread join failed, thread name: %s, err: %s", name_.c_str(), strerror(err));
+    thread_id_ = 0;
+}
+
 // stop thread
 void Thread::stop() {
     if (thread_id_ == 0) 
@@ -53,6 +91,8 @@ void *Thread::wrap(void *arg) {
     int err = pthread_setname_np(thread->thread_id_, thread->name_.c_str());
     if (err == 0) 
         ARIS_LOG_FMT_ERROR("set thread name failed, thread id: %d, error: %s", thread->thread_id_, strerror(errno));
+    // bind before func run, memory first touched by func is then local to its cpus
+    apply_affinity(pthread_self(), thread->cpus_);
     if (thread->cb_)
         thread->cb_();
     return (void*)1;
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <memory>
 #include <cstring>
+#include <vector>
 
 
 namespace aris {
@@ -45,6 +46,25 @@ public:
      * @param[in] name thread name 
      */
     void reset(std::function<void(void)>cb, const std::string & name);
+    /**
+     * @brief bind thread to cpus, take effect when thread start if it is not running yet
+     * @param[in] cpus cpu ids, empty means no binding
+     * @return false if binding failed
+     */
+    bool set_affinity(const std::vector<int> & cpus);
+
+    /**
+     * @brief bind calling thread to cpus
+     * @param[in] cpus cpu ids, empty means no binding
+     * @return false if binding failed
+     */
+    static bool set_current_affinity(const std::vector<int> & cpus);
+
+    /**
+     * @brief wait thread to exit, thread can run again after join
+     */
+    void join();
+
     /**
      * @brief get thread id
      */
@@ -61,6 +81,11 @@ public:
     bool operator==(Thread & thread);
 
 private:
+    /**
+     * @brief apply cpu binding to thread
+     */
+    static bool apply_affinity(pthread_t thread_id, const std::vector<int> & cpus);
+
     /**
      * @brief wrap exec func
      * 
@@ -77,6 +102,8 @@ private:
     pthread_t thread_id_ {0};
     /// proc id
     pid_t proc_id {0};
+    /// cpus thread is bound to
+    std::vector<int> cpus_ {};
 };
 
 
@@ -0,0 +1,297 @@
+#include "timer.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace aris {
+
+/// level 0 has 256 slots, upper levels 64
+static int get_level_bits(int level) {
+    return level == 0 ? 8 : 6;
+}
+
+/// tick width of level slot is 1 << shift
+static int get_level_shift(int level) {
+    return level == 0 ? 0 : 8 + 6 * (level - 1);
+}
+
+/**
+ * @brief get distance from start to first non empty slot, wrap around at size
+ * @return -1 if all slots are empty
+ */
+static int find_slot(const std::vector<uint64_t> & bitmap, int size, int start) {
+    for (int distance = 0; distance < size; ) {
+        int slot = (start + distance) & (size - 1);
+        uint64_t word = bitmap[slot >> 6] >> (slot & 63);
+        if (word != 0)
+            return distance + __builtin_ctzll(word);
+        distance += 64 - (slot & 63);
+    }
+    return -1;
+}
+
+static void on_condition_timer(std::weak_ptr<void> cond, std::function<void()> cb) {
+    std::shared_ptr<void> tmp = cond.lock();
+    if (tmp)
+        cb();
+}
+
+Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
+    : ms_(ms), recurring_(recurring), cb_(std::move(cb)), manager_(manager) {
+    expire_ = manager_->get_now_ms() + ms_;
+}
+
+bool Timer::cancel() {
+    ptr self;
+    bool empty = false;
+    {
+        Mutex::Lock lock(manager_->mutex_);
+        if (!cb_)
+            return false;
+        cb_ = nullptr;
+        manager_->unlink(this);
+        self.swap(self_);
+        empty = manager_->count_ == 0;
+    }
+    if (empty)
+        manager_->on_timer_front_changed();
+    return true;
+}
+
+bool Timer::refresh() {
+    bool front = false;
+    {
+        Mutex::Lock lock(manager_->mutex_);
+        if (!cb_)
+            return false;
+        manager_->unlink(this);
+        expire_ = manager_->get_now_ms() + ms_;
+        front = manager_->add(this);
+    }
+    if (front)
+        manager_->on_timer_front_changed();
+    return true;
+}
+
+bool Timer::reset(uint64_t ms, bool from_now) {
+    if (ms == ms_ && !from_now)
+        return true;
+    bool front = false;
+    {
+        Mutex::Lock lock(manager_->mutex_);
+        if (!cb_)
+            return false;
+        manager_->unlink(this);
+        uint64_t start = from_now ? manager_->get_now_ms() : expire_ - ms_;
+        ms_ = ms;
+        expire_ = start + ms_;
+        front = manager_->add(this);
+    }
+    if (front)
+        manager_->on_timer_front_changed();
+    return true;
+}
+
+uint64_t TimerManager::get_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TimerManager::TimerManager() {
+    for (int level = 0; level < wheel_levels; level++) {
+        int size = 1 << get_level_bits(level);
+        slots_[level].assign(size, nullptr);
+        bitmaps_[level].assign((size + 63) / 64, 0);
+    }
+    current_ = get_now_ms();
+}
+
+TimerManager::~TimerManager() {
+    // timers left in wheel hold themselves, release them after lock
+    std::vector<Timer::ptr> timers;
+    Mutex::Lock lock(mutex_);
+    for (int level = 0; level < wheel_levels; level++) {
+        for (Timer*& head : slots_[level]) {
+            for (Timer* timer = head; timer != nullptr; ) {
+                Timer* next = timer->next_;
+                timer->prev_ = timer->next_ = nullptr;
+                timer->level_ = timer->slot_ = -1;
+                timer->cb_ = nullptr;
+                timers.emplace_back(std::move(timer->self_));
+                timer = next;
+            }
+            head = nullptr;
+        }
+    }
+    count_ = 0;
+    lock.unlock();
+}
+
+Timer::ptr TimerManager::add_timer(uint64_t ms, std::function<void()> cb, bool recurring) {
+    Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this));
+    bool front = false;
+    {
+        Mutex::Lock lock(mutex_);
+        timer->self_ = timer;
+        front = add(timer.get());
+    }
+    if (front)
+        on_timer_front_changed();
+    return timer;
+}
+
+Timer::ptr TimerManager::add_condition_timer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> cond, bool recurring) {
+    return add_timer(ms, std::bind(&on_condition_timer, std::move(cond), std::move(cb)), recurring);
+}
+
+uint64_t TimerManager::get_next_timer() {
+    Mutex::Lock lock(mutex_);
+    uint64_t tick = get_next_tick();
+    wake_tick_ = tick;
+    if (tick == ~0ull)
+        return ~0ull;
+    uint64_t now = get_now_ms();
+    return tick > now ? tick - now : 0;
+}
+
+void TimerManager::list_expired_cbs(std::vector<std::function<void()>> & cbs) {
+    uint64_t now = get_now_ms();
+    std::vector<Timer::ptr> expired;
+    Mutex::Lock lock(mutex_);
+    while (current_ <= now) {
+        if (count_ == 0) {
+            current_ = now + 1;
+            break;
+        }
+        int index = current_ & 255;
+        // level 0 wrap, pull next slot of upper level down, and so on if it wrap too
+        if (index == 0) {
+            for (int level = 1; level < wheel_levels && cascade(level) == 0; level++) {
+            }
+        }
+        Timer* timer = slots_[0][index];
+        slots_[0][index] = nullptr;
+        bitmaps_[0][index >> 6] &= ~(1ull << (index & 63));
+        while (timer != nullptr) {
+            Timer* next = timer->next_;
+            timer->prev_ = timer->next_ = nullptr;
+            timer->level_ = timer->slot_ = -1;
+            count_--;
+            expired.emplace_back(std::move(timer->self_));
+            timer = next;
+        }
+        current_++;
+        // skip empty ticks, stop at next wrap so upper levels cascade in time
+        int start = current_ & 255;
+        if (start != 0) {
+            int distance = find_slot(bitmaps_[0], 256, start);
+            uint64_t next = (distance < 0 || start + distance > 255) ? (current_ | 255) + 1 : current_ + distance;
+            current_ = std::min(next, now + 1);
+        }
+    }
+    for (auto & timer : expired) {
+        cbs.push_back(timer->cb_);
+        if (timer->recurring_) {
+            timer->expire_ = now + timer->ms_;
+            timer->self_ = timer;
+            link(timer.get());
+        } else {
+            timer->cb_ = nullptr;
+        }
+    }
+}
+
+bool TimerManager::has_timer() {
+    Mutex::Lock lock(mutex_);
+    return count_ > 0;
+}
+
+void TimerManager::link(Timer* timer) {
+    // expired timer fire on next tick
+    uint64_t expire = std::max(timer->expire_, current_);
+    uint64_t delta = expire - current_;
+    int level = 0;
+    while (level < wheel_levels - 1 && (delta >> (get_level_shift(level) + get_level_bits(level))) != 0)
+        level++;
+    int shift = get_level_shift(level);
+    int bits = get_level_bits(level);
+    // beyond top level, park at its far end, cascade put it back later
+    if ((delta >> (shift + bits)) != 0)
+        expire = current_ + (1ull << (shift + bits)) - 1;
+    int slot = (expire >> shift) & ((1 << bits) - 1);
+    Timer*& head = slots_[level][slot];
+    timer->prev_ = nullptr;
+    timer->next_ = head;
+    if (head != nullptr)
+        head->prev_ = timer;
+    head = timer;
+    bitmaps_[level][slot >> 6] |= 1ull << (slot & 63);
+    timer->level_ = level;
+    timer->slot_ = slot;
+    count_++;
+}
+
+void TimerManager::unlink(Timer* timer) {
+    if (timer->level_ < 0)
+        return;
+    int level = timer->level_;
+    int slot = timer->slot_;
+    if (timer->prev_ != nullptr)
+        timer->prev_->next_ = timer->next_;
+    else
+        slots_[level][slot] = timer->next_;
+    if (timer->next_ != nullptr)
+        timer->next_->prev_ = timer->prev_;
+    if (slots_[level][slot] == nullptr)
+        bitmaps_[level][slot >> 6] &= ~(1ull << (slot & 63));
+    timer->prev_ = timer->next_ = nullptr;
+    timer->level_ = timer->slot_ = -1;
+    count_--;
+}
+
+bool TimerManager::add(Timer* timer) {
+    link(timer);
+    if (timer->expire_ >= wake_tick_)
+        return false;
+    wake_tick_ = timer->expire_;
+    return true;
+}
+
+int TimerManager::cascade(int level) {
+    int shift = get_level_shift(level);
+    int index = (current_ >> shift) & ((1 << get_level_bits(level)) - 1);
+    Timer* timer = slots_[level][index];
+    slots_[level][index] = nullptr;
+    bitmaps_[level][index >> 6] &= ~(1ull << (index & 63));
+    while (timer != nullptr) {
+        Timer* next = timer->next_;
+        timer->level_ = -1;
+        count_--;
+        link(timer);
+        timer = next;
+    }
+    return index;
+}
+
+uint64_t TimerManager::get_next_tick() {
+    if (count_ == 0)
+        return ~0ull;
+    uint64_t next = ~0ull;
+    int distance = find_slot(bitmaps_[0], 256, current_ & 255);
+    if (distance >= 0)
+        next = current_ + distance;
+    // upper slot cascade when time reach its start, current slot is done unless we stand at its start
+    for (int level = 1; level < wheel_levels; level++) {
+        int shift = get_level_shift(level);
+        int size = 1 << get_level_bits(level);
+        uint64_t first = current_ >> shift;
+        if ((current_ & ((1ull << shift) - 1)) != 0)
+            first++;
+        distance = find_slot(bitmaps_[level], size, first & (size - 1));
+        if (distance >= 0)
+            next = std::min(next, (first + distance) << shift);
+    }
+    return next;
+}
+
+}
@@ -0,0 +1,176 @@
+/**
+ * @file timer.h
+ * @author aris
+ * @brief timers kept in hierarchical timing wheel
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_TIMER_H__
+#define __STUDY_SRC_TIMER_H__
+
+#include "noncopable.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace aris {
+
+class TimerManager;
+
+/**
+ * @brief one shot or recurring timer, manager keep it alive until it fire or is cancelled
+ */
+class Timer : public std::enable_shared_from_this<Timer>, Noncopable {
+friend class TimerManager;
+public:
+    typedef std::shared_ptr<Timer> ptr;
+
+    /**
+     * @brief cancel timer
+     * @return false if timer already fired or cancelled
+     */
+    bool cancel();
+
+    /**
+     * @brief restart timer from now with same period
+     */
+    bool refresh();
+
+    /**
+     * @brief change period of timer
+     * @param[in] ms new period in milliseconds
+     * @param[in] from_now restart from now, otherwise from last start
+     */
+    bool reset(uint64_t ms, bool from_now);
+
+private:
+    Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
+
+private:
+    /// period in milliseconds
+    uint64_t ms_ {0};
+    /// expire time in milliseconds of steady clock
+    uint64_t expire_ {0};
+    bool recurring_ {false};
+    std::function<void()> cb_ {nullptr};
+    TimerManager* manager_ {nullptr};
+
+    /// slot list links, level is -1 if timer is not in wheel
+    Timer* prev_ {nullptr};
+    Timer* next_ {nullptr};
+    int level_ {-1};
+    int slot_ {-1};
+    /// hold by wheel while timer is in it
+    ptr self_ {nullptr};
+};
+
+/**
+ * @brief timers in hierarchical timing wheel of 1 millisecond tick, add and cancel is O(1).
+ * level 0 has 256 slots of 1 tick, each upper level has 64 slots 64 times wider,
+ * timers cascade down when time reach their slot
+ */
+class TimerManager : Noncopable {
+friend class Timer;
+public:
+    TimerManager();
+    virtual ~TimerManager();
+
+    /**
+     * @brief add timer
+     * @param[in] ms timeout in milliseconds
+     * @param[in] cb func called when timer fire
+     * @param[in] recurring fire every ms until cancelled
+     */
+    Timer::ptr add_timer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+
+    /**
+     * @brief add timer which only fire if cond is still alive
+     * @param[in] ms timeout in milliseconds
+     * @param[in] cb func called when timer fire
+     * @param[in] cond weak pointer checked before cb
+     * @param[in] recurring fire every ms until cancelled
+     */
+    Timer::ptr add_condition_timer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> cond, bool recurring = false);
+
+    /**
+     * @brief get milliseconds before timers should be checked again, ~0ull if no timer,
+     * it may be earlier than next expire when upper level slot should cascade
+     */
+    uint64_t get_next_timer();
+
+    /**
+     * @brief take funcs of expired timers, recurring timers are added again
+     * @param[out] cbs expired funcs
+     */
+    void list_expired_cbs(std::vector<std::function<void()>> & cbs);
+
+    /**
+     * @brief check if any timer is waiting
+     */
+    bool has_timer();
+
+protected:
+    /**
+     * @brief called when timer is added before current wait deadline,
+     * or last timer is cancelled, waiter should check timers again
+     */
+    virtual void on_timer_front_changed() = 0;
+
+    /**
+     * @brief get current time in milliseconds timers count from, steady clock by default
+     */
+    virtual uint64_t get_now_ms();
+
+private:
+    /**
+     * @brief put timer in slot by its expire time, lock should be held
+     */
+    void link(Timer* timer);
+
+    /**
+     * @brief remove timer from its slot, lock should be held
+     */
+    void unlink(Timer* timer);
+
+    /**
+     * @brief add timer to wheel, lock should be held
+     * @return true if waiter should be notified
+     */
+    bool add(Timer* timer);
+
+    /**
+     * @brief move timers of upper level slot down
+     * @return slot index
+     */
+    int cascade(int level);
+
+    /**
+     * @brief get next tick some slot should be processed, lock should be held
+     */
+    uint64_t get_next_tick();
+
+private:
+    static const int wheel_levels = 5;
+
+    Mutex mutex_;
+    /// slot list heads of each level
+    std::vector<Timer*> slots_[wheel_levels];
+    /// non empty slots of each level
+    std::vector<uint64_t> bitmaps_[wheel_levels];
+    /// next tick to process
+    uint64_t current_ {0};
+    size_t count_ {0};
+    /// tick waiter wake up at, timer before it need notify
+    uint64_t wake_tick_ {~0ull};
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "uring.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace aris {
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+Uring::Uring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = io_uring_setup(entries, &params);
+    if (fd < 0) {
+        ARIS_LOG_FMT_WARN("setup io_uring failed, err: %s", strerror(errno));
+        return;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        ARIS_LOG_FMT_WARN("map io_uring sq ring failed, err: %s", strerror(errno));
+        sq_ring_ = nullptr;
+        close(fd);
+        return;
+    }
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            ARIS_LOG_FMT_WARN("map io_uring cq ring failed, err: %s", strerror(errno));
+            cq_ring_ = nullptr;
+            munmap(sq_ring_, sq_ring_size_);
+            sq_ring_ = nullptr;
+            close(fd);
+            return;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        ARIS_LOG_FMT_WARN("map io_uring sqes failed, err: %s", strerror(errno));
+        if (cq_ring_ != sq_ring_)
+            munmap(cq_ring_, cq_ring_size_);
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = cq_ring_ = nullptr;
+        close(fd);
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_flags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqe_head_ = sqe_tail_ = *sq_tail_;
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    fd_ = fd;
+}
+
+Uring::~Uring() {
+    if (sqes_ != nullptr)
+        munmap(sqes_, sqes_size_);
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+        munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != nullptr)
+        munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool Uring::probe() {
+    if (fd_ < 0)
+        return false;
+    static const int ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_ACCEPT, IORING_OP_FSYNC,
+        IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED};
+    size_t size = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+    std::vector<char> buffer(size, 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    // probe itself came with read and write ops
+    if (io_uring_register(fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) != 0)
+        return false;
+    for (int op : ops) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+io_uring_sqe* Uring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_)
+        return nullptr;
+    io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    sqe_tail_++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int Uring::submit() {
+    unsigned tail = *sq_tail_;
+    for (; sqe_head_ != sqe_tail_; sqe_head_++, tail++)
+        sq_array_[tail & sq_mask_] = sqe_head_ & sq_mask_;
+    // entries are written before kernel see new tail
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    // kernel consume published entries it did not take last time too
+    unsigned to_submit = tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (to_submit == 0)
+        return 0;
+    int submitted = 0;
+    do {
+        submitted = io_uring_enter(fd_, to_submit, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+    return submitted;
+}
+
+bool Uring::flush_overflow() {
+#ifdef IORING_SQ_CQ_OVERFLOW
+    if (!(__atomic_load_n(sq_flags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+        return false;
+    return io_uring_enter(fd_, 0, 0, IORING_ENTER_GETEVENTS) >= 0;
+#else
+    return false;
+#endif
+}
+
+bool Uring::register_buffers(const std::vector<iovec> & buffers) {
+    io_uring_register(fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    if (buffers.empty())
+        return true;
+    return io_uring_register(fd_, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0;
+}
+
+bool Uring::register_files(const std::vector<int> & fds) {
+    io_uring_register(fd_, IORING_UNREGISTER_FILES, nullptr, 0);
+    if (fds.empty())
+        return true;
+    return io_uring_register(fd_, IORING_REGISTER_FILES, fds.data(), fds.size()) == 0;
+}
+
+}
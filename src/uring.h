@@ -0,0 +1,159 @@
+/**
+ * @file uring.h
+ * @author aris
+ * @brief io_uring instance driven by raw syscalls
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_URING_H__
+#define __STUDY_SRC_URING_H__
+
+#include "noncopable.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief one io_uring, submission queue is filled by one thread,
+ * completion queue can be reaped by any thread under lock
+ */
+class Uring : Noncopable {
+public:
+    typedef std::shared_ptr<Uring> ptr;
+
+    /**
+     * @brief setup ring, check is_valid after
+     * @param[in] entries submission queue size, rounded up to power of 2 by kernel
+     */
+    explicit Uring(unsigned entries);
+
+    ~Uring();
+
+    /**
+     * @brief check if ring is set up
+     */
+    bool is_valid() const { return fd_ >= 0; }
+
+    /**
+     * @brief get ring fd, readable when completion queue is not empty
+     */
+    int get_fd() const { return fd_; }
+
+    /**
+     * @brief check if kernel support opcodes used by IOManager,
+     * read, write, accept, fsync and their fixed buffer variants
+     */
+    bool probe();
+
+    /**
+     * @brief get free submission entry, it is cleared and submitted by next submit
+     * @return null if submission queue is full
+     */
+    io_uring_sqe* get_sqe();
+
+    /**
+     * @brief get count of entries got but not taken by kernel yet
+     */
+    unsigned get_pending() const { return sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE); }
+
+    /**
+     * @brief submit pending entries with one syscall, entries kernel did not take stay pending
+     * @return count of entries submitted, -1 if failed, errno is set
+     */
+    int submit();
+
+    /**
+     * @brief take all completions, no syscall needed
+     * @param[in] fn called with user data and result of each completion
+     * @param[in] wait block on lock if other thread is reaping, otherwise give up
+     * @return count of completions taken
+     */
+    template <typename Func>
+    size_t reap(Func fn, bool wait) {
+        if (wait)
+            cq_mutex_.lock();
+        else if (!cq_mutex_.try_lock())
+            return 0;
+        size_t count = 0;
+        while (true) {
+            unsigned head = *cq_head_;
+            // completions before tail are written
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            count += tail - head;
+            for (; head != tail; head++) {
+                const io_uring_cqe & cqe = cqes_[head & cq_mask_];
+                fn(cqe.user_data, cqe.res);
+            }
+            // kernel may reuse entries once head pass them
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            // completions kernel kept aside when queue was full come in after a syscall
+            if (!flush_overflow())
+                break;
+        }
+        cq_mutex_.unlock();
+        return count;
+    }
+
+    /**
+     * @brief register buffers for fixed buffer read and write, previous buffers are replaced
+     * @return false if failed, errno is set
+     */
+    bool register_buffers(const std::vector<iovec> & buffers);
+
+    /**
+     * @brief register fds, op with fixed file flag use index in this table instead of fd,
+     * previous fds are replaced
+     * @return false if failed, errno is set
+     */
+    bool register_files(const std::vector<int> & fds);
+
+private:
+    /**
+     * @brief move overflowed completions into queue
+     * @return false if nothing overflowed
+     */
+    bool flush_overflow();
+
+private:
+    int fd_ {-1};
+    /// mapped rings, cq shares sq mapping with single mmap feature
+    void* sq_ring_ {nullptr};
+    size_t sq_ring_size_ {0};
+    void* cq_ring_ {nullptr};
+    size_t cq_ring_size_ {0};
+    io_uring_sqe* sqes_ {nullptr};
+    size_t sqes_size_ {0};
+
+    /// submission queue, kernel move head, owner move tail
+    unsigned* sq_head_ {nullptr};
+    unsigned* sq_tail_ {nullptr};
+    unsigned* sq_array_ {nullptr};
+    unsigned* sq_flags_ {nullptr};
+    unsigned sq_mask_ {0};
+    unsigned sq_entries_ {0};
+    /// entries got by get_sqe, [head, tail) is not published to kernel yet
+    unsigned sqe_head_ {0};
+    unsigned sqe_tail_ {0};
+
+    /// completion queue, kernel move tail, reaper move head
+    unsigned* cq_head_ {nullptr};
+    unsigned* cq_tail_ {nullptr};
+    unsigned cq_mask_ {0};
+    io_uring_cqe* cqes_ {nullptr};
+    Mutex cq_mutex_;
+};
+
+}
+
+#endif
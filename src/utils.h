@@ -6,20 +6,28 @@
 #include "noncopable.h"
 #include "macro.h"
 
-#include "thread.h"
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <cstdarg>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <string>
+#include <linux/futex.h>
 #include <pthread.h>
 #include <sstream>
+#include <sys/syscall.h>
 #include <tuple>
+#include <unistd.h>
 
 namespace aris {
 
+/// avoid false sharing
+static const size_t cache_line_size = 64;
+
 class StringGenerator {
 public:
     static const std::string format(const std::string fmt, ...) {
@@ -80,6 +88,9 @@ public:
     void lock() {
         pthread_mutex_lock(&lock_);
     }
+    bool try_lock() {
+        return pthread_mutex_trylock(&lock_) == 0;
+    }
     void unlock() {
         pthread_mutex_unlock(&lock_);
     }
@@ -89,6 +100,58 @@ private:
 
 
 
+template<typename T>
+class ReadScopedLockImpl {
+public:
+    // read lock
+    ReadScopedLockImpl(T& lock): lock_(lock) {
+        lock_.rdlock();
+        is_locked_ = true;
+    }
+    // unlock
+    virtual~ReadScopedLockImpl() {
+        unlock();
+    }
+
+    void unlock() {
+        if (!is_locked_)
+            return;
+        lock_.unlock();
+        is_locked_ = false; 
+    }
+
+private:
+    bool is_locked_ {false};
+    T& lock_;
+};
+
+
+class RWMutex {
+public:
+    typedef ReadScopedLockImpl<RWMutex> ReadLock;
+    typedef ScopedLockImpl<RWMutex> Lock;
+    RWMutex() {
+        pthread_rwlock_init(&lock_, nullptr);
+    }
+    ~RWMutex() {
+        pthread_rwlock_destroy(&lock_);
+    }
+    void rdlock() {
+        pthread_rwlock_rdlock(&lock_);
+    }
+    // write lock
+    void lock() {
+        pthread_rwlock_wrlock(&lock_);
+    }
+    void unlock() {
+        pthread_rwlock_unlock(&lock_);
+    }
+private:
+    pthread_rwlock_t lock_;
+};
+
+
+
 template <typename T>
 class ScopedCondImpl {
 public:
@@ -96,11 +159,10 @@ public:
         lock();
     }
 
-    // wait
+    // wait, lock is held again when return
     void wait() {
         lock();
         cond_.wait();
-        unlock();
     }
 
     // signal
@@ -127,7 +189,7 @@ public:
     }
     
     ~ScopedCondImpl() {
-        signal();
+        unlock();
     }
 
 private:
@@ -179,6 +241,63 @@ private:
     pthread_cond_t cond_;
 };
 
+/**
+ * @brief park one thread on futex until other thread unpark it,
+ * unpark before park is kept, so next park return at once
+ */
+class Parker {
+public:
+    // block until unpark
+    void park() {
+        // notified -> empty, or empty -> parked
+        if (state_.fetch_sub(1, std::memory_order_acquire) == notified)
+            return;
+        while (true) {
+            syscall(SYS_futex, &state_, FUTEX_WAIT_PRIVATE, parked, nullptr, nullptr, 0);
+            int expected = notified;
+            if (state_.compare_exchange_strong(expected, empty, std::memory_order_acquire))
+                return;
+        }
+    }
+
+    // block until unpark or timeout, false if timed out
+    bool park_for(uint64_t timeout_ns) {
+        if (state_.fetch_sub(1, std::memory_order_acquire) == notified)
+            return true;
+        timespec timeout {static_cast<time_t>(timeout_ns / 1000000000), static_cast<long>(timeout_ns % 1000000000)};
+        while (true) {
+            long ret = syscall(SYS_futex, &state_, FUTEX_WAIT_PRIVATE, parked, &timeout, nullptr, 0);
+            int expected = notified;
+            if (state_.compare_exchange_strong(expected, empty, std::memory_order_acquire))
+                return true;
+            if (ret != 0 && errno == ETIMEDOUT) {
+                // unpark racing with timeout fail this, it is taken in next round
+                expected = parked;
+                if (state_.compare_exchange_strong(expected, empty, std::memory_order_acquire))
+                    return false;
+            }
+        }
+    }
+
+    // wake parked thread, or make next park return at once
+    void unpark() {
+        if (state_.exchange(notified, std::memory_order_release) == parked)
+            syscall(SYS_futex, &state_, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    // take pending unpark without blocking, true if there was one
+    bool try_consume() {
+        int expected = notified;
+        return state_.compare_exchange_strong(expected, empty, std::memory_order_acquire);
+    }
+
+private:
+    static const int parked = -1;
+    static const int empty = 0;
+    static const int notified = 1;
+    std::atomic<int> state_ {empty};
+};
+
 
 }
 
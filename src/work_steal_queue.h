@@ -0,0 +1,163 @@
+/**
+ * @file work_steal_queue.h
+ * @author aris
+ * @brief chase-lev work stealing deque
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_SRC_WORK_STEAL_QUEUE_H__
+#define __STUDY_SRC_WORK_STEAL_QUEUE_H__
+
+#include "noncopable.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace aris {
+
+/**
+ * @brief single owner deque, owner push and pop at bottom without lock,
+ * other threads steal from top. items should be trivially copyable, eg pointers
+ */
+template <typename T>
+class WorkStealQueue : Noncopable {
+    static_assert(std::is_trivially_copyable<T>::value, "item should be trivially copyable");
+
+public:
+    /**
+     * @brief Construct a new Work Steal Queue object
+     * @param[in] capacity init capacity, rounded up to power of 2, queue grow when full
+     */
+    explicit WorkStealQueue(size_t capacity = 256) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        array_.store(new Array(size), std::memory_order_relaxed);
+    }
+
+    ~WorkStealQueue() {
+        delete array_.load(std::memory_order_relaxed);
+        for (Array* array : garbage_)
+            delete array;
+    }
+
+    /**
+     * @brief push item at bottom, only called by owner
+     */
+    void push(T item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Array* array = array_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(array->capacity) - 1)
+            array = grow(array, top, bottom);
+        array->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief pop item at bottom, only called by owner
+     * @return false if queue is empty
+     */
+    bool pop(T & item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        // bottom must be visible before top is read, thieves do the opposite
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = array->get(bottom);
+        if (top == bottom) {
+            // last item, race with thieves
+            bool won = top_.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    /**
+     * @brief steal item at top, called by any thread
+     * @return false if queue is empty or lost race with others
+     */
+    bool steal(T & item) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return false;
+        Array* array = array_.load(std::memory_order_acquire);
+        item = array->get(top);
+        return top_.compare_exchange_strong(top, top + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief check if queue is empty, only a hint when called by others
+     */
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /**
+     * @brief get item count, only a hint when called by others
+     */
+    size_t size() const {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+private:
+    /**
+     * @brief circular array, items are atomic so thieves may read them while owner write
+     */
+    struct Array {
+        explicit Array(size_t size): capacity(size), mask(size - 1), items(new std::atomic<T>[size]) {}
+        ~Array() { delete[] items; }
+
+        T get(int64_t index) const {
+            return items[index & mask].load(std::memory_order_relaxed);
+        }
+        void put(int64_t index, T item) {
+            items[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        size_t capacity;
+        size_t mask;
+        std::atomic<T>* items;
+    };
+
+    // double array, old one is kept until queue is destroyed, thieves may still read it
+    Array* grow(Array* array, int64_t top, int64_t bottom) {
+        Array* bigger = new Array(array->capacity * 2);
+        for (int64_t index = top; index < bottom; index++)
+            bigger->put(index, array->get(index));
+        garbage_.push_back(array);
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    alignas(cache_line_size) std::atomic<int64_t> top_ {0};
+    alignas(cache_line_size) std::atomic<int64_t> bottom_ {0};
+    alignas(cache_line_size) std::atomic<Array*> array_ {nullptr};
+    std::vector<Array*> garbage_;
+};
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file bench_context.cc
+ * @author aris
+ * @brief context switch cost, build twice to compare backends:
+ *   default (asm on x86-64 and aarch64) and -DARIS_FIBER_USE_UCONTEXT
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "context.h"
+#include "fiber.h"
+#include "test.h"
+
+#include <cstdio>
+#include <vector>
+
+static aris::Context main_context;
+static aris::Context entry_context;
+
+static void context_entry() {
+    while (true)
+        aris::Context::swap(entry_context, main_context);
+}
+
+int main(int argc, char** argv) {
+    const uint64_t rounds = argc > 1 ? strtoull(argv[1], nullptr, 10) : 5000000;
+#ifdef ARIS_FIBER_USE_UCONTEXT
+    const char* backend = "ucontext";
+#else
+    const char* backend = "asm";
+#endif
+
+    // bare backend, one round is two switches
+    std::vector<char> stack(64 * 1024);
+    entry_context.make(stack.data(), stack.size(), context_entry);
+    uint64_t begin = aris::test_now_ns();
+    for (uint64_t round = 0; round < rounds; round++)
+        aris::Context::swap(main_context, entry_context);
+    uint64_t context_ns = aris::test_now_ns() - begin;
+
+    // fiber resume and yield, state and current fiber bookkeeping included
+    aris::Fiber::ptr fiber(new aris::Fiber([]() {
+        while (true)
+            aris::Fiber::get_thread_current_fiber()->yield();
+    }));
+    begin = aris::test_now_ns();
+    for (uint64_t round = 0; round < rounds; round++)
+        fiber->resume();
+    uint64_t fiber_ns = aris::test_now_ns() - begin;
+
+    printf("backend %s, %llu rounds\n", backend, static_cast<unsigned long long>(rounds));
+    printf("  context swap      %6.1f ns per switch\n", static_cast<double>(context_ns) / rounds / 2);
+    printf("  fiber resume+yield %6.1f ns per round\n", static_cast<double>(fiber_ns) / rounds);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file bench_mpmc_queue.cc
+ * @author aris
+ * @brief mpmc queue throughput against a locked deque
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "mpmc_queue.h"
+#include "test.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief baseline, same interface as MPMCQueue
+ */
+class LockedQueue {
+public:
+    explicit LockedQueue(size_t capacity): capacity_(capacity) {}
+
+    bool push(long & item) {
+        aris::Mutex::Lock lock(mutex_);
+        if (items_.size() >= capacity_)
+            return false;
+        items_.push_back(item);
+        return true;
+    }
+
+    bool pop(long & item) {
+        aris::Mutex::Lock lock(mutex_);
+        if (items_.empty())
+            return false;
+        item = items_.front();
+        items_.pop_front();
+        return true;
+    }
+
+private:
+    size_t capacity_;
+    aris::Mutex mutex_;
+    std::deque<long> items_;
+};
+
+// get ns per item moved from producers to consumers
+template <typename Queue>
+static double run(int producers, int consumers, long per_producer) {
+    Queue queue(4096);
+    const long total = producers * per_producer;
+    std::atomic<long> popped {0};
+    std::vector<std::thread> threads;
+    uint64_t begin = aris::test_now_ns();
+    for (int producer = 0; producer < producers; producer++) {
+        threads.emplace_back([&queue, per_producer]() {
+            for (long index = 0; index < per_producer; index++) {
+                while (!queue.push(index))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int consumer = 0; consumer < consumers; consumer++) {
+        threads.emplace_back([&queue, &popped, total]() {
+            long value = 0;
+            while (popped.load(std::memory_order_relaxed) < total) {
+                if (queue.pop(value))
+                    popped.fetch_add(1, std::memory_order_relaxed);
+                else
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (auto & thread : threads)
+        thread.join();
+    return static_cast<double>(aris::test_now_ns() - begin) / total;
+}
+
+int main(int argc, char** argv) {
+    const long per_producer = argc > 1 ? strtol(argv[1], nullptr, 10) : 1000000;
+    const int shapes[][2] = {{1, 1}, {4, 1}, {1, 4}, {4, 4}, {8, 8}};
+    printf("%ld items per producer, %u cpus\n", per_producer, std::thread::hardware_concurrency());
+    for (auto & shape : shapes) {
+        double mpmc = run<aris::MPMCQueue<long>>(shape[0], shape[1], per_producer);
+        double locked = run<LockedQueue>(shape[0], shape[1], per_producer);
+        printf("  %dp %dc  mpmc %6.1f ns  locked %6.1f ns per item\n", shape[0], shape[1], mpmc, locked);
+    }
+    return 0;
+}
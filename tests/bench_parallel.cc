@@ -0,0 +1,81 @@
+/**
+ * @file bench_parallel.cc
+ * @author aris
+ * @brief speedup of parallel for, reduce and sort over serial loops
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "parallel.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// enough work per index that chunk claim cost is small
+static double work(size_t index) {
+    double value = static_cast<double>(index);
+    for (int round = 0; round < 64; round++)
+        value = std::sqrt(value + round);
+    return value;
+}
+
+static void report(const char* name, uint64_t serial_ns, uint64_t parallel_ns) {
+    printf("  %-8s serial %8.2f ms  parallel %8.2f ms  speedup %5.2fx\n", name,
+        serial_ns / 1e6, parallel_ns / 1e6, static_cast<double>(serial_ns) / parallel_ns);
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000000;
+    const int threads = argc > 2 ? atoi(argv[2]) : 4;
+    aris::Scheduler scheduler(threads, "bench");
+    scheduler.start();
+    std::vector<double> output(count);
+    printf("%zu items on %d workers, calling thread help too\n", count, threads);
+
+    uint64_t begin = aris::test_now_ns();
+    for (size_t index = 0; index < count; index++)
+        output[index] = work(index);
+    uint64_t serial_ns = aris::test_now_ns() - begin;
+    begin = aris::test_now_ns();
+    aris::parallel_for(&scheduler, 0, count, [&output](size_t index) { output[index] = work(index); }, 1024);
+    report("for", serial_ns, aris::test_now_ns() - begin);
+
+    begin = aris::test_now_ns();
+    double serial_sum = 0;
+    for (size_t index = 0; index < count; index++)
+        serial_sum += work(index);
+    serial_ns = aris::test_now_ns() - begin;
+    begin = aris::test_now_ns();
+    double sum = aris::parallel_reduce<double>(&scheduler, 0, count, 0.0, work,
+        [](double a, double b) { return a + b; }, 1024);
+    report("reduce", serial_ns, aris::test_now_ns() - begin);
+    // sums differ only by rounding of chunk order
+    if (std::fabs(sum - serial_sum) > serial_sum * 1e-9)
+        printf("  reduce mismatch %f %f\n", sum, serial_sum);
+
+    std::mt19937 random(1);
+    std::vector<uint32_t> values(count);
+    for (auto & value : values)
+        value = random();
+    std::vector<uint32_t> copy = values;
+    begin = aris::test_now_ns();
+    std::sort(copy.begin(), copy.end());
+    serial_ns = aris::test_now_ns() - begin;
+    begin = aris::test_now_ns();
+    aris::parallel_sort(&scheduler, values.begin(), values.end());
+    report("sort", serial_ns, aris::test_now_ns() - begin);
+    if (values != copy)
+        printf("  sort mismatch\n");
+
+    scheduler.stop();
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file bench_schedule.cc
+ * @author aris
+ * @brief task dispatch cost through local queue and inject queue, per task and batched
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <unistd.h>
+#include <vector>
+
+static std::atomic<uint64_t> done {0};
+
+static void count_task(void*) {
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void wait_done(uint64_t count) {
+    while (done.load(std::memory_order_relaxed) < count)
+        usleep(100);
+}
+
+int main(int argc, char** argv) {
+    const uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    const int threads = argc > 2 ? atoi(argv[2]) : 4;
+    aris::Scheduler scheduler(threads, "bench");
+    scheduler.start();
+
+    // worker feed its own local queue, nodes are reused by the same thread
+    done = 0;
+    uint64_t begin = aris::test_now_ns();
+    scheduler.schedule([count]() {
+        aris::Scheduler* self = aris::Scheduler::get_thread_scheduler();
+        for (uint64_t index = 0; index < count; index++)
+            self->schedule(&count_task, nullptr);
+    });
+    wait_done(count);
+    uint64_t local_ns = aris::test_now_ns() - begin;
+
+    // outside thread feed inject queue, workers take batches
+    done = 0;
+    begin = aris::test_now_ns();
+    for (uint64_t index = 0; index < count; index++)
+        scheduler.schedule(&count_task, nullptr);
+    wait_done(count);
+    uint64_t inject_ns = aris::test_now_ns() - begin;
+
+    // fiber funcs, fiber cache and queue nodes both reused
+    done = 0;
+    begin = aris::test_now_ns();
+    for (uint64_t index = 0; index < count; index++)
+        scheduler.schedule([]() { done.fetch_add(1, std::memory_order_relaxed); });
+    wait_done(count);
+    uint64_t fiber_ns = aris::test_now_ns() - begin;
+
+    // same funcs submitted one by one, as one batch and by schedule_n,
+    // from outside the pool and from a worker
+    std::vector<std::function<void()>> funcs(count, []() { done.fetch_add(1, std::memory_order_relaxed); });
+    auto submit_each = [&scheduler, &funcs]() {
+        for (auto & func : funcs)
+            scheduler.schedule(func);
+    };
+    auto submit_batch = [&scheduler, &funcs]() {
+        scheduler.schedule_batch(funcs.begin(), funcs.end());
+    };
+    auto submit_n = [&scheduler, count]() {
+        scheduler.schedule_n(count, [](size_t) { done.fetch_add(1, std::memory_order_relaxed); });
+    };
+    auto time_outside = [count](const std::function<void()> & submit) {
+        done = 0;
+        uint64_t start = aris::test_now_ns();
+        submit();
+        wait_done(count);
+        return aris::test_now_ns() - start;
+    };
+    auto time_worker = [&scheduler, count](const std::function<void()> & submit) {
+        done = 0;
+        uint64_t start = aris::test_now_ns();
+        scheduler.schedule([&submit]() { submit(); });
+        // submitting task is not counted
+        wait_done(count);
+        return aris::test_now_ns() - start;
+    };
+    uint64_t outside_each_ns = time_outside(submit_each);
+    uint64_t outside_batch_ns = time_outside(submit_batch);
+    uint64_t outside_n_ns = time_outside(submit_n);
+    uint64_t worker_each_ns = time_worker(submit_each);
+    uint64_t worker_batch_ns = time_worker(submit_batch);
+    uint64_t worker_n_ns = time_worker(submit_n);
+
+    scheduler.stop();
+    printf("%llu tasks on %d workers\n", static_cast<unsigned long long>(count), threads);
+    printf("  local push   %6.1f ns per task\n", static_cast<double>(local_ns) / count);
+    printf("  inject push  %6.1f ns per task\n", static_cast<double>(inject_ns) / count);
+    printf("  fiber func   %6.1f ns per task\n", static_cast<double>(fiber_ns) / count);
+    printf("  submit and run, ns per task   each   batch      n\n");
+    printf("    outside                   %6.1f  %6.1f  %6.1f\n", static_cast<double>(outside_each_ns) / count,
+        static_cast<double>(outside_batch_ns) / count, static_cast<double>(outside_n_ns) / count);
+    printf("    worker                    %6.1f  %6.1f  %6.1f\n", static_cast<double>(worker_each_ns) / count,
+        static_cast<double>(worker_batch_ns) / count, static_cast<double>(worker_n_ns) / count);
+    return 0;
+}
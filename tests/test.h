@@ -0,0 +1,47 @@
+/**
+ * @file test.h
+ * @author aris
+ * @brief tiny check and timing helpers shared by tests and benches
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef __STUDY_TESTS_TEST_H__
+#define __STUDY_TESTS_TEST_H__
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * tests and benches are standalone programs, build one against src like
+ *   g++ -std=c++20 -O2 -Isrc tests/test_context.cc src/*.cc -lpthread -ldl   (src/main.cc excluded)
+ * a test exit with 0 when all checks pass
+ */
+
+/// check always run, ARIS_ASSERT is compiled out in release
+#define TEST_CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, #x); \
+            abort(); \
+        } \
+    } while (0)
+
+namespace aris {
+
+/**
+ * @brief get monotonic time in ns
+ */
+inline uint64_t test_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+#endif
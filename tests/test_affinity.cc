@@ -0,0 +1,166 @@
+/**
+ * @file test_affinity.cc
+ * @author aris
+ * @brief worker cpu binding by affinity mode, and tasks pinned to a worker run only there
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "cpu_topology.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <vector>
+
+using aris::CpuTopology;
+using aris::Fiber;
+using aris::Scheduler;
+
+static const int worker_count = 4;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(done.load() == count);
+}
+
+static std::vector<int> get_thread_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    TEST_CHECK(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0);
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// cpus each worker thread is allowed to run on
+static std::vector<std::vector<int>> get_worker_cpus(Scheduler & scheduler) {
+    std::vector<std::vector<int>> cpus(worker_count);
+    std::atomic<int> done {0};
+    for (int index = 0; index < worker_count; index++) {
+        scheduler.schedule([&cpus, &done, index]() {
+            cpus[index] = get_thread_cpus();
+            done++;
+        }, index);
+    }
+    wait_for(done, worker_count);
+    return cpus;
+}
+
+static std::vector<int> sorted(std::vector<int> cpus) {
+    std::sort(cpus.begin(), cpus.end());
+    return cpus;
+}
+
+// each worker on one cpu of its node, workers of a node take its cpus in turn
+static void test_cpu() {
+    Scheduler scheduler(worker_count, "cpu");
+    scheduler.set_affinity(Scheduler::Affinity::CPU);
+    scheduler.start();
+    std::vector<std::vector<int>> cpus = get_worker_cpus(scheduler);
+    std::vector<int> seen(CpuTopology::get_node_count(), 0);
+    int last_node = 0;
+    for (int index = 0; index < worker_count; index++) {
+        int node = scheduler.get_worker_node(index);
+        TEST_CHECK(node >= last_node && node < CpuTopology::get_node_count());
+        last_node = node;
+        const std::vector<int> & node_cpus = CpuTopology::get_node_cpus(node);
+        TEST_CHECK(cpus[index].size() == 1);
+        TEST_CHECK(cpus[index][0] == node_cpus[seen[node]++ % node_cpus.size()]);
+    }
+    TEST_CHECK(scheduler.stop());
+}
+
+// each worker on all cpus of its node, one worker override
+static void test_node() {
+    Scheduler scheduler(worker_count, "node");
+    scheduler.set_affinity(Scheduler::Affinity::NODE);
+    const std::vector<int> & all = CpuTopology::get_cpus();
+    scheduler.set_worker_cpus(1, {all.back()});
+    scheduler.start();
+    std::vector<std::vector<int>> cpus = get_worker_cpus(scheduler);
+    for (int index = 0; index < worker_count; index++) {
+        if (index == 1)
+            continue;
+        TEST_CHECK(cpus[index] == sorted(CpuTopology::get_node_cpus(scheduler.get_worker_node(index))));
+    }
+    TEST_CHECK(cpus[1] == std::vector<int>{all.back()});
+    TEST_CHECK(scheduler.get_worker_node(1) == CpuTopology::get_cpu_node(all.back()));
+    TEST_CHECK(scheduler.get_worker_node(-1) == -1 && scheduler.get_worker_node(worker_count) == -1);
+    TEST_CHECK(scheduler.stop());
+}
+
+// no binding keep mask of process
+static void test_none() {
+    std::vector<int> process = get_thread_cpus();
+    Scheduler scheduler(worker_count, "none");
+    scheduler.start();
+    for (auto & cpus : get_worker_cpus(scheduler))
+        TEST_CHECK(cpus == process);
+    TEST_CHECK(scheduler.stop());
+}
+
+// every kind of pinned task, from outside and from other worker, run on its worker only
+static void test_pinned() {
+    const int count = 200;
+    const int target = 2;
+    Scheduler scheduler(worker_count, "pinned");
+    scheduler.start();
+    std::atomic<int> done {0};
+    std::atomic<int> wrong {0};
+    auto check = [&done, &wrong, target]() {
+        if (Scheduler::get_thread_worker_index() != target)
+            wrong++;
+        done++;
+    };
+    struct Raw {
+        static void run(void* arg) { (*static_cast<std::function<void()>*>(arg))(); }
+    };
+    std::function<void()> raw = check;
+    auto push_all = [&scheduler, &check, &raw, target]() {
+        for (int index = 0; index < count; index++) {
+            scheduler.schedule(check, target);
+            scheduler.schedule(check, Scheduler::Priority::HIGH, target);
+            scheduler.schedule(check, Scheduler::Priority::LOW, target);
+            scheduler.schedule_deadline(check, std::chrono::steady_clock::now(), target);
+            scheduler.schedule(&Raw::run, &raw, target);
+            // fiber yield and come back to its worker
+            scheduler.schedule(Fiber::ptr(new Fiber([&check]() {
+                check();
+                Fiber::get_thread_current_fiber()->yield();
+                check();
+            })), target);
+        }
+    };
+    const int per_push = count * 7;
+    push_all();
+    wait_for(done, per_push);
+    scheduler.schedule(push_all, 0);
+    wait_for(done, per_push * 2);
+    TEST_CHECK(wrong.load() == 0);
+    TEST_CHECK(scheduler.stop());
+}
+
+int main() {
+    test_cpu();
+    test_node();
+    test_none();
+    test_pinned();
+    printf("test_affinity passed\n");
+    return 0;
+}
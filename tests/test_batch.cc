@@ -0,0 +1,134 @@
+/**
+ * @file test_batch.cc
+ * @author aris
+ * @brief every batched task run exactly once through global, pinned and local queues
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <unistd.h>
+#include <vector>
+
+using aris::Scheduler;
+
+static const int worker_count = 4;
+static const size_t task_count = 20000;
+
+// visit count and worker of each task
+struct Visits {
+    Visits() : counts(task_count), workers(task_count) {
+        for (size_t index = 0; index < task_count; index++) {
+            counts[index] = 0;
+            workers[index] = -2;
+        }
+    }
+
+    void visit(size_t index) {
+        workers[index] = Scheduler::get_thread_worker_index();
+        counts[index]++;
+        done++;
+    }
+
+    void wait() {
+        for (int round = 0; round < 1000 && done.load() < task_count; round++)
+            usleep(10000);
+        TEST_CHECK(done.load() == task_count);
+        // late duplicate would show up here
+        usleep(10000);
+        for (size_t index = 0; index < task_count; index++)
+            TEST_CHECK(counts[index].load() == 1);
+    }
+
+    std::vector<std::atomic<int>> counts;
+    std::vector<std::atomic<int>> workers;
+    std::atomic<size_t> done {0};
+};
+
+static std::vector<std::function<void()>> make_funcs(Visits & visits) {
+    std::vector<std::function<void()>> funcs;
+    funcs.reserve(task_count);
+    for (size_t index = 0; index < task_count; index++)
+        funcs.emplace_back([&visits, index]() { visits.visit(index); });
+    return funcs;
+}
+
+// outside thread push to global queue, any worker run them
+static void test_global() {
+    Scheduler scheduler(worker_count, "global");
+    scheduler.start();
+    Visits batch;
+    auto funcs = make_funcs(batch);
+    scheduler.schedule_batch(funcs.begin(), funcs.end());
+    batch.wait();
+    Visits n;
+    scheduler.schedule_n(task_count, [&n](size_t index) { n.visit(index); });
+    n.wait();
+    scheduler.stop();
+}
+
+// pinned batch run only on its worker, from outside and from other worker
+static void test_pinned() {
+    const int target = 2;
+    Scheduler scheduler(worker_count, "pinned");
+    scheduler.start();
+    Visits batch;
+    auto funcs = make_funcs(batch);
+    scheduler.schedule_batch(funcs.begin(), funcs.end(), target);
+    batch.wait();
+    Visits n;
+    scheduler.schedule([&scheduler, &n]() {
+        scheduler.schedule_n(task_count, [&n](size_t index) { n.visit(index); }, target);
+    }, 0);
+    n.wait();
+    for (size_t index = 0; index < task_count; index++) {
+        TEST_CHECK(batch.workers[index].load() == target);
+        TEST_CHECK(n.workers[index].load() == target);
+    }
+    scheduler.stop();
+}
+
+// worker push to its own queue, others steal
+static void test_local() {
+    Scheduler scheduler(worker_count, "local");
+    scheduler.start();
+    Visits batch;
+    auto funcs = make_funcs(batch);
+    scheduler.schedule([&scheduler, &funcs]() {
+        scheduler.schedule_batch(funcs.begin(), funcs.end());
+    });
+    batch.wait();
+    Visits n;
+    scheduler.schedule([&scheduler, &n]() {
+        scheduler.schedule_n(task_count, [&n](size_t index) { n.visit(index); });
+    });
+    n.wait();
+    scheduler.stop();
+}
+
+// empty batch push nothing
+static void test_empty() {
+    Scheduler scheduler(worker_count, "empty");
+    scheduler.start();
+    std::vector<std::function<void()>> funcs;
+    scheduler.schedule_batch(funcs.begin(), funcs.end());
+    scheduler.schedule_n(0, [](size_t) { TEST_CHECK(false); });
+    TEST_CHECK(scheduler.stop());
+}
+
+int main() {
+    test_global();
+    test_pinned();
+    test_local();
+    test_empty();
+    printf("test_batch passed\n");
+    return 0;
+}
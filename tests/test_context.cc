@@ -0,0 +1,128 @@
+/**
+ * @file test_context.cc
+ * @author aris
+ * @brief context switch correctness, build twice to cover both backends:
+ *   default (asm on x86-64 and aarch64) and -DARIS_FIBER_USE_UCONTEXT
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "context.h"
+#include "fiber.h"
+#include "test.h"
+
+#include <cfenv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+static aris::Context main_context;
+static aris::Context entry_context;
+static volatile uint64_t entry_count = 0;
+
+static void context_entry() {
+    while (true) {
+        entry_count++;
+        aris::Context::swap(entry_context, main_context);
+    }
+}
+
+// raw context round trip, values kept in callee saved registers survive each swap
+static void test_raw_swap() {
+    const size_t size = 64 * 1024;
+    std::vector<char> stack(size);
+    entry_context.make(stack.data(), size, context_entry);
+    uint64_t a = 1, b = 2, c = 3;
+    for (uint64_t round = 0; round < 100000; round++) {
+        aris::Context::swap(main_context, entry_context);
+        a += round; b ^= round; c *= 3;
+    }
+    TEST_CHECK(entry_count == 100000);
+    uint64_t ea = 1, eb = 2, ec = 3;
+    for (uint64_t round = 0; round < 100000; round++) {
+        ea += round; eb ^= round; ec *= 3;
+    }
+    TEST_CHECK(a == ea && b == eb && c == ec);
+    // saved stack pointer point into stack of switched out context
+    char* sp = static_cast<char*>(entry_context.get_stack_pointer());
+    if (sp != nullptr)
+        TEST_CHECK(sp > stack.data() && sp < stack.data() + size);
+}
+
+// float control state belong to each context
+static void test_float_state() {
+    int round_mode = -1;
+    aris::Fiber::ptr fiber(new aris::Fiber([&round_mode]() {
+        fesetround(FE_UPWARD);
+        aris::Fiber::get_thread_current_fiber()->yield();
+        round_mode = fegetround();
+    }));
+    fesetround(FE_TONEAREST);
+    fiber->resume();
+    TEST_CHECK(fegetround() == FE_TONEAREST);
+    fiber->resume();
+    TEST_CHECK(round_mode == FE_UPWARD);
+    fesetround(FE_TONEAREST);
+}
+
+// many fibers interleaved, each keep its own locals
+static void test_interleave(aris::Fiber::StackMode mode) {
+    const int count = 64;
+    const int rounds = 100;
+    std::vector<int> sums(count, 0);
+    std::vector<aris::Fiber::ptr> fibers;
+    for (int index = 0; index < count; index++) {
+        fibers.emplace_back(new aris::Fiber([index, &sums]() {
+            int local = index;
+            for (int round = 0; round < rounds; round++) {
+                local += index;
+                aris::Fiber::get_thread_current_fiber()->yield();
+            }
+            sums[index] = local;
+        }, 0, mode));
+    }
+    for (int round = 0; round <= rounds; round++) {
+        for (auto & fiber : fibers)
+            fiber->resume();
+    }
+    for (int index = 0; index < count; index++) {
+        TEST_CHECK(fibers[index]->get_fiber_state() == aris::Fiber::State::TERM);
+        TEST_CHECK(sums[index] == index * (rounds + 1));
+    }
+}
+
+// exception thrown and caught inside fiber unwind its own stack only
+static void test_exception() {
+    bool caught = false;
+    aris::Fiber::ptr fiber(new aris::Fiber([&caught]() {
+        try {
+            aris::Fiber::get_thread_current_fiber()->yield();
+            throw std::runtime_error("fiber");
+        } catch (const std::runtime_error &) {
+            caught = true;
+        }
+    }));
+    fiber->resume();
+    fiber->resume();
+    TEST_CHECK(caught);
+}
+
+int main() {
+#ifdef ARIS_FIBER_USE_UCONTEXT
+    printf("backend: ucontext\n");
+#else
+    printf("backend: asm\n");
+#endif
+    test_raw_swap();
+    test_float_state();
+    test_interleave(aris::Fiber::StackMode::PRIVATE);
+    test_interleave(aris::Fiber::StackMode::SHARED);
+    test_exception();
+    printf("test_context passed\n");
+    return 0;
+}
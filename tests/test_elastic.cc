@@ -0,0 +1,237 @@
+/**
+ * @file test_elastic.cc
+ * @author aris
+ * @brief elastic worker pool, bounds, resize, growth on wait, idle retirement and bound shared fibers
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <unistd.h>
+#include <vector>
+
+using aris::Fiber;
+using aris::Scheduler;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(10000);
+    TEST_CHECK(done.load() == count);
+}
+
+// count of slots whose thread is still in run loop
+static int running_count(Scheduler & scheduler) {
+    int count = 0;
+    for (auto & worker : scheduler.get_stats().workers)
+        count += worker.active ? 1 : 0;
+    return count;
+}
+
+static void wait_running(Scheduler & scheduler, int count) {
+    for (int round = 0; round < 1000 && running_count(scheduler) != count; round++)
+        usleep(1000);
+    TEST_CHECK(running_count(scheduler) == count);
+}
+
+static void spin_ms(uint64_t ms) {
+    uint64_t end = aris::test_now_ns() + ms * 1000000;
+    while (aris::test_now_ns() < end) {
+    }
+}
+
+// policy is checked against initial count and can not change after start
+static void test_bounds() {
+    Scheduler scheduler(2, "bounds");
+    Scheduler::ElasticPolicy policy;
+    policy.min_threads = 0;
+    policy.max_threads = 4;
+    TEST_CHECK(!scheduler.set_elastic_policy(policy));
+    policy.min_threads = 3;
+    TEST_CHECK(!scheduler.set_elastic_policy(policy));
+    policy.min_threads = 1;
+    policy.max_threads = 1;
+    TEST_CHECK(!scheduler.set_elastic_policy(policy));
+    policy.max_threads = 4;
+    TEST_CHECK(scheduler.set_elastic_policy(policy));
+    TEST_CHECK(scheduler.get_thread_count() == 4);
+    TEST_CHECK(scheduler.get_active_count() == 2);
+    scheduler.start();
+    TEST_CHECK(!scheduler.set_elastic_policy(policy));
+    TEST_CHECK(!scheduler.resize(0));
+    TEST_CHECK(!scheduler.resize(5));
+    TEST_CHECK(scheduler.get_active_count() == 2);
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(!scheduler.resize(2));
+}
+
+// pinned tasks follow slot, retired slot thread is joined and run again on growth
+static void test_resize() {
+    const int count = 200;
+    Scheduler scheduler(2, "resize");
+    Scheduler::ElasticPolicy policy;
+    policy.min_threads = 1;
+    policy.max_threads = 6;
+    TEST_CHECK(scheduler.set_elastic_policy(policy));
+    scheduler.start();
+    wait_running(scheduler, 2);
+    TEST_CHECK(scheduler.resize(6));
+    TEST_CHECK(scheduler.get_active_count() == 6);
+    wait_running(scheduler, 6);
+    std::atomic<int> done {0};
+    std::vector<int> workers(count, -2);
+    for (int index = 0; index < count; index++) {
+        scheduler.schedule([&workers, &done, index]() {
+            workers[index] = Scheduler::get_thread_worker_index();
+            done++;
+        }, 5);
+    }
+    wait_for(done, count);
+    TEST_CHECK(std::all_of(workers.begin(), workers.end(), [](int worker) { return worker == 5; }));
+    // highest slots leave first
+    TEST_CHECK(scheduler.resize(1));
+    TEST_CHECK(scheduler.get_active_count() == 1);
+    wait_running(scheduler, 1);
+    TEST_CHECK(scheduler.get_stats().workers[0].active);
+    // task pinned to retired slot run on the one left
+    done = 0;
+    for (int index = 0; index < count; index++) {
+        scheduler.schedule([&workers, &done, index]() {
+            workers[index] = Scheduler::get_thread_worker_index();
+            done++;
+        }, 5);
+    }
+    wait_for(done, count);
+    TEST_CHECK(std::all_of(workers.begin(), workers.end(), [](int worker) { return worker == 0; }));
+    // slot threads joined above start again
+    TEST_CHECK(scheduler.resize(6));
+    wait_running(scheduler, 6);
+    done = 0;
+    for (int index = 0; index < count; index++) {
+        scheduler.schedule([&workers, &done, index]() {
+            workers[index] = Scheduler::get_thread_worker_index();
+            done++;
+        }, 5);
+    }
+    wait_for(done, count);
+    TEST_CHECK(std::all_of(workers.begin(), workers.end(), [](int worker) { return worker == 5; }));
+    // shrink and grow before retiring workers leave keep them
+    TEST_CHECK(scheduler.resize(2));
+    TEST_CHECK(scheduler.resize(6));
+    TEST_CHECK(scheduler.get_active_count() == 6);
+    wait_running(scheduler, 6);
+    TEST_CHECK(scheduler.stop());
+}
+
+// long queue wait spawn workers up to max, parked workers retire down to min
+static void test_grow_retire() {
+    const int count = 200;
+    Scheduler scheduler(1, "grow");
+    Scheduler::ElasticPolicy policy;
+    policy.min_threads = 1;
+    policy.max_threads = 4;
+    policy.spawn_wait_us = 2000;
+    policy.retire_idle_ms = 50;
+    TEST_CHECK(scheduler.set_elastic_policy(policy));
+    scheduler.start();
+    std::atomic<int> done {0};
+    for (int index = 0; index < count; index++) {
+        scheduler.schedule([&done]() {
+            spin_ms(2);
+            done++;
+        });
+    }
+    int peak = 1;
+    for (int round = 0; round < 10000 && done.load() < count; round++) {
+        peak = std::max(peak, scheduler.get_active_count());
+        usleep(1000);
+    }
+    wait_for(done, count);
+    TEST_CHECK(peak > 1);
+    TEST_CHECK(peak <= 4);
+    // idle ones retire, never below min
+    for (int round = 0; round < 200 && scheduler.get_active_count() > 1; round++)
+        usleep(10000);
+    TEST_CHECK(scheduler.get_active_count() == 1);
+    wait_running(scheduler, 1);
+    TEST_CHECK(scheduler.stop());
+}
+
+// worker holding a live shared stack fiber is not retired until the fiber end
+static void test_bound() {
+    Scheduler scheduler(3, "bound");
+    Scheduler::ElasticPolicy policy;
+    policy.min_threads = 1;
+    policy.max_threads = 3;
+    policy.retire_idle_ms = 20;
+    TEST_CHECK(scheduler.set_elastic_policy(policy));
+    scheduler.start();
+    std::atomic<int> held {0};
+    std::atomic<int> ended {0};
+    std::atomic<int> worker {-1};
+    Fiber::ptr fiber(new Fiber([&held, &ended, &worker]() {
+        worker = Scheduler::get_thread_worker_index();
+        held++;
+        Fiber::get_thread_current_fiber()->hold();
+        // shared fiber come back to the thread its stack belong to
+        TEST_CHECK(Scheduler::get_thread_worker_index() == worker.load());
+        ended++;
+    }, 0, Fiber::StackMode::SHARED));
+    scheduler.schedule(fiber, 2);
+    wait_for(held, 1);
+    TEST_CHECK(worker.load() == 2);
+    // highest slot would leave first, bound one is skipped
+    TEST_CHECK(scheduler.resize(1));
+    wait_running(scheduler, 1);
+    TEST_CHECK(scheduler.get_stats().workers[2].active);
+    // idle retirement skip it too
+    TEST_CHECK(scheduler.resize(3));
+    usleep(200000);
+    TEST_CHECK(scheduler.get_active_count() == 1);
+    wait_running(scheduler, 1);
+    TEST_CHECK(scheduler.get_stats().workers[2].active);
+    // fiber end on its worker, it is free to go
+    scheduler.schedule(fiber);
+    wait_for(ended, 1);
+    TEST_CHECK(scheduler.resize(3));
+    TEST_CHECK(scheduler.resize(1));
+    wait_running(scheduler, 1);
+    TEST_CHECK(!scheduler.get_stats().workers[2].active);
+    TEST_CHECK(scheduler.stop());
+}
+
+// tasks queued on retiring workers are handed over and still run by stop
+static void test_stop_while_retiring() {
+    const int count = 10000;
+    Scheduler scheduler(4, "retiring");
+    Scheduler::ElasticPolicy policy;
+    policy.min_threads = 1;
+    policy.max_threads = 4;
+    TEST_CHECK(scheduler.set_elastic_policy(policy));
+    scheduler.start();
+    std::atomic<int> done {0};
+    for (int index = 0; index < count; index++)
+        scheduler.schedule([&done]() { done++; }, index % 4);
+    TEST_CHECK(scheduler.resize(1));
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(done.load() == count);
+}
+
+int main() {
+    test_bounds();
+    test_resize();
+    test_grow_retire();
+    test_bound();
+    test_stop_while_retiring();
+    printf("test_elastic passed\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file test_event.cc
+ * @author aris
+ * @brief iomanager fd events, fire once, del without firing, cancel firing at once
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "iomanager.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using aris::Fiber;
+using aris::IOManager;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(done.load() == count);
+}
+
+// waiter is scheduled before pending count drop
+static void wait_no_pending(IOManager & iom) {
+    for (int round = 0; round < 1000 && iom.get_pending_event_count() != 0; round++)
+        usleep(1000);
+    TEST_CHECK(iom.get_pending_event_count() == 0);
+}
+
+struct Pair {
+    Pair() { TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0); }
+    ~Pair() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    void send() { TEST_CHECK(write(fds[1], "x", 1) == 1); }
+
+    int fds[2];
+};
+
+// callback run once when data come, later data does not run it again
+static void test_fire(IOManager & iom) {
+    Pair pair;
+    std::atomic<int> fired {0};
+    TEST_CHECK(iom.add_event(pair.fds[0], IOManager::READ, [&fired]() { fired++; }));
+    TEST_CHECK(iom.get_pending_event_count() == 1);
+    usleep(10000);
+    TEST_CHECK(fired.load() == 0);
+    pair.send();
+    wait_for(fired, 1);
+    wait_no_pending(iom);
+    pair.send();
+    usleep(10000);
+    TEST_CHECK(fired.load() == 1);
+}
+
+// fiber hold after add is resumed by event
+static void test_fiber(IOManager & iom) {
+    Pair pair;
+    std::atomic<int> waiting {0};
+    std::atomic<int> done {0};
+    int fd = pair.fds[0];
+    iom.schedule([&iom, &waiting, &done, fd]() {
+        TEST_CHECK(iom.add_event(fd, IOManager::READ));
+        waiting++;
+        Fiber::get_thread_current_fiber()->hold();
+        char byte = 0;
+        TEST_CHECK(read(fd, &byte, 1) == 1 && byte == 'x');
+        done++;
+    });
+    wait_for(waiting, 1);
+    pair.send();
+    wait_for(done, 1);
+    wait_no_pending(iom);
+}
+
+// deleted waiter is dropped, not fired
+static void test_del(IOManager & iom) {
+    Pair pair;
+    std::atomic<int> fired {0};
+    TEST_CHECK(iom.add_event(pair.fds[0], IOManager::READ, [&fired]() { fired++; }));
+    TEST_CHECK(iom.del_event(pair.fds[0], IOManager::READ));
+    TEST_CHECK(!iom.del_event(pair.fds[0], IOManager::READ));
+    TEST_CHECK(iom.get_pending_event_count() == 0);
+    pair.send();
+    usleep(10000);
+    TEST_CHECK(fired.load() == 0);
+    // fd can be waited again after del
+    char byte = 0;
+    TEST_CHECK(read(pair.fds[0], &byte, 1) == 1);
+    TEST_CHECK(iom.add_event(pair.fds[0], IOManager::READ, [&fired]() { fired++; }));
+    TEST_CHECK(iom.cancel_event(pair.fds[0], IOManager::READ));
+    wait_for(fired, 1);
+}
+
+// cancelled waiter fire at once without data, held fiber is resumed
+static void test_cancel(IOManager & iom) {
+    Pair pair;
+    std::atomic<int> waiting {0};
+    std::atomic<int> done {0};
+    int fd = pair.fds[0];
+    iom.schedule([&iom, &waiting, &done, fd]() {
+        TEST_CHECK(iom.add_event(fd, IOManager::READ));
+        waiting++;
+        Fiber::get_thread_current_fiber()->hold();
+        char byte = 0;
+        TEST_CHECK(read(fd, &byte, 1) == -1);
+        done++;
+    });
+    wait_for(waiting, 1);
+    TEST_CHECK(iom.cancel_event(fd, IOManager::READ));
+    TEST_CHECK(!iom.cancel_event(fd, IOManager::READ));
+    wait_for(done, 1);
+    wait_no_pending(iom);
+}
+
+// read and write waited apart on one fd, cancel all fire what is left
+static void test_both(IOManager & iom) {
+    Pair pair;
+    std::atomic<int> reads {0};
+    std::atomic<int> writes {0};
+    int fd = pair.fds[0];
+    TEST_CHECK(iom.add_event(fd, IOManager::READ, [&reads]() { reads++; }));
+    TEST_CHECK(!iom.add_event(fd, IOManager::READ, [&reads]() { reads += 100; }));
+    // socket is writable, write waiter fire alone
+    TEST_CHECK(iom.add_event(fd, IOManager::WRITE, [&writes]() { writes++; }));
+    wait_for(writes, 1);
+    usleep(10000);
+    TEST_CHECK(reads.load() == 0);
+    TEST_CHECK(iom.get_pending_event_count() == 1);
+    TEST_CHECK(iom.cancel_all(fd));
+    TEST_CHECK(!iom.cancel_all(fd));
+    wait_for(reads, 1);
+    wait_no_pending(iom);
+}
+
+// bad arguments are refused
+static void test_invalid(IOManager & iom) {
+    Pair pair;
+    TEST_CHECK(!iom.add_event(pair.fds[0], IOManager::NONE, []() {}));
+    TEST_CHECK(!iom.add_event(-1, IOManager::READ, []() {}));
+    // main thread is no fiber that can hold
+    TEST_CHECK(!iom.add_event(pair.fds[0], IOManager::READ));
+    TEST_CHECK(!iom.del_event(pair.fds[0], IOManager::WRITE));
+    TEST_CHECK(!iom.cancel_event(pair.fds[0], IOManager::WRITE));
+    TEST_CHECK(iom.get_pending_event_count() == 0);
+}
+
+int main() {
+    IOManager iom(2, "event");
+    iom.start();
+    test_fire(iom);
+    test_fiber(iom);
+    test_del(iom);
+    test_cancel(iom);
+    test_both(iom);
+    test_invalid(iom);
+    TEST_CHECK(iom.stop());
+    printf("test_event passed\n");
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file test_fiber_local.cc
+ * @author aris
+ * @brief fiber local values stay with their fiber across switches and workers, freed when fiber end
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+using aris::Fiber;
+using aris::FiberLocal;
+using aris::Scheduler;
+
+static const int worker_count = 4;
+
+static std::atomic<int> live_values {0};
+
+// count live values, leaked or double freed value show up in count
+struct Value {
+    explicit Value(int id = 0) : id(id) { live_values++; }
+    Value(const Value & other) : id(other.id) { live_values++; }
+    Value & operator=(const Value & other) = default;
+    ~Value() { live_values--; }
+
+    int id;
+};
+
+static FiberLocal<Value> local_value;
+static FiberLocal<std::string> local_name;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(10000);
+    TEST_CHECK(done.load() == count);
+}
+
+// many fibers set own value then hop over all workers, each see only its own value
+static void test_isolation() {
+    const int count = 200;
+    const int hops = 8;
+    Scheduler scheduler(worker_count, "local");
+    scheduler.start();
+    std::atomic<int> done {0};
+    std::atomic<int> wrong {0};
+    std::atomic<int> moved {0};
+    for (int id = 0; id < count; id++) {
+        scheduler.schedule([&scheduler, &done, &wrong, &moved, id]() {
+            if (local_value.get() != nullptr || local_name.get() != nullptr)
+                wrong++;
+            local_value.set(Value(id));
+            local_name.set(std::to_string(id));
+            for (int hop = 0; hop < hops; hop++) {
+                // come back on next worker, other fibers run on this one meanwhile
+                int worker = Scheduler::get_thread_worker_index();
+                int next = (worker + 1) % worker_count;
+                scheduler.schedule(Fiber::get_thread_current_fiber(), next);
+                Fiber::get_thread_current_fiber()->hold();
+                if (Scheduler::get_thread_worker_index() != next)
+                    wrong++;
+                else
+                    moved++;
+                if (local_value.get() == nullptr || local_value.get()->id != id || *local_name.get() != std::to_string(id))
+                    wrong++;
+            }
+            done++;
+        });
+    }
+    wait_for(done, count);
+    TEST_CHECK(wrong.load() == 0);
+    TEST_CHECK(moved.load() == count * hops);
+    TEST_CHECK(scheduler.stop());
+    // values go with their fiber
+    TEST_CHECK(live_values.load() == 0);
+}
+
+// set again assign in place, reset free at once, thread main fiber has own values
+static void test_set_reset() {
+    local_value.set(Value(1));
+    Value* first = local_value.get();
+    local_value.set(Value(2));
+    TEST_CHECK(local_value.get() == first && first->id == 2);
+    TEST_CHECK(live_values.load() == 1);
+    Fiber::ptr fiber(new Fiber([]() {
+        TEST_CHECK(local_value.get() == nullptr);
+        local_value.set(Value(3));
+        Fiber::get_thread_current_fiber()->yield();
+        TEST_CHECK(local_value.get()->id == 3);
+        local_value.reset();
+        TEST_CHECK(local_value.get() == nullptr);
+        local_value.set(Value(4));
+    }));
+    fiber->resume();
+    TEST_CHECK(local_value.get()->id == 2);
+    TEST_CHECK(live_values.load() == 2);
+    fiber->resume();
+    // freed when fiber end, main value untouched
+    TEST_CHECK(live_values.load() == 1);
+    TEST_CHECK(local_value.get()->id == 2);
+    local_value.reset();
+    TEST_CHECK(live_values.load() == 0);
+}
+
+int main() {
+    test_isolation();
+    test_set_reset();
+    printf("test_fiber_local passed\n");
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file test_fiber_reuse.cc
+ * @author aris
+ * @brief term fiber reset with new func start clean, scheduler reuse cached fibers
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+using aris::Fiber;
+using aris::FiberLocal;
+using aris::Scheduler;
+
+static FiberLocal<int> local;
+
+// func and locals are released at term, reset start new func from the top
+static void test_reset() {
+    auto resource = std::make_shared<int>(1);
+    std::weak_ptr<int> watch = resource;
+    int step = 0;
+    Fiber::ptr fiber(new Fiber([resource, &step]() {
+        local.set(*resource);
+        step = 1;
+        Fiber::get_thread_current_fiber()->yield();
+        step = 2;
+    }));
+    resource.reset();
+    TEST_CHECK(fiber->resume() == Fiber::State::Ready);
+    // fiber not term can not be reset, old func go on
+    fiber->reset([&step]() { step = 100; });
+    TEST_CHECK(fiber->resume() == Fiber::State::TERM);
+    TEST_CHECK(step == 2);
+    TEST_CHECK(watch.expired());
+    fiber->reset([&step]() {
+        TEST_CHECK(local.get() == nullptr);
+        step = 3;
+    });
+    TEST_CHECK(fiber->get_fiber_state() == Fiber::State::Ready);
+    TEST_CHECK(fiber->resume() == Fiber::State::TERM);
+    TEST_CHECK(step == 3);
+    // fiber ended by exception is reusable too
+    fiber->reset([]() { throw std::runtime_error("fail"); });
+    TEST_CHECK(fiber->resume() == Fiber::State::TERM);
+    fiber->reset([&step]() { step = 4; });
+    TEST_CHECK(fiber->resume() == Fiber::State::TERM);
+    TEST_CHECK(step == 4);
+}
+
+// shared fiber is unbound at reset, next run may take stack of another thread
+static void test_reset_shared() {
+    int runs = 0;
+    Fiber::ptr fiber(new Fiber([&runs]() { runs++; }, 0, Fiber::StackMode::SHARED));
+    TEST_CHECK(fiber->resume() == Fiber::State::TERM);
+    fiber->reset([&runs]() {
+        Fiber::get_thread_current_fiber()->yield();
+        runs++;
+    });
+    TEST_CHECK(!fiber->is_stack_bound());
+    std::thread other([&fiber]() {
+        // plain thread need its main fiber to switch from, as worker does
+        Fiber::create_main_fiber();
+        TEST_CHECK(fiber->resume() == Fiber::State::Ready);
+        TEST_CHECK(fiber->is_stack_bound());
+        TEST_CHECK(fiber->resume() == Fiber::State::TERM);
+    });
+    other.join();
+    TEST_CHECK(runs == 2);
+}
+
+// one worker run tasks one by one, fibers come from its cache and start clean
+static void test_scheduler_cache() {
+    const int count = 1000;
+    Scheduler scheduler(1, "reuse");
+    scheduler.start();
+    std::set<Fiber*> fibers;
+    std::atomic<int> done {0};
+    std::atomic<int> wrong {0};
+    std::weak_ptr<int> last;
+    for (int index = 0; index < count; index++) {
+        auto resource = std::make_shared<int>(index);
+        scheduler.schedule([resource, &fibers, &done, &wrong, &last, index]() {
+            Fiber::ptr self = Fiber::get_thread_current_fiber();
+            // previous func is gone with all it captured
+            if (local.get() != nullptr || !last.expired() || self->get_fiber_state() != Fiber::State::RUNNING)
+                wrong++;
+            fibers.insert(self.get());
+            local.set(index);
+            last = resource;
+            done++;
+        });
+    }
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(done.load() == count);
+    TEST_CHECK(wrong.load() == 0);
+    TEST_CHECK(fibers.size() < static_cast<size_t>(count));
+    TEST_CHECK(scheduler.stop());
+}
+
+int main() {
+    test_reset();
+    test_reset_shared();
+    test_scheduler_cache();
+    printf("test_fiber_reuse passed\n");
+    return 0;
+}
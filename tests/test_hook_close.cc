@@ -0,0 +1,104 @@
+/**
+ * @file test_hook_close.cc
+ * @author aris
+ * @brief close wake fiber waiting on fd whatever thread call it
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "hook.h"
+#include "iomanager.h"
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using aris::IOManager;
+
+struct RecvResult {
+    std::atomic<int> fd {-1};
+    std::atomic<bool> done {false};
+    ssize_t ret {0};
+    int error {0};
+};
+
+// fiber on iom block in recv of an udp socket nobody send to
+static void start_receiver(IOManager & iom, RecvResult & result) {
+    iom.schedule([&result]() {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        TEST_CHECK(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        result.fd = fd;
+        char buffer[16];
+        result.ret = recv(fd, buffer, sizeof(buffer), 0);
+        result.error = errno;
+        result.done = true;
+    });
+    for (int round = 0; round < 1000 && iom.get_pending_event_count() == 0; round++)
+        usleep(1000);
+    TEST_CHECK(iom.get_pending_event_count() == 1);
+}
+
+static void check_woken(IOManager & iom, RecvResult & result) {
+    for (int round = 0; round < 1000 && !result.done.load(); round++)
+        usleep(1000);
+    TEST_CHECK(result.done.load());
+    TEST_CHECK(result.ret == -1 && result.error == EBADF);
+    // count drop right after waiter is scheduled, it may run first
+    for (int round = 0; round < 1000 && iom.get_pending_event_count() != 0; round++)
+        usleep(1000);
+    TEST_CHECK(iom.get_pending_event_count() == 0);
+}
+
+// thread out of any iomanager close fd
+static void test_close_from_plain_thread() {
+    IOManager iom(2, "close");
+    iom.set_hook_enable(true);
+    iom.start();
+    RecvResult result;
+    start_receiver(iom, result);
+    // hooks are per thread, enable them so close take the hooked path
+    aris::set_hook_enable(true);
+    close(result.fd);
+    aris::set_hook_enable(false);
+    check_woken(iom, result);
+    iom.stop();
+}
+
+// fiber of another iomanager close fd, events are cancelled on the owning one
+static void test_close_from_other_iomanager() {
+    IOManager iom(2, "owner");
+    IOManager other(1, "other");
+    iom.set_hook_enable(true);
+    other.set_hook_enable(true);
+    iom.start();
+    other.start();
+    RecvResult result;
+    start_receiver(iom, result);
+    std::atomic<bool> closed {false};
+    other.schedule([&result, &closed]() {
+        close(result.fd);
+        closed = true;
+    });
+    check_woken(iom, result);
+    TEST_CHECK(closed.load());
+    iom.stop();
+    other.stop();
+}
+
+int main() {
+    test_close_from_plain_thread();
+    test_close_from_other_iomanager();
+    printf("test_hook_close passed\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file test_mpmc_queue.cc
+ * @author aris
+ * @brief mpmc queue bounds and multi producer multi consumer stress
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "mpmc_queue.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// full queue refuse push without moving item, empty queue refuse pop
+static void test_bounds() {
+    aris::MPMCQueue<std::unique_ptr<int>> queue(5);
+    TEST_CHECK(queue.capacity() == 8);
+    for (int index = 0; index < 8; index++) {
+        std::unique_ptr<int> item(new int(index));
+        TEST_CHECK(queue.push(item));
+        TEST_CHECK(item == nullptr);
+    }
+    std::unique_ptr<int> extra(new int(8));
+    TEST_CHECK(!queue.push(extra));
+    TEST_CHECK(extra != nullptr);
+    TEST_CHECK(queue.size() == 8);
+    // fifo through several rounds of the ring
+    for (int round = 0; round < 3; round++) {
+        for (int index = 0; index < 8; index++) {
+            std::unique_ptr<int> item;
+            TEST_CHECK(queue.pop(item));
+            TEST_CHECK(*item == round * 8 + index);
+            item.reset(new int((round + 1) * 8 + index));
+            TEST_CHECK(queue.push(item));
+        }
+    }
+    std::unique_ptr<int> item;
+    for (int index = 0; index < 8; index++)
+        TEST_CHECK(queue.pop(item));
+    TEST_CHECK(!queue.pop(item));
+    TEST_CHECK(queue.empty());
+}
+
+// every pushed value is popped exactly once
+static void test_stress(int producers, int consumers, long per_producer) {
+    aris::MPMCQueue<long> queue(1024);
+    const long total = producers * per_producer;
+    std::vector<std::atomic<unsigned char>> seen(total);
+    for (auto & flag : seen)
+        flag = 0;
+    std::atomic<long> popped {0};
+    std::atomic<int> disorder {0};
+    std::vector<std::thread> threads;
+    for (int producer = 0; producer < producers; producer++) {
+        threads.emplace_back([&queue, producer, per_producer]() {
+            for (long index = 0; index < per_producer; index++) {
+                long value = producer * per_producer + index;
+                while (!queue.push(value))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int consumer = 0; consumer < consumers; consumer++) {
+        threads.emplace_back([&, producers, per_producer]() {
+            // last value seen of each producer
+            std::vector<long> last(producers, -1);
+            long value = 0;
+            while (popped.load(std::memory_order_relaxed) < total) {
+                if (!queue.pop(value)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                seen[value]++;
+                popped++;
+                long producer = value / per_producer;
+                if (value <= last[producer])
+                    disorder++;
+                last[producer] = value;
+            }
+        });
+    }
+    for (auto & thread : threads)
+        thread.join();
+    long lost = 0;
+    long duplicated = 0;
+    for (auto & flag : seen) {
+        if (flag == 0)
+            lost++;
+        else if (flag > 1)
+            duplicated++;
+    }
+    TEST_CHECK(popped.load() == total);
+    TEST_CHECK(lost == 0 && duplicated == 0);
+    // one consumer pop in queue order, so it see values of one producer increasing
+    TEST_CHECK(disorder.load() == 0);
+}
+
+int main() {
+    test_bounds();
+    test_stress(1, 1, 1000000);
+    test_stress(4, 1, 250000);
+    test_stress(1, 4, 1000000);
+    test_stress(8, 8, 200000);
+    test_stress(16, 16, 100000);
+    printf("test_mpmc_queue passed\n");
+    return 0;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file test_parallel.cc
+ * @author aris
+ * @brief parallel algorithms from outside thread, worker fiber and shared stack fiber
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "hook.h"
+#include "iomanager.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using aris::Fiber;
+using aris::IOManager;
+using aris::Scheduler;
+
+static const int worker_count = 4;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(10000);
+    TEST_CHECK(done.load() == count);
+}
+
+// run check on a worker fiber, calling fiber take part and hold while helpers finish
+static void run_in_fiber(Scheduler & scheduler, std::function<void()> check) {
+    std::atomic<int> done {0};
+    scheduler.schedule([&check, &done]() {
+        check();
+        done++;
+    });
+    wait_for(done, 1);
+}
+
+// each index is visited once whatever grain is
+static void check_for(Scheduler* scheduler) {
+    const size_t count = 100000;
+    for (size_t grain : {1, 7, 1000, 200000}) {
+        std::vector<std::atomic<int>> visits(count);
+        for (auto & visit : visits)
+            visit = 0;
+        aris::parallel_for(scheduler, 0, count, [&visits](size_t index) { visits[index]++; }, grain);
+        for (auto & visit : visits)
+            TEST_CHECK(visit.load() == 1);
+    }
+    // empty range call nothing
+    aris::parallel_for(scheduler, 5, 5, [](size_t) { TEST_CHECK(false); });
+}
+
+static void check_reduce(Scheduler* scheduler) {
+    const size_t count = 1000000;
+    uint64_t sum = aris::parallel_reduce<uint64_t>(scheduler, 0, count, 0,
+        [](size_t index) { return static_cast<uint64_t>(index); },
+        [](uint64_t a, uint64_t b) { return a + b; }, 1000);
+    TEST_CHECK(sum == static_cast<uint64_t>(count) * (count - 1) / 2);
+}
+
+static void check_transform(Scheduler* scheduler) {
+    std::vector<int> input(50000);
+    std::iota(input.begin(), input.end(), 0);
+    std::vector<std::string> output(input.size());
+    auto end = aris::parallel_transform(scheduler, input.begin(), input.end(), output.begin(),
+        [](int value) { return std::to_string(value * 3); }, 100);
+    TEST_CHECK(end == output.end());
+    for (size_t index = 0; index < input.size(); index++)
+        TEST_CHECK(output[index] == std::to_string(input[index] * 3));
+}
+
+static void check_sort(Scheduler* scheduler) {
+    std::mt19937 random(42);
+    // sizes around cutoff cover serial sort, odd block split and several merge rounds
+    for (size_t count : {0, 1, 100, 4096, 8193, 100000, 300001}) {
+        std::vector<uint32_t> values(count);
+        for (auto & value : values)
+            value = random() % 1000;
+        std::vector<uint32_t> expected = values;
+        std::sort(expected.begin(), expected.end());
+        aris::parallel_sort(scheduler, values.begin(), values.end());
+        TEST_CHECK(values == expected);
+    }
+    // value without default constructor is moved through buffer, small cutoff force merges
+    std::vector<std::string> words(20000);
+    for (auto & word : words)
+        word = std::to_string(random());
+    std::vector<std::string> expected = words;
+    std::sort(expected.begin(), expected.end(), std::greater<std::string>());
+    aris::parallel_sort(scheduler, words.begin(), words.end(), std::greater<std::string>(), 256);
+    TEST_CHECK(words == expected);
+}
+
+// first exception reach caller, indexes not started are skipped
+static void check_exception(Scheduler* scheduler) {
+    const size_t count = 1000000;
+    std::atomic<size_t> ran {0};
+    bool caught = false;
+    try {
+        aris::parallel_for(scheduler, 0, count, [&ran](size_t index) {
+            ran++;
+            if (index == 100)
+                throw std::runtime_error("index 100");
+        });
+    } catch (const std::runtime_error & e) {
+        caught = std::string(e.what()) == "index 100";
+    }
+    TEST_CHECK(caught);
+    TEST_CHECK(ran.load() < count);
+}
+
+static void check_all(Scheduler* scheduler) {
+    check_for(scheduler);
+    check_reduce(scheduler);
+    check_transform(scheduler);
+    check_sort(scheduler);
+    check_exception(scheduler);
+}
+
+// calling thread out of scheduler help and wait on cond
+static void test_from_outside() {
+    Scheduler scheduler(worker_count, "outside");
+    scheduler.start();
+    check_all(&scheduler);
+    scheduler.stop();
+    // no scheduler run serially
+    check_all(nullptr);
+}
+
+// worker fiber use current scheduler, it is hold instead of worker thread
+static void test_from_fiber() {
+    Scheduler scheduler(worker_count, "fiber");
+    scheduler.start();
+    run_in_fiber(scheduler, []() { check_all(nullptr); });
+    scheduler.stop();
+}
+
+// run fn below depth padded frames, callers wait at different stack offsets
+static void call_at_depth(int depth, const std::function<void()> & fn) {
+    volatile char pad[256];
+    for (size_t index = 0; index < sizeof(pad); index++)
+        pad[index] = static_cast<char>(0xa5);
+    if (depth == 0)
+        fn();
+    else
+        call_at_depth(depth - 1, fn);
+    TEST_CHECK(pad[0] == static_cast<char>(0xa5));
+}
+
+// shared stack callers hold while other callers run on the same stack,
+// finisher must not reach into swapped out stack to wake caller
+static void test_shared_caller() {
+    const int count = 16;
+    const int rounds = 10;
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    // one stack per worker, every switch between callers swap stack out
+    Fiber::set_shared_stack(1, 256 * 1024);
+    // sleep hold fiber, yielded shared fiber would run again before helpers
+    IOManager iom(2, "shared");
+    iom.set_hook_enable(true);
+    iom.start();
+    for (int key = 0; key < count; key++) {
+        iom.schedule(Fiber::ptr(new Fiber([key, &done, &broken]() {
+            call_at_depth(key % 4, [&broken]() {
+                Fiber* caller = Fiber::get_thread_current_fiber().get();
+                for (int round = 0; round < rounds; round++) {
+                    // helpers reach it while caller stack is swapped out, keep it off stack
+                    auto sum = std::make_shared<std::atomic<int>>(0);
+                    // helpers are slower, caller run out of chunks first and hold
+                    aris::parallel_for(nullptr, 0, 16, [caller, sum](size_t index) {
+                        usleep(Fiber::get_thread_current_fiber().get() == caller ? 100 : 1000);
+                        *sum += static_cast<int>(index);
+                    });
+                    if (sum->load() != 16 * 15 / 2)
+                        broken++;
+                }
+            });
+            done++;
+        }, 0, Fiber::StackMode::SHARED)));
+    }
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    iom.stop();
+}
+
+int main() {
+    test_from_outside();
+    test_from_fiber();
+    test_shared_caller();
+    printf("test_parallel passed\n");
+    return 0;
+}
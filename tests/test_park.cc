@@ -0,0 +1,110 @@
+/**
+ * @file test_park.cc
+ * @author aris
+ * @brief parked workers are woken by schedule from outside and from other workers, no wake up is lost
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+using aris::Scheduler;
+
+static const int worker_count = 4;
+
+// parked worker has no timeout, a lost wake up show as a task never run
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 2000 && done.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(done.load() == count);
+}
+
+static uint64_t elapsed_ms(uint64_t start) {
+    return (aris::test_now_ns() - start) / 1000000;
+}
+
+// task pushed from outside wake a parked worker, pinned task wake its own worker
+static void test_outside(const Scheduler::IdlePolicy & policy) {
+    const int rounds = 200;
+    Scheduler scheduler(worker_count, "outside");
+    scheduler.set_idle_policy(policy);
+    scheduler.start();
+    for (int round = 0; round < rounds; round++) {
+        // let all workers park now and then, otherwise some are still spinning
+        if (round % 20 == 0)
+            usleep(20000);
+        std::atomic<int> done {0};
+        int thread = round % 2 == 0 ? -1 : round / 2 % worker_count;
+        std::atomic<int> worker {-2};
+        uint64_t start = aris::test_now_ns();
+        scheduler.schedule([&done, &worker]() {
+            worker = Scheduler::get_thread_worker_index();
+            done++;
+        }, thread);
+        wait_for(done, 1);
+        TEST_CHECK(elapsed_ms(start) < 1000);
+        TEST_CHECK(thread == -1 || worker.load() == thread);
+    }
+    TEST_CHECK(scheduler.stop());
+}
+
+// chain of tasks each pinned to next worker, every hop wake a parked worker from a worker
+static void test_chain(const Scheduler::IdlePolicy & policy) {
+    const int hops = 5000;
+    Scheduler scheduler(worker_count, "chain");
+    scheduler.set_idle_policy(policy);
+    scheduler.start();
+    usleep(20000);
+    std::atomic<int> done {0};
+    std::atomic<int> wrong {0};
+    struct Hop {
+        static void run(Scheduler* scheduler, int left, int worker, std::atomic<int>* done, std::atomic<int>* wrong) {
+            if (Scheduler::get_thread_worker_index() != worker)
+                (*wrong)++;
+            if (left == 0) {
+                (*done)++;
+                return;
+            }
+            int next = (worker + 1) % worker_count;
+            scheduler->schedule([scheduler, left, next, done, wrong]() { run(scheduler, left - 1, next, done, wrong); }, next);
+        }
+    };
+    Scheduler* pointer = &scheduler;
+    scheduler.schedule([pointer, &done, &wrong]() { Hop::run(pointer, hops, 0, &done, &wrong); }, 0);
+    wait_for(done, 1);
+    TEST_CHECK(wrong.load() == 0);
+    TEST_CHECK(scheduler.stop());
+}
+
+// burst after all parked wake enough workers, then they all park again
+static void test_burst() {
+    const int count = 2000;
+    Scheduler scheduler(worker_count, "burst");
+    scheduler.start();
+    for (int round = 0; round < 5; round++) {
+        usleep(20000);
+        std::atomic<int> done {0};
+        for (int index = 0; index < count; index++)
+            scheduler.schedule([&done]() { done++; }, index % (worker_count + 1) - 1);
+        wait_for(done, count);
+    }
+    TEST_CHECK(scheduler.stop());
+}
+
+int main() {
+    test_outside(Scheduler::IdlePolicy::park());
+    test_outside(Scheduler::IdlePolicy::spin(200, 200));
+    test_chain(Scheduler::IdlePolicy::park());
+    test_chain(Scheduler::IdlePolicy::spin(200, 200));
+    test_burst();
+    printf("test_park passed\n");
+    return 0;
+}
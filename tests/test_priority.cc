@@ -0,0 +1,103 @@
+/**
+ * @file test_priority.cc
+ * @author aris
+ * @brief priority bands run high first, low band still progress under sustained high load
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "scheduler.h"
+#include "test.h"
+#include "utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using aris::Scheduler;
+
+// tasks queued before start run high, deadline by deadline, normal, then low
+static void test_band_order() {
+    aris::Mutex mutex;
+    std::string order;
+    auto record = [&mutex, &order](char tag) {
+        return [&mutex, &order, tag]() {
+            aris::Mutex::Lock lock(mutex);
+            order.push_back(tag);
+        };
+    };
+    Scheduler scheduler(1, "order");
+    // no aging in this test, low wait for normal
+    scheduler.set_aging(60 * 1000 * 1000);
+    auto now = std::chrono::steady_clock::now();
+    for (int round = 0; round < 4; round++) {
+        scheduler.schedule(record('l'), Scheduler::Priority::LOW);
+        scheduler.schedule(record('n'), Scheduler::Priority::NORMAL);
+        scheduler.schedule(record('h'), Scheduler::Priority::HIGH);
+    }
+    // later deadline pushed first still run after earlier one
+    scheduler.schedule_deadline(record('2'), now + std::chrono::seconds(2));
+    scheduler.schedule_deadline(record('1'), now + std::chrono::seconds(1));
+    scheduler.start();
+    scheduler.stop();
+    TEST_CHECK(order == "hhhh12nnnnllll");
+}
+
+// high and normal tasks keep rescheduling themselves, normal get turns between high streaks
+// and low run once it is aged
+static void test_no_starvation() {
+    std::atomic<bool> flooding {true};
+    std::atomic<uint64_t> high_runs {0};
+    std::atomic<uint64_t> normal_runs {0};
+    std::atomic<uint64_t> low_at {0};
+    Scheduler scheduler(1, "starve");
+    // aged low task run before others after 10ms
+    scheduler.set_aging(10 * 1000);
+    scheduler.start();
+    std::function<void()> high = [&]() {
+        high_runs++;
+        if (flooding.load())
+            Scheduler::get_thread_scheduler()->schedule(high, Scheduler::Priority::HIGH);
+    };
+    std::function<void()> normal = [&]() {
+        normal_runs++;
+        if (flooding.load())
+            Scheduler::get_thread_scheduler()->schedule(normal, Scheduler::Priority::NORMAL);
+    };
+    // several chains so bands are never empty
+    for (int chain = 0; chain < 4; chain++) {
+        scheduler.schedule(high, Scheduler::Priority::HIGH);
+        scheduler.schedule(normal, Scheduler::Priority::NORMAL);
+    }
+    usleep(10000);
+    uint64_t begin = aris::test_now_ns();
+    scheduler.schedule([&low_at]() { low_at = aris::test_now_ns(); }, Scheduler::Priority::LOW);
+    for (int round = 0; round < 200 && low_at.load() == 0; round++)
+        usleep(5000);
+    // floods are still going when low ran
+    TEST_CHECK(flooding.load());
+    flooding = false;
+    scheduler.stop();
+    TEST_CHECK(low_at.load() != 0);
+    TEST_CHECK(high_runs.load() > 1000 && normal_runs.load() > 100);
+    // high keep most turns, normal get one per high streak
+    TEST_CHECK(high_runs.load() > normal_runs.load() * 4);
+    // low wait about aging time, far below the one second limit
+    TEST_CHECK(low_at.load() - begin < 500 * 1000 * 1000ull);
+    printf("under flood: low ran after %.2f ms, %llu high runs, %llu normal runs\n",
+        (low_at.load() - begin) / 1e6, static_cast<unsigned long long>(high_runs.load()),
+        static_cast<unsigned long long>(normal_runs.load()));
+}
+
+int main() {
+    test_band_order();
+    test_no_starvation();
+    printf("test_priority passed\n");
+    return 0;
+}
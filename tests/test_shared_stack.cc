@@ -0,0 +1,405 @@
+/**
+ * @file test_shared_stack.cc
+ * @author aris
+ * @brief shared stack fibers on a multi worker scheduler
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "channel.h"
+#include "fiber.h"
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "task.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+using aris::Fiber;
+using aris::Scheduler;
+
+static const int worker_count = 4;
+
+// fill locals with fiber key, stack content must come back intact after each switch
+struct StackPattern {
+    explicit StackPattern(int key) {
+        for (int index = 0; index < size; index++)
+            values[index] = key * 131 + index;
+    }
+
+    bool check(int key) const {
+        for (int index = 0; index < size; index++) {
+            if (values[index] != key * 131 + index)
+                return false;
+        }
+        return true;
+    }
+
+    static const int size = 256;
+    volatile int values[size];
+};
+
+static Fiber::ptr new_shared_fiber(std::function<void()> cb) {
+    return Fiber::ptr(new Fiber(std::move(cb), 0, Fiber::StackMode::SHARED));
+}
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(10000);
+    TEST_CHECK(done.load() == count);
+}
+
+// fibers created on main thread take stacks of the worker they first run on
+static void test_created_outside() {
+    const int count = 64;
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "shared");
+    scheduler.start();
+    for (int key = 0; key < count; key++) {
+        scheduler.schedule(new_shared_fiber([key, &done, &broken]() {
+            StackPattern pattern(key);
+            for (int round = 0; round < 100; round++) {
+                Fiber::get_thread_current_fiber()->yield();
+                if (!pattern.check(key))
+                    broken++;
+            }
+            done++;
+        }));
+    }
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    scheduler.stop();
+}
+
+// fiber held and scheduled again from outside with any thread still resume on its worker
+static void test_reschedule_bound() {
+    const int count = 32;
+    const int rounds = 20;
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    std::vector<std::atomic<int>> held(count);
+    std::vector<Fiber::ptr> fibers;
+    Scheduler scheduler(worker_count, "bound");
+    scheduler.start();
+    for (int key = 0; key < count; key++) {
+        held[key] = 0;
+        fibers.push_back(new_shared_fiber([key, &held, &done, &broken]() {
+            StackPattern pattern(key);
+            pthread_t thread = pthread_self();
+            for (int round = 0; round < rounds; round++) {
+                held[key]++;
+                Fiber::get_thread_current_fiber()->hold();
+                if (!pthread_equal(thread, pthread_self()) || !pattern.check(key))
+                    broken++;
+            }
+            done++;
+        }));
+        scheduler.schedule(fibers.back());
+    }
+    for (int round = 1; round <= rounds; round++) {
+        for (int key = 0; key < count; key++) {
+            while (held[key].load() < round)
+                usleep(100);
+            scheduler.schedule(fibers[key]);
+        }
+    }
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    scheduler.stop();
+}
+
+// fiber bound to a thread out of scheduler is rejected instead of run on foreign stack
+static void test_reject_foreign() {
+    std::atomic<int> runs {0};
+    Fiber::ptr fiber = new_shared_fiber([&runs]() {
+        runs++;
+        Fiber::get_thread_current_fiber()->yield();
+        runs++;
+    });
+    // bound to main thread stack
+    fiber->resume();
+    Scheduler scheduler(worker_count, "foreign");
+    scheduler.start();
+    scheduler.schedule(fiber);
+    usleep(50000);
+    scheduler.stop();
+    TEST_CHECK(runs.load() == 1);
+    fiber->resume();
+    TEST_CHECK(runs.load() == 2);
+}
+
+static aris::Task<int> add_later(Scheduler* scheduler, int a, int b) {
+    // finish on other worker while awaiting fiber is hold
+    co_await aris::resume_on(scheduler);
+    co_return a + b;
+}
+
+static aris::Task<void> throw_later(Scheduler* scheduler) {
+    co_await aris::resume_on(scheduler);
+    throw std::runtime_error("task");
+}
+
+// result of awaited task is handed to fiber whose stack is swapped out
+static void test_await_in_fiber() {
+    const int count = 32;
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "await");
+    scheduler.start();
+    for (int key = 0; key < count; key++) {
+        scheduler.schedule(new_shared_fiber([key, &scheduler, &done, &broken]() {
+            StackPattern pattern(key);
+            for (int round = 0; round < 20; round++) {
+                if (aris::await_in_fiber(add_later(&scheduler, key, round)) != key + round)
+                    broken++;
+                try {
+                    aris::await_in_fiber(throw_later(&scheduler));
+                    broken++;
+                } catch (const std::runtime_error &) {
+                }
+                if (!pattern.check(key))
+                    broken++;
+            }
+            done++;
+        }));
+    }
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    scheduler.stop();
+}
+
+// contended lock park shared fibers, lock is handed between workers
+static void test_mutex() {
+    const int count = 32;
+    const int rounds = 100;
+    aris::FiberMutex mutex;
+    int counter = 0;
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "mutex");
+    scheduler.start();
+    for (int key = 0; key < count; key++) {
+        scheduler.schedule(new_shared_fiber([key, &mutex, &counter, &done, &broken]() {
+            StackPattern pattern(key);
+            for (int round = 0; round < rounds; round++) {
+                aris::FiberMutex::Lock lock(mutex);
+                int value = counter;
+                // hold lock across switch so others park on it
+                Fiber::get_thread_current_fiber()->yield();
+                counter = value + 1;
+            }
+            if (!pattern.check(key))
+                broken++;
+            done++;
+        }));
+    }
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    TEST_CHECK(counter == count * rounds);
+    scheduler.stop();
+}
+
+// consumers park on condition until producers push
+static void test_condition() {
+    const int consumers = 16;
+    const int producers = 4;
+    const int items = 200;
+    aris::FiberMutex mutex;
+    aris::FiberCondition cond;
+    std::deque<int> queue;
+    std::atomic<long> sum {0};
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "cond");
+    scheduler.start();
+    for (int key = 0; key < consumers; key++) {
+        scheduler.schedule(new_shared_fiber([key, &mutex, &cond, &queue, &sum, &done, &broken]() {
+            StackPattern pattern(key);
+            while (true) {
+                aris::FiberMutex::Lock lock(mutex);
+                cond.wait(mutex, [&queue]() { return !queue.empty(); });
+                int value = queue.front();
+                queue.pop_front();
+                lock.unlock();
+                // negative value tell consumer to leave
+                if (value < 0)
+                    break;
+                sum += value;
+            }
+            if (!pattern.check(key))
+                broken++;
+            done++;
+        }));
+    }
+    for (int key = 0; key < producers; key++) {
+        scheduler.schedule(new_shared_fiber([&mutex, &cond, &queue]() {
+            for (int item = 1; item <= items; item++) {
+                {
+                    aris::FiberMutex::Lock lock(mutex);
+                    queue.push_back(item);
+                }
+                cond.notify_one();
+                if (item % 16 == 0)
+                    Fiber::get_thread_current_fiber()->yield();
+            }
+        }));
+    }
+    for (int round = 0; round < 1000 && sum.load() < static_cast<long>(producers) * items * (items + 1) / 2; round++)
+        usleep(10000);
+    TEST_CHECK(sum.load() == static_cast<long>(producers) * items * (items + 1) / 2);
+    {
+        aris::FiberMutex::Lock lock(mutex);
+        for (int key = 0; key < consumers; key++)
+            queue.push_back(-1);
+    }
+    cond.notify_all();
+    wait_for(done, consumers);
+    TEST_CHECK(broken.load() == 0);
+    scheduler.stop();
+}
+
+// waiters park on semaphore, permits are posted by fibers and main thread
+static void test_semaphore() {
+    const int count = 32;
+    aris::FiberSemaphore semaphore(0);
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "semaphore");
+    scheduler.start();
+    for (int key = 0; key < count; key++) {
+        scheduler.schedule(new_shared_fiber([key, &semaphore, &done, &broken]() {
+            StackPattern pattern(key);
+            for (int round = 0; round < 10; round++)
+                semaphore.wait();
+            if (!pattern.check(key))
+                broken++;
+            done++;
+        }));
+    }
+    for (int key = 0; key < count / 2; key++) {
+        scheduler.schedule(new_shared_fiber([&semaphore]() {
+            for (int round = 0; round < 10; round++) {
+                semaphore.post();
+                Fiber::get_thread_current_fiber()->yield();
+            }
+        }));
+    }
+    for (int round = 0; round < count / 2 * 10; round++)
+        semaphore.post();
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    scheduler.stop();
+}
+
+// senders and receivers park with values handed between workers
+static void test_channel(size_t capacity) {
+    const int pairs = 8;
+    const int items = 200;
+    aris::Channel<std::string> channel(capacity);
+    std::atomic<long> sum {0};
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "channel");
+    scheduler.start();
+    for (int key = 0; key < pairs; key++) {
+        scheduler.schedule(new_shared_fiber([key, &channel, &done, &broken]() {
+            StackPattern pattern(key);
+            for (int item = 1; item <= items; item++) {
+                if (!channel.send(std::to_string(item)))
+                    broken++;
+            }
+            if (!pattern.check(key))
+                broken++;
+            done++;
+        }));
+        scheduler.schedule(new_shared_fiber([key, &channel, &sum, &done, &broken]() {
+            StackPattern pattern(key + pairs);
+            std::string value;
+            for (int item = 1; item <= items; item++) {
+                if (!channel.recv(value))
+                    broken++;
+                sum += std::stol(value);
+            }
+            if (!pattern.check(key + pairs))
+                broken++;
+            done++;
+        }));
+    }
+    wait_for(done, pairs * 2);
+    TEST_CHECK(broken.load() == 0);
+    TEST_CHECK(sum.load() == static_cast<long>(pairs) * items * (items + 1) / 2);
+    scheduler.stop();
+}
+
+// select parked on two channels, send not taken keep its value, close wake receivers
+static void test_select() {
+    const int count = 16;
+    aris::Channel<int> a;
+    aris::Channel<int> b;
+    aris::Channel<int> idle;
+    std::atomic<long> sum {0};
+    std::atomic<int> done {0};
+    std::atomic<int> broken {0};
+    Scheduler scheduler(worker_count, "select");
+    scheduler.start();
+    for (int key = 0; key < count; key++) {
+        scheduler.schedule(new_shared_fiber([key, &a, &b, &idle, &sum, &done, &broken]() {
+            StackPattern pattern(key);
+            while (true) {
+                int from_a = 0;
+                int from_b = 0;
+                int unsent = key;
+                aris::Select select;
+                select.recv(a, from_a).recv(b, from_b).send(idle, unsent);
+                int index = select.wait();
+                if (!select.ok())
+                    break;
+                if (index == 2 || unsent != key)
+                    broken++;
+                sum += index == 0 ? from_a : from_b;
+            }
+            if (!pattern.check(key))
+                broken++;
+            done++;
+        }));
+    }
+    for (int item = 1; item <= 100; item++) {
+        scheduler.schedule(new_shared_fiber([item, &a, &b]() {
+            (item % 2 ? a : b).send(item);
+        }));
+    }
+    for (int round = 0; round < 1000 && sum.load() < 5050; round++)
+        usleep(10000);
+    TEST_CHECK(sum.load() == 5050);
+    a.close();
+    wait_for(done, count);
+    TEST_CHECK(broken.load() == 0);
+    scheduler.stop();
+}
+
+int main() {
+    Fiber::set_shared_stack(2, 64 * 1024);
+    test_created_outside();
+    test_reschedule_bound();
+    test_reject_foreign();
+    test_await_in_fiber();
+    test_mutex();
+    test_condition();
+    test_semaphore();
+    test_channel(0);
+    test_channel(4);
+    test_select();
+    printf("test_shared_stack passed\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file test_stack_size.cc
+ * @author aris
+ * @brief adaptive stack size follow entry point when fiber is reset and reused
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "stack_profiler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+static std::atomic<int> done {0};
+
+// use far more than smallest size class
+static void deep_entry() {
+    volatile char buffer[200 * 1024];
+    memset(const_cast<char*>(buffer), 1, sizeof(buffer));
+    done++;
+}
+
+static void shallow_entry() {
+    done++;
+}
+
+static void run_once(void (*entry)(), size_t stacksize) {
+    aris::Fiber::ptr fiber(new aris::Fiber(entry, stacksize));
+    fiber->resume();
+}
+
+// fiber sized for shallow entry grow when reset with deep entry
+static void test_reset_grow() {
+    aris::Fiber::ptr fiber(new aris::Fiber(shallow_entry));
+    fiber->resume();
+    fiber->reset(deep_entry);
+    fiber->resume();
+    TEST_CHECK(fiber->get_fiber_state() == aris::Fiber::State::TERM);
+}
+
+// scheduler reuse term fibers of shallow funcs for deep funcs
+static void test_scheduler_reuse() {
+    done = 0;
+    aris::Scheduler scheduler(1, "stack");
+    scheduler.start();
+    for (int round = 0; round < 100; round++)
+        scheduler.schedule(round % 2 ? deep_entry : shallow_entry);
+    // small fixed stack fiber is never handed to other funcs
+    scheduler.schedule(aris::Fiber::ptr(new aris::Fiber(shallow_entry, 16 * 1024)));
+    for (int round = 0; round < 100; round++)
+        scheduler.schedule(deep_entry);
+    scheduler.stop();
+    TEST_CHECK(done.load() == 201);
+}
+
+int main() {
+    aris::StackProfiler::set_profiling(true);
+    aris::StackProfiler::set_adaptive(true);
+    // record peak of both entry points on big fixed stacks
+    run_once(deep_entry, 1024 * 1024);
+    for (int round = 0; round < 4; round++)
+        run_once(shallow_entry, 1024 * 1024);
+    test_reset_grow();
+    test_scheduler_reuse();
+    printf("test_stack_size passed\n");
+    return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file test_stats.cc
+ * @author aris
+ * @brief scheduler stats snapshot, build with and without ARIS_DISABLE_STATS
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+using aris::Scheduler;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(done.load() == count);
+}
+
+static void spin_us(uint64_t us) {
+    uint64_t end = aris::test_now_ns() + us * 1000;
+    while (aris::test_now_ns() < end) {
+    }
+}
+
+// tasks queued behind a busy worker show as its depth
+static void test_depth() {
+    const int count = 50;
+    Scheduler scheduler(2, "depth");
+    scheduler.start();
+    std::atomic<bool> release {false};
+    std::atomic<int> started {0};
+    std::atomic<int> done {0};
+    scheduler.schedule([&release, &started]() {
+        started++;
+        while (!release.load())
+            usleep(100);
+    }, 1);
+    wait_for(started, 1);
+    for (int index = 0; index < count; index++)
+        scheduler.schedule([&done]() { done++; }, 1);
+    Scheduler::Stats stats = scheduler.get_stats();
+    TEST_CHECK(stats.workers.size() == 2);
+    TEST_CHECK(stats.workers[1].index == 1 && stats.workers[1].active);
+    TEST_CHECK(stats.workers[1].depth == count);
+    TEST_CHECK(stats.total.depth == count);
+    release = true;
+    wait_for(done, count);
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(scheduler.get_stats().total.depth == 0);
+}
+
+// each run is counted on the worker that ran it, merged in total
+static void test_counts() {
+    const int first = 100;
+    const int second = 40;
+    const uint64_t spin = 200;
+    Scheduler scheduler(2, "counts");
+    scheduler.start();
+    std::atomic<int> done {0};
+    for (int index = 0; index < first; index++)
+        scheduler.schedule([&done, spin]() { spin_us(spin); done++; }, 0);
+    for (int index = 0; index < second; index++)
+        scheduler.schedule([&done, spin]() { spin_us(spin); done++; }, 1);
+    wait_for(done, first + second);
+    // run time is recorded after task return
+    TEST_CHECK(scheduler.stop());
+    Scheduler::Stats stats = scheduler.get_stats();
+    const Scheduler::WorkerStats & total = stats.total;
+    TEST_CHECK(total.index == -1);
+#ifndef ARIS_DISABLE_STATS
+    TEST_CHECK(stats.workers[0].tasks == first);
+    TEST_CHECK(stats.workers[1].tasks == second);
+    TEST_CHECK(total.tasks == first + second);
+    TEST_CHECK(total.run.count == total.tasks && total.wait.count == total.tasks);
+    TEST_CHECK(total.stolen == 0);
+    TEST_CHECK(total.run.min >= spin * 1000);
+    TEST_CHECK(total.run.min <= total.run.percentile(50) && total.run.percentile(50) <= total.run.percentile(99));
+    TEST_CHECK(total.run.percentile(99) <= total.run.max);
+    TEST_CHECK(total.busy_ns == total.run.sum && total.busy_ns >= (first + second) * spin * 1000);
+    TEST_CHECK(total.idle.count > 0 && total.idle_ns == total.idle.sum);
+    TEST_CHECK(total.utilization > 0 && total.utilization <= 1);
+    TEST_CHECK(stats.workers[0].busy_ns + stats.workers[1].busy_ns == total.busy_ns);
+#else
+    // collection compiled out, only depth is reported
+    TEST_CHECK(total.tasks == 0 && total.run.count == 0 && total.busy_ns == 0);
+    TEST_CHECK(total.utilization == 0);
+#endif
+}
+
+int main() {
+    test_depth();
+    test_counts();
+    printf("test_stats passed\n");
+    return 0;
+}
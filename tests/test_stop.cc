@@ -0,0 +1,173 @@
+/**
+ * @file test_stop.cc
+ * @author aris
+ * @brief stop policies of scheduler and iomanager waiting for pending events and timers
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "hook.h"
+#include "iomanager.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using aris::Fiber;
+using aris::IOManager;
+using aris::Scheduler;
+
+static uint64_t elapsed_ms(uint64_t start) {
+    return (aris::test_now_ns() - start) / 1000000;
+}
+
+// queued tasks all run before stop return
+static void test_drain() {
+    const int count = 10000;
+    Scheduler scheduler(4, "drain");
+    scheduler.start();
+    std::atomic<int> ran {0};
+    for (int index = 0; index < count; index++)
+        scheduler.schedule([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); });
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(ran.load() == count);
+    TEST_CHECK(scheduler.get_cancelled_count() == 0);
+    // no new func after stop
+    scheduler.schedule([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); });
+    TEST_CHECK(ran.load() == count);
+}
+
+// queued funcs are dropped, fibers hold forever do not keep workers
+static void test_cancel() {
+    const int count = 100000;
+    const int held_count = 8;
+    Scheduler scheduler(2, "cancel");
+    std::mutex mutex;
+    std::vector<Fiber::ptr> held;
+    std::atomic<int> ran {0};
+    scheduler.start();
+    for (int index = 0; index < held_count; index++) {
+        scheduler.schedule([&mutex, &held]() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                held.push_back(Fiber::get_thread_current_fiber());
+            }
+            Fiber::get_thread_current_fiber()->hold();
+        });
+    }
+    for (int index = 0; index < count; index++)
+        scheduler.schedule([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); });
+    uint64_t start = aris::test_now_ns();
+    TEST_CHECK(!scheduler.stop(Scheduler::StopPolicy::CANCEL));
+    TEST_CHECK(elapsed_ms(start) < 1000);
+    TEST_CHECK(ran.load() + scheduler.get_cancelled_count() + held.size() == count + held_count);
+    TEST_CHECK(scheduler.get_cancelled_count() > 0);
+}
+
+// many workers wake up and leave at once
+static void test_stop_prompt() {
+    Scheduler scheduler(32, "prompt");
+    scheduler.start();
+    // let workers park first
+    usleep(20000);
+    uint64_t start = aris::test_now_ns();
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(elapsed_ms(start) < 200);
+}
+
+// drain wait for timer not fired yet
+static void test_pending_timer() {
+    IOManager iom(2, "timer");
+    iom.start();
+    std::atomic<bool> fired {false};
+    uint64_t start = aris::test_now_ns();
+    iom.add_timer(50, [&fired]() { fired = true; });
+    TEST_CHECK(iom.stop());
+    TEST_CHECK(fired.load());
+    TEST_CHECK(elapsed_ms(start) >= 40);
+}
+
+// drain wait for fiber blocked in recv until datagram come
+static void test_pending_event() {
+    IOManager iom(2, "event");
+    iom.set_hook_enable(true);
+    iom.start();
+    std::atomic<int> port {0};
+    std::atomic<ssize_t> received {-1};
+    iom.schedule([&port, &received]() {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        TEST_CHECK(bind(fd, reinterpret_cast<sockaddr*>(&addr), len) == 0);
+        TEST_CHECK(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+        port = ntohs(addr.sin_port);
+        char buffer[16];
+        received = recv(fd, buffer, sizeof(buffer), 0);
+        close(fd);
+    });
+    for (int round = 0; round < 1000 && iom.get_pending_event_count() == 0; round++)
+        usleep(1000);
+    TEST_CHECK(iom.get_pending_event_count() == 1);
+    std::thread sender([&port]() {
+        usleep(30000);
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port.load());
+        TEST_CHECK(sendto(fd, "ping", 4, 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 4);
+        close(fd);
+    });
+    TEST_CHECK(iom.stop());
+    TEST_CHECK(received.load() == 4);
+    TEST_CHECK(iom.get_pending_event_count() == 0);
+    sender.join();
+}
+
+// fiber arm timers again while draining, idle worker that saw nothing pending
+// go idle again instead of spinning on its ended idle fiber
+static void test_rearm_while_draining() {
+    const int rounds = 200;
+    IOManager iom(2, "rearm");
+    iom.set_hook_enable(true);
+    iom.start();
+    std::atomic<int> slept {0};
+    iom.schedule([&slept]() {
+        for (int round = 0; round < rounds; round++) {
+            usleep(500);
+            slept++;
+        }
+    });
+    usleep(1000);
+    TEST_CHECK(iom.stop());
+    TEST_CHECK(slept.load() == rounds);
+#ifndef ARIS_DISABLE_STATS
+    // a few idle rounds per sleep, spinning worker record one per loop
+    TEST_CHECK(iom.get_stats().total.idle.count < static_cast<uint64_t>(rounds) * 20);
+#endif
+}
+
+int main() {
+    test_drain();
+    test_cancel();
+    test_stop_prompt();
+    test_pending_timer();
+    test_pending_event();
+    test_rearm_while_draining();
+    printf("test_stop passed\n");
+    return 0;
+}
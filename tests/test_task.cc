@@ -0,0 +1,142 @@
+/**
+ * @file test_task.cc
+ * @author aris
+ * @brief task hand value, exception and void completion to awaiting coroutine and fiber
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "task.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+using aris::Fiber;
+using aris::Scheduler;
+using aris::Task;
+
+static const int worker_count = 3;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(done.load() == count);
+}
+
+static Task<int> twice(int value) {
+    co_return value * 2;
+}
+
+static Task<std::unique_ptr<std::string>> name(Scheduler* scheduler, int value) {
+    // finish on another worker, move only value is moved out
+    co_await aris::resume_on(scheduler);
+    co_return std::make_unique<std::string>(std::to_string(value));
+}
+
+static Task<int> fail(Scheduler* scheduler) {
+    co_await aris::resume_on(scheduler);
+    throw std::runtime_error("fail");
+}
+
+static Task<void> add(Scheduler* scheduler, std::atomic<int>* counter, int value) {
+    co_await aris::resume_on(scheduler);
+    *counter += value;
+}
+
+// nested tasks awaited by coroutine, exception cross each co_await
+static Task<void> run_all(Scheduler* scheduler, int value, std::atomic<int>* counter,
+    std::atomic<int>* wrong, std::atomic<int>* done) {
+    if (co_await twice(value) != value * 2)
+        (*wrong)++;
+    std::unique_ptr<std::string> text = co_await name(scheduler, value);
+    if (!text || *text != std::to_string(value))
+        (*wrong)++;
+    try {
+        co_await fail(scheduler);
+        (*wrong)++;
+    } catch (const std::runtime_error & error) {
+        if (std::string(error.what()) != "fail")
+            (*wrong)++;
+    }
+    co_await add(scheduler, counter, value);
+    (*done)++;
+}
+
+static void test_spawn() {
+    const int count = 1000;
+    Scheduler scheduler(worker_count, "task");
+    scheduler.start();
+    std::atomic<int> counter {0};
+    std::atomic<int> wrong {0};
+    std::atomic<int> done {0};
+    for (int value = 0; value < count; value++)
+        aris::spawn(&scheduler, run_all(&scheduler, value, &counter, &wrong, &done));
+    wait_for(done, count);
+    TEST_CHECK(wrong.load() == 0);
+    TEST_CHECK(counter.load() == count * (count - 1) / 2);
+    TEST_CHECK(scheduler.stop());
+}
+
+// fiber hold until task finish, then continue on its worker and in its band
+static void test_await_in_fiber() {
+    const int count = 200;
+    const int target = 1;
+    Scheduler scheduler(worker_count, "await");
+    scheduler.start();
+    std::atomic<int> counter {0};
+    std::atomic<int> wrong {0};
+    std::atomic<int> done {0};
+    for (int value = 0; value < count; value++) {
+        scheduler.schedule([&scheduler, &counter, &wrong, &done, value]() {
+            Fiber::ptr self = Fiber::get_thread_current_fiber();
+            if (aris::await_in_fiber(twice(value)) != value * 2)
+                wrong++;
+            if (*aris::await_in_fiber(name(&scheduler, value)) != std::to_string(value))
+                wrong++;
+            try {
+                aris::await_in_fiber(fail(&scheduler));
+                wrong++;
+            } catch (const std::runtime_error &) {
+            }
+            aris::await_in_fiber(add(&scheduler, &counter, value));
+            if (Scheduler::get_thread_worker_index() != target)
+                wrong++;
+            if (Scheduler::get_resume_hint(self).priority != Scheduler::Priority::HIGH)
+                wrong++;
+            done++;
+        }, Scheduler::Priority::HIGH, target);
+    }
+    wait_for(done, count);
+    TEST_CHECK(wrong.load() == 0);
+    TEST_CHECK(counter.load() == count * (count - 1) / 2);
+    TEST_CHECK(scheduler.stop());
+}
+
+// main fiber has nothing to hold
+static void test_await_outside() {
+    bool thrown = false;
+    try {
+        aris::await_in_fiber(twice(1));
+    } catch (const std::logic_error &) {
+        thrown = true;
+    }
+    TEST_CHECK(thrown);
+}
+
+int main() {
+    test_spawn();
+    test_await_in_fiber();
+    test_await_outside();
+    printf("test_task passed\n");
+    return 0;
+}
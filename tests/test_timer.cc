@@ -0,0 +1,346 @@
+/**
+ * @file test_timer.cc
+ * @author aris
+ * @brief timing wheel on a fake clock, expiry order, wrap and cascade, far timers and timer control
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "timer.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+using aris::Timer;
+
+// wheel driven by hand, poll like a worker would
+class TestTimers : public aris::TimerManager {
+public:
+    TestTimers() : now(aris::test_now_ns() / 1000000) {
+        // wheel start from the real clock, settle it on the fake one
+        poll();
+    }
+
+    // run expired callbacks, return how many
+    size_t poll() {
+        std::vector<std::function<void()>> cbs;
+        list_expired_cbs(cbs);
+        for (auto & cb : cbs)
+            cb();
+        return cbs.size();
+    }
+
+    uint64_t now;
+    int front_changed = 0;
+
+protected:
+    void on_timer_front_changed() override { front_changed++; }
+    uint64_t get_now_ms() override { return now; }
+};
+
+// every timer fire at the first poll not before its deadline, in deadline order
+static void test_order() {
+    TestTimers timers;
+    const uint64_t start = timers.now;
+    std::vector<uint64_t> fired_at;
+    std::vector<int> order;
+    // around level 0 wrap and each upper level boundary
+    const std::vector<uint64_t> delays = {300, 5, 1, 255, 256, 257, 20, 16383, 16384, 16385, 1048575, 1048576, 1048577};
+    fired_at.assign(delays.size(), 0);
+    for (size_t index = 0; index < delays.size(); index++) {
+        timers.add_timer(delays[index], [&timers, &fired_at, &order, index]() {
+            fired_at[index] = timers.now;
+            order.push_back(static_cast<int>(index));
+        });
+    }
+    // step one tick before and at each deadline
+    std::vector<uint64_t> sorted = delays;
+    std::sort(sorted.begin(), sorted.end());
+    for (uint64_t delay : sorted) {
+        if (delay > 0 && start + delay - 1 > timers.now) {
+            timers.now = start + delay - 1;
+            timers.poll();
+        }
+        timers.now = std::max(timers.now, start + delay);
+        timers.poll();
+    }
+    TEST_CHECK(!timers.has_timer());
+    TEST_CHECK(order.size() == delays.size());
+    for (size_t index = 0; index < delays.size(); index++)
+        TEST_CHECK(fired_at[index] == start + delays[index]);
+    for (size_t index = 1; index < order.size(); index++)
+        TEST_CHECK(delays[order[index - 1]] <= delays[order[index]]);
+}
+
+// timer far beyond top level is parked and brought back, never fire early
+static void test_far() {
+    TestTimers timers;
+    const uint64_t start = timers.now;
+    const uint64_t delay = (1ull << 32) + 1000;
+    bool fired = false;
+    timers.add_timer(delay, [&fired]() { fired = true; });
+    Timer::ptr cancelled = timers.add_timer(1ull << 40, []() { TEST_CHECK(false); });
+    // sleep as long as wheel says, like idle does
+    int wakes = 0;
+    while (!fired) {
+        uint64_t wait = timers.get_next_timer();
+        TEST_CHECK(wait != ~0ull);
+        TEST_CHECK(timers.now + wait <= start + delay);
+        timers.now += wait;
+        timers.poll();
+        TEST_CHECK(fired == (timers.now >= start + delay));
+        TEST_CHECK(++wakes < 10000);
+    }
+    TEST_CHECK(timers.now == start + delay);
+    TEST_CHECK(timers.has_timer());
+    TEST_CHECK(cancelled->cancel());
+    TEST_CHECK(!timers.has_timer());
+    TEST_CHECK(timers.get_next_timer() == ~0ull);
+}
+
+static void test_cancel() {
+    TestTimers timers;
+    int fired = 0;
+    Timer::ptr timer = timers.add_timer(10, [&fired]() { fired++; });
+    int front = timers.front_changed;
+    TEST_CHECK(timer->cancel());
+    TEST_CHECK(!timer->cancel());
+    // last timer gone, poller may stop waiting for it
+    TEST_CHECK(timers.front_changed == front + 1);
+    TEST_CHECK(!timer->refresh());
+    TEST_CHECK(!timer->reset(20, true));
+    timers.now += 100;
+    timers.poll();
+    TEST_CHECK(fired == 0);
+    // fired timer can not be cancelled
+    timer = timers.add_timer(10, [&fired]() { fired++; });
+    timers.now += 10;
+    timers.poll();
+    TEST_CHECK(fired == 1);
+    TEST_CHECK(!timer->cancel());
+}
+
+static void test_refresh_reset() {
+    TestTimers timers;
+    const uint64_t start = timers.now;
+    uint64_t fired_at = 0;
+    auto cb = [&timers, &fired_at]() { fired_at = timers.now; };
+    // refresh count again from now
+    Timer::ptr timer = timers.add_timer(100, cb);
+    timers.now = start + 60;
+    timers.poll();
+    TEST_CHECK(timer->refresh());
+    timers.now = start + 159;
+    timers.poll();
+    TEST_CHECK(fired_at == 0);
+    timers.now = start + 160;
+    timers.poll();
+    TEST_CHECK(fired_at == start + 160);
+    // reset keep old start unless from now
+    fired_at = 0;
+    timer = timers.add_timer(100, cb);
+    timers.now = start + 200;
+    timers.poll();
+    TEST_CHECK(timer->reset(300, false));
+    timers.now = start + 459;
+    timers.poll();
+    TEST_CHECK(fired_at == 0);
+    timers.now = start + 460;
+    timers.poll();
+    TEST_CHECK(fired_at == start + 460);
+    fired_at = 0;
+    timer = timers.add_timer(100, cb);
+    TEST_CHECK(timer->reset(50, true));
+    timers.now = start + 510;
+    timers.poll();
+    TEST_CHECK(fired_at == start + 510);
+    // shorten to a deadline already passed, fire on next poll
+    fired_at = 0;
+    timer = timers.add_timer(1000, cb);
+    timers.now = start + 700;
+    TEST_CHECK(timer->reset(10, false));
+    timers.poll();
+    TEST_CHECK(fired_at == start + 700);
+}
+
+static void test_recurring() {
+    TestTimers timers;
+    int fired = 0;
+    Timer::ptr timer = timers.add_timer(10, [&fired]() { fired++; }, true);
+    for (int tick = 0; tick < 1000; tick++) {
+        timers.now++;
+        timers.poll();
+    }
+    TEST_CHECK(fired == 100);
+    // late poll fire once, then count from that poll
+    timers.now += 35;
+    timers.poll();
+    TEST_CHECK(fired == 101);
+    timers.now += 9;
+    timers.poll();
+    TEST_CHECK(fired == 101);
+    timers.now += 1;
+    timers.poll();
+    TEST_CHECK(fired == 102);
+    TEST_CHECK(timer->cancel());
+    timers.now += 100;
+    timers.poll();
+    TEST_CHECK(fired == 102);
+    TEST_CHECK(!timers.has_timer());
+}
+
+static void test_condition() {
+    TestTimers timers;
+    int fired = 0;
+    auto alive = std::make_shared<int>(0);
+    auto gone = std::make_shared<int>(0);
+    timers.add_condition_timer(10, [&fired]() { fired++; }, alive);
+    timers.add_condition_timer(10, [&fired]() { fired += 100; }, gone);
+    gone.reset();
+    timers.now += 10;
+    TEST_CHECK(timers.poll() == 2);
+    TEST_CHECK(fired == 1);
+}
+
+// poller is told only when new timer is earlier than its wake up
+static void test_front_changed() {
+    TestTimers timers;
+    TEST_CHECK(timers.get_next_timer() == ~0ull);
+    timers.add_timer(100, []() {});
+    TEST_CHECK(timers.front_changed == 1);
+    TEST_CHECK(timers.get_next_timer() <= 100);
+    timers.add_timer(200, []() {});
+    TEST_CHECK(timers.front_changed == 1);
+    timers.add_timer(50, []() {});
+    TEST_CHECK(timers.front_changed == 2);
+}
+
+// random add, cancel, refresh, reset and clock steps against a plain list of deadlines
+static void test_random() {
+    struct Expect {
+        Timer::ptr timer;
+        uint64_t ms;
+        uint64_t expire;
+        uint64_t due;
+        bool recurring;
+        bool alive;
+    };
+    TestTimers timers;
+    std::mt19937_64 random(7);
+    std::vector<Expect> expects;
+    std::vector<size_t> fired;
+    // ids not seen dead at last poll
+    std::vector<size_t> live;
+    uint64_t last_poll = timers.now;
+    // expired deadline go to next tick wheel has not passed
+    auto due_of = [&last_poll](uint64_t expire) { return std::max(expire, last_poll + 1); };
+    auto pick_ms = [&random]() -> uint64_t {
+        switch (random() % 8) {
+        case 0: return 0;
+        case 1: return random() % (1ull << 22);
+        case 2: case 3: return random() % 20000;
+        default: return random() % 300;
+        }
+    };
+    for (int op = 0; op < 200000; op++) {
+        switch (random() % 10) {
+        case 0: case 1: case 2: {
+            size_t id = expects.size();
+            uint64_t ms = pick_ms();
+            bool recurring = ms > 0 && random() % 4 == 0;
+            Timer::ptr timer = timers.add_timer(ms, [&fired, id]() { fired.push_back(id); }, recurring);
+            expects.push_back({timer, ms, timers.now + ms, due_of(timers.now + ms), recurring, true});
+            live.push_back(id);
+            break;
+        }
+        case 3: case 4: case 5: {
+            // ignore the few jumps that would take long, they are covered above
+            uint64_t step = random() % 8 == 0 ? random() % 100000 : random() % 300;
+            timers.now += step;
+            break;
+        }
+        default: {
+            if (live.empty())
+                break;
+            Expect & expect = expects[live[random() % live.size()]];
+            int kind = random() % 3;
+            if (kind == 0) {
+                TEST_CHECK(expect.timer->cancel() == expect.alive);
+                expect.alive = false;
+            } else if (kind == 1) {
+                TEST_CHECK(expect.timer->refresh() == expect.alive);
+                expect.expire = timers.now + expect.ms;
+            } else {
+                uint64_t ms = pick_ms();
+                if (expect.recurring && ms == 0)
+                    ms = 1;
+                bool from_now = random() % 2 == 0;
+                bool changed = ms != expect.ms || from_now;
+                TEST_CHECK(expect.timer->reset(ms, from_now) == (expect.alive || !changed));
+                if (expect.alive && changed) {
+                    expect.expire = (from_now ? timers.now : expect.expire - expect.ms) + ms;
+                    expect.ms = ms;
+                }
+            }
+            if (expect.alive)
+                expect.due = due_of(expect.expire);
+            break;
+        }
+        }
+        if (op % 3 == 0) {
+            uint64_t first = ~0ull;
+            for (size_t id : live) {
+                if (expects[id].alive)
+                    first = std::min(first, expects[id].due);
+            }
+            uint64_t wait = timers.get_next_timer();
+            TEST_CHECK((wait == ~0ull) == (first == ~0ull));
+            if (wait != ~0ull)
+                TEST_CHECK(timers.now + wait <= std::max(first, timers.now));
+        }
+        if (op % 2 == 0) {
+            fired.clear();
+            timers.poll();
+            last_poll = timers.now;
+            uint64_t prev_due = 0;
+            for (size_t id : fired) {
+                Expect & expect = expects[id];
+                TEST_CHECK(expect.alive && expect.due <= timers.now);
+                TEST_CHECK(expect.due >= prev_due);
+                prev_due = expect.due;
+                if (expect.recurring) {
+                    expect.expire = timers.now + expect.ms;
+                    expect.due = due_of(expect.expire);
+                } else {
+                    expect.alive = false;
+                }
+            }
+            live.erase(std::remove_if(live.begin(), live.end(),
+                [&expects](size_t id) { return !expects[id].alive; }), live.end());
+            for (size_t id : live)
+                TEST_CHECK(expects[id].due > timers.now);
+            TEST_CHECK(timers.has_timer() == !live.empty());
+        }
+    }
+}
+
+int main() {
+    test_order();
+    test_far();
+    test_cancel();
+    test_refresh_reset();
+    test_recurring();
+    test_condition();
+    test_front_changed();
+    test_random();
+    printf("test_timer passed\n");
+    return 0;
+}
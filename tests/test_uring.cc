@@ -0,0 +1,249 @@
+/**
+ * @file test_uring.cc
+ * @author aris
+ * @brief io ops on files, pipes and loopback sockets, with io_uring backend and epoll fallback
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "iomanager.h"
+#include "macro.h"
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using aris::IOManager;
+
+static const int worker_count = 2;
+static const size_t block = 4096;
+
+static void wait_for(std::atomic<int> & done, int count) {
+    for (int round = 0; round < 1000 && done.load() < count; round++)
+        usleep(10000);
+    TEST_CHECK(done.load() == count);
+}
+
+// run check on a worker fiber and wait it
+static void run_in_fiber(IOManager & iom, std::function<void()> check) {
+    std::atomic<int> done {0};
+    iom.schedule([&check, &done]() {
+        check();
+        done++;
+    });
+    wait_for(done, 1);
+}
+
+// op may resume fiber on other worker, errno address must be taken again after it
+static ARIS_NOINLINE int last_errno() {
+    return errno;
+}
+
+static int make_file() {
+    char path[] = "/tmp/test_uring_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_CHECK(fd >= 0);
+    unlink(path);
+    return fd;
+}
+
+// many fibers write blocks at offsets, sync and read them back, ops of a worker share one submit
+static void check_file(IOManager & iom) {
+    const int fibers = 16;
+    const int blocks = 16;
+    int fd = make_file();
+    std::atomic<int> done {0};
+    for (int key = 0; key < fibers; key++) {
+        iom.schedule([&iom, &done, fd, key]() {
+            std::vector<char> buffer(block);
+            for (int index = 0; index < blocks; index++) {
+                int64_t offset = static_cast<int64_t>((key * blocks + index) * block);
+                memset(buffer.data(), 'a' + (key + index) % 26, block);
+                TEST_CHECK(iom.io_write(fd, buffer.data(), block, offset) == static_cast<ssize_t>(block));
+            }
+            TEST_CHECK(iom.io_fsync(fd, key % 2 == 0) == 0);
+            for (int index = 0; index < blocks; index++) {
+                int64_t offset = static_cast<int64_t>((key * blocks + index) * block);
+                TEST_CHECK(iom.io_read(fd, buffer.data(), block, offset) == static_cast<ssize_t>(block));
+                TEST_CHECK(buffer[0] == 'a' + (key + index) % 26 && buffer[block - 1] == buffer[0]);
+            }
+            done++;
+        });
+    }
+    wait_for(done, fibers);
+    // offset -1 use and move file position
+    run_in_fiber(iom, [&iom, fd]() {
+        TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+        std::vector<char> buffer(8);
+        TEST_CHECK(iom.io_write(fd, "12345678", 8) == 8);
+        TEST_CHECK(iom.io_read(fd, buffer.data(), 8) == 8);
+        TEST_CHECK(lseek(fd, 0, SEEK_CUR) == 16);
+        TEST_CHECK(buffer[0] == 'a');
+    });
+    close(fd);
+}
+
+// registered buffers with registered file index, epoll fall back to plain read and write
+static void check_fixed(IOManager & iom) {
+    const int count = 4;
+    int fd = make_file();
+    std::vector<char> memory(count * block);
+    std::vector<iovec> buffers;
+    for (int index = 0; index < count; index++)
+        buffers.push_back({memory.data() + index * block, block});
+    TEST_CHECK(iom.register_buffers(buffers));
+    TEST_CHECK(iom.register_files({fd}));
+    std::atomic<int> done {0};
+    for (int index = 0; index < count; index++) {
+        iom.schedule([&iom, &memory, &done, index]() {
+            char* buffer = memory.data() + index * block;
+            int64_t offset = static_cast<int64_t>(index * block);
+            memset(buffer, 'A' + index, block);
+            TEST_CHECK(iom.io_write_fixed(0, buffer, block, offset, index, IOManager::IO_FIXED_FILE) == static_cast<ssize_t>(block));
+            memset(buffer, 0, block);
+            TEST_CHECK(iom.io_read_fixed(0, buffer, block, offset, index, IOManager::IO_FIXED_FILE) == static_cast<ssize_t>(block));
+            TEST_CHECK(buffer[0] == 'A' + index && buffer[block - 1] == 'A' + index);
+            TEST_CHECK(iom.io_fsync(0, true, IOManager::IO_FIXED_FILE) == 0);
+            done++;
+        });
+    }
+    wait_for(done, count);
+    char byte = 0;
+    TEST_CHECK(pread(fd, &byte, 1, 3 * block) == 1 && byte == 'D');
+    // unknown file index fail as bad fd
+    run_in_fiber(iom, [&iom]() {
+        char buffer[8];
+        TEST_CHECK(iom.io_read(5, buffer, sizeof(buffer), 0, IOManager::IO_FIXED_FILE) == -1);
+        TEST_CHECK(last_errno() == EBADF);
+    });
+    TEST_CHECK(iom.register_files({}));
+    close(fd);
+}
+
+// reader wait on empty pipe until a plain thread write
+static void check_pipe(IOManager & iom, bool nonblock) {
+    int fds[2];
+    TEST_CHECK(pipe2(fds, nonblock ? O_NONBLOCK : 0) == 0);
+    std::atomic<int> done {0};
+    std::atomic<ssize_t> received {0};
+    iom.schedule([&iom, &done, &received, fds]() {
+        char buffer[16];
+        ssize_t n = 0;
+        while (received.load() < 8 && (n = iom.io_read(fds[0], buffer, sizeof(buffer))) > 0)
+            received += n;
+        done++;
+    });
+    std::thread writer([fds]() {
+        usleep(20000);
+        TEST_CHECK(write(fds[1], "ping", 4) == 4);
+        usleep(10000);
+        TEST_CHECK(write(fds[1], "pong", 4) == 4);
+    });
+    wait_for(done, 1);
+    TEST_CHECK(received.load() == 8);
+    writer.join();
+    // end of file read 0
+    close(fds[1]);
+    run_in_fiber(iom, [&iom, fds]() {
+        char buffer[4];
+        TEST_CHECK(iom.io_read(fds[0], buffer, sizeof(buffer)) == 0);
+    });
+    close(fds[0]);
+}
+
+// accept on non blocking loopback socket before client connect
+static void check_accept(IOManager & iom) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    TEST_CHECK(listener >= 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    TEST_CHECK(bind(listener, reinterpret_cast<sockaddr*>(&addr), len) == 0);
+    TEST_CHECK(getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+    TEST_CHECK(listen(listener, 16) == 0);
+    std::atomic<int> done {0};
+    iom.schedule([&iom, &done, listener]() {
+        sockaddr_in peer {};
+        socklen_t peer_len = sizeof(peer);
+        int fd = iom.io_accept(listener, reinterpret_cast<sockaddr*>(&peer), &peer_len);
+        TEST_CHECK(fd >= 0);
+        TEST_CHECK(peer_len == sizeof(peer) && peer.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+        char buffer[4];
+        TEST_CHECK(iom.io_read(fd, buffer, sizeof(buffer)) == 4 && memcmp(buffer, "ping", 4) == 0);
+        TEST_CHECK(iom.io_write(fd, "pong", 4) == 4);
+        close(fd);
+        done++;
+    });
+    std::thread client([addr]() {
+        usleep(20000);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        TEST_CHECK(connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+        TEST_CHECK(write(fd, "ping", 4) == 4);
+        char buffer[4];
+        TEST_CHECK(read(fd, buffer, sizeof(buffer)) == 4 && memcmp(buffer, "pong", 4) == 0);
+        close(fd);
+    });
+    wait_for(done, 1);
+    client.join();
+    close(listener);
+}
+
+// failed op return -1 and errno like syscall, outside fiber op is a plain syscall
+static void check_errors(IOManager & iom) {
+    run_in_fiber(iom, [&iom]() {
+        char buffer[4];
+        TEST_CHECK(iom.io_read(-1, buffer, sizeof(buffer), 0) == -1);
+        TEST_CHECK(last_errno() == EBADF);
+        TEST_CHECK(iom.io_fsync(-1) == -1);
+        TEST_CHECK(last_errno() == EBADF);
+    });
+    int fd = make_file();
+    TEST_CHECK(iom.io_write(fd, "main", 4, 0) == 4);
+    char buffer[4];
+    TEST_CHECK(iom.io_read(fd, buffer, sizeof(buffer), 0) == 4 && memcmp(buffer, "main", 4) == 0);
+    TEST_CHECK(iom.io_fsync(fd) == 0);
+    close(fd);
+}
+
+static void test_backend(IOManager::IoBackend backend) {
+    IOManager iom(worker_count, "uring");
+    // small batch so full batch submit is taken too
+    if (!iom.set_io_backend(backend, 64, 4)) {
+        printf("io_uring is not supported, skip\n");
+        return;
+    }
+    TEST_CHECK(iom.get_io_backend() == backend);
+    iom.start();
+    check_file(iom);
+    check_fixed(iom);
+    check_pipe(iom, true);
+    // ring wait on blocking fd, epoll would block worker
+    if (backend == IOManager::IoBackend::URING)
+        check_pipe(iom, false);
+    check_accept(iom);
+    check_errors(iom);
+    TEST_CHECK(iom.stop());
+}
+
+int main() {
+    test_backend(IOManager::IoBackend::URING);
+    test_backend(IOManager::IoBackend::EPOLL);
+    printf("test_uring passed\n");
+    return 0;
+}
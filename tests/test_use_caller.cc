@@ -0,0 +1,93 @@
+/**
+ * @file test_use_caller.cc
+ * @author aris
+ * @brief use_caller scheduler run tasks of worker 0 on the thread calling start, when it call stop
+ * @version 0.1
+ * @date 2022-03-01
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <pthread.h>
+#include <unistd.h>
+
+using aris::Fiber;
+using aris::Scheduler;
+
+// caller is the only worker, nothing run until stop drain there
+static void test_single() {
+    const int count = 1000;
+    const pthread_t caller = pthread_self();
+    Scheduler scheduler(1, "caller", true);
+    scheduler.start();
+    TEST_CHECK(Scheduler::get_thread_scheduler() == &scheduler);
+    TEST_CHECK(Scheduler::get_thread_worker_index() == 0);
+    std::atomic<int> ran {0};
+    std::atomic<int> elsewhere {0};
+    auto check = [&ran, &elsewhere, caller]() {
+        if (!pthread_equal(pthread_self(), caller) || Scheduler::get_thread_worker_index() != 0)
+            elsewhere++;
+        ran++;
+    };
+    for (int index = 0; index < count; index++)
+        scheduler.schedule(check);
+    // task scheduled while draining and yielding fiber run too
+    scheduler.schedule([&scheduler, &check]() {
+        for (int index = 0; index < count; index++)
+            scheduler.schedule(check);
+        Fiber::get_thread_current_fiber()->yield();
+        check();
+    });
+    usleep(10000);
+    TEST_CHECK(ran.load() == 0);
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(ran.load() == count * 2 + 1);
+    TEST_CHECK(elsewhere.load() == 0);
+    // caller is a plain thread again
+    TEST_CHECK(Scheduler::get_thread_scheduler() == nullptr);
+    TEST_CHECK(Scheduler::get_thread_worker_index() == -1);
+}
+
+// other workers run shared tasks, tasks pinned to worker 0 wait for caller
+static void test_pinned() {
+    const int count = 500;
+    const pthread_t caller = pthread_self();
+    Scheduler scheduler(3, "caller_pinned", true);
+    scheduler.start();
+    std::atomic<int> shared {0};
+    std::atomic<int> pinned {0};
+    std::atomic<int> elsewhere {0};
+    for (int index = 0; index < count; index++) {
+        scheduler.schedule([&pinned, &elsewhere, caller]() {
+            if (!pthread_equal(pthread_self(), caller))
+                elsewhere++;
+            pinned++;
+        }, 0);
+    }
+    // pushed from a worker, go to global queue
+    scheduler.schedule([&scheduler, &shared]() {
+        for (int index = 0; index < count; index++)
+            scheduler.schedule([&shared]() { shared++; });
+    }, 1);
+    for (int round = 0; round < 1000 && shared.load() < count; round++)
+        usleep(1000);
+    TEST_CHECK(shared.load() == count);
+    TEST_CHECK(pinned.load() == 0);
+    TEST_CHECK(scheduler.stop());
+    TEST_CHECK(pinned.load() == count);
+    TEST_CHECK(elsewhere.load() == 0);
+}
+
+int main() {
+    test_single();
+    test_pinned();
+    printf("test_use_caller passed\n");
+    return 0;
+}